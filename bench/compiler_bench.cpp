@@ -0,0 +1,31 @@
+#include <benchmark/benchmark.h>
+
+#include "corpus.hpp"
+#include "tsbl/bytecode.hpp"
+#include "tsbl/compiler.hpp"
+#include "tsbl/lexer.hpp"
+
+using namespace tsbl;
+
+static void BM_Compiler_Compile(benchmark::State & state) {
+    std::string data = bench::make_script((size_t)state.range(0));
+    Chunk chunk;
+    for (auto _ : state) {
+        Lexer lexer;
+        lexer.read((const uint8_t *)data.data(), data.size());
+        chunk.clear();
+        Compiler compiler(lexer, chunk);
+        if (!compiler.compile()) {
+            state.SkipWithError(compiler.error().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(chunk.code());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    // Source lines compiled per second
+    state.counters["lines"] = benchmark::Counter(
+        (double)state.range(0) * state.iterations(),
+        benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Compiler_Compile)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
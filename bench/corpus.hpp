@@ -0,0 +1,140 @@
+#pragma once
+#ifndef TSBL_BENCH_CORPUS_HPP
+#define TSBL_BENCH_CORPUS_HPP
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace tsbl::bench {
+    /**
+     * \brief The kinds of source text the benchmarks are run over
+     */
+    enum class Corpus {
+        Ascii,       //< Mixed statements, like the scripts we load at startup
+        Identifiers, //< Long identifier runs with few operators
+        Strings,     //< Mostly string literals, some with escapes
+        Numeric,     //< Tables of integer and real literals
+        Cjk          //< Identifiers in CJK, three bytes per character
+    };
+
+    inline const char * corpus_block(Corpus kind) {
+        switch (kind) {
+        case Corpus::Identifiers:
+            return
+                "alpha beta_gamma delta_epsilon_zeta eta theta iota_kappa\n"
+                "lambda_mu nu xi omicron_pi rho sigma_tau upsilon phi_chi\n"
+                "psi omega counter_total limit message_text state_value\n";
+        case Corpus::Strings:
+            return
+                "log(\"state updated\", \"counter reached its limit\")\n"
+                "name = 'a much longer single quoted string value'\n"
+                "path = \"C:\\\\scripts\\\\boot.tsbl\\tloaded\\n\"\n"
+                "doc = \"\"\"A long string\nover two lines\"\"\"\n";
+        case Corpus::Numeric:
+            return
+                "table = [ 0, 1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233 ]\n"
+                "reals = [ 0.5, 3.14159, 2.71828, 1.5e3, 6.02e23, 42.0 ]\n"
+                "big = [ 4294967296, 18446744073, 123456789012345 ]\n";
+        case Corpus::Cjk:
+            // Written as bytes to keep the source ASCII
+            return
+                "\xe5\xae\x9a\xe4\xb9\x89 " "\xe7\x8a\xb6\xe6\x80\x81 " "= "
+                "\xe8\xae\xa1\xe6\x95\xb0\xe5\x99\xa8 " "+ "
+                "\xe9\x99\x90\xe5\x88\xb6\n"
+                "\xe6\xb6\x88\xe6\x81\xaf\xe6\x96\x87\xe6\x9c\xac " "= "
+                "\xe5\x90\x8d\xe5\xad\x97 " "* " "\xe6\x95\xb0\xe9\x87\x8f\n"
+                "\xe8\xbf\x94\xe5\x9b\x9e "
+                "\xe7\xbb\x93\xe6\x9e\x9c_\xe5\x80\xbc " "!= "
+                "\xe9\x9b\xb6\n";
+        case Corpus::Ascii:
+        default:
+            return
+                "def update_state(counter, limit)\n"
+                "    total = counter * 2 + limit ** 3 - 17\n"
+                "    while total >= limit { total = total >> 1 }\n"
+                "    message = \"state updated\"\n"
+                "    return total != 0\n";
+        }
+    }
+
+    /**
+     * \brief Build a source text of exactly `size` bytes
+     *
+     * The text is a repeating block of the given kind. It is cut on a
+     * character boundary and padded with spaces, so it always decodes.
+     */
+    inline std::string make_corpus(size_t size, Corpus kind = Corpus::Ascii) {
+        const char * block = corpus_block(kind);
+        std::string data;
+        data.reserve(size + 256);
+        while (data.size() < size) {
+            data += block;
+        }
+        size_t end = size;
+        while (end > 0 && ((uint8_t)data[end] & 0xC0) == 0x80) {
+            end -= 1;
+        }
+        data.resize(end);
+        data.resize(size, ' ');
+        return data;
+    }
+
+    /**
+     * \brief Build a program of `lines` lines which the Compiler accepts
+     *
+     * A repeating block of assignments, conditionals and loops over a
+     * hundred variables, so constants and locals are shared the way they
+     * would be in a real script.
+     */
+    inline std::string make_script(size_t lines) {
+        std::string data;
+        data.reserve(lines * 32);
+        for (size_t i = 0, line = 0; line < lines; ++i) {
+            std::string x = "x" + std::to_string(i % 100);
+            std::string y = "y" + std::to_string((i + 7) % 100);
+            if (i < 100) {
+                // Declare both before any of the others reads them
+                data += x + " = " + std::to_string(i) + "\n";
+                data += y + " = " + std::to_string(i) + ".5\n";
+                line += 2;
+                continue;
+            }
+            data += x + " = " + x + " * 3 + " + y + " - 17\n";
+            data += "if " + x + " >= 1000 {\n";
+            data += "    " + x + " = " + x + " >> 2\n";
+            data += "} else {\n";
+            data += "    " + y + " = (" + y + " + 0.25) / 2\n";
+            data += "}\n";
+            data += "while " + x + " > 64 { " + x + " = " + x + " - 64 }\n";
+            data += y + "++\n";
+            line += 8;
+        }
+        return data;
+    }
+
+    /**
+     * \brief Get the path of a corpus file of `size` bytes, creating it once
+     *
+     * Files are written next to the benchmark executable and are reused by
+     * later runs.
+     */
+    inline std::string corpus_file(size_t size) {
+        std::string path = "tsbl_corpus_" + std::to_string(size) + ".tsbl";
+        std::ifstream existing(path, std::ios::binary | std::ios::ate);
+        if (existing && (size_t)existing.tellg() == size) {
+            return path;
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        std::string block = make_corpus(size < (1 << 24) ? size : (1 << 24));
+        for (size_t written = 0; written < size; written += block.size()) {
+            size_t count = size - written;
+            out.write(block.data(), count < block.size() ? count : block.size());
+        }
+        return path;
+    }
+}
+
+#endif
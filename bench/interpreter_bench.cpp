@@ -0,0 +1,300 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+
+#include "tsbl/bytecode.hpp"
+#include "tsbl/compiler.hpp"
+#include "tsbl/image.hpp"
+#include "tsbl/interpreter.hpp"
+
+using namespace tsbl;
+
+// i = 0, sum = 0
+// while (i < count) { sum = sum + i * 3, i = i + 1 }
+// return sum
+//
+// Returns the instructions run per iteration
+static size_t int_loop(Chunk & chunk, int64_t count) {
+    uint16_t zero = (uint16_t)chunk.add_constant(Value::FromInt(0));
+    uint16_t three = (uint16_t)chunk.add_constant(Value::FromInt(3));
+    uint16_t limit = (uint16_t)chunk.add_constant(Value::FromInt(count));
+    chunk.set_locals(2);
+    chunk.emit(Opcode::Constant, zero, 1);
+    chunk.emit(Opcode::SetLocal, 0, 1);
+    chunk.emit(Opcode::SetLocal, 1, 1);
+    chunk.emit(Opcode::Pop, 1);
+
+    size_t loop = chunk.size();
+    chunk.emit(Opcode::GetLocal, 0, 2);
+    chunk.emit(Opcode::Constant, limit, 2);
+    chunk.emit(Opcode::Less, 2);
+    size_t exit = chunk.emit_jump(Opcode::JumpIfFalse, 2);
+    chunk.emit(Opcode::GetLocal, 1, 3);
+    chunk.emit(Opcode::GetLocal, 0, 3);
+    chunk.emit(Opcode::Constant, three, 3);
+    chunk.emit(Opcode::Multiply, 3);
+    chunk.emit(Opcode::Plus, 3);
+    chunk.emit(Opcode::SetLocal, 1, 3);
+    chunk.emit(Opcode::Pop, 3);
+    chunk.emit(Opcode::GetLocal, 0, 4);
+    chunk.emit(Opcode::Increment, 4);
+    chunk.emit(Opcode::SetLocal, 0, 4);
+    chunk.emit(Opcode::Pop, 4);
+    chunk.emit_loop(loop, 4);
+    chunk.patch_jump(exit);
+
+    chunk.emit(Opcode::GetLocal, 1, 5);
+    chunk.emit(Opcode::Return, 5);
+    return 16;
+}
+
+// x = 1.0, i = 0
+// while (i < count) { x = x * 1.0000001 + 0.5 - x / 4.0, i = i + 1 }
+// return x
+static size_t real_loop(Chunk & chunk, int64_t count) {
+    uint16_t zero = (uint16_t)chunk.add_constant(Value::FromInt(0));
+    uint16_t one = (uint16_t)chunk.add_constant(Value::FromReal(1.0));
+    uint16_t scale = (uint16_t)chunk.add_constant(Value::FromReal(1.0000001));
+    uint16_t half = (uint16_t)chunk.add_constant(Value::FromReal(0.5));
+    uint16_t four = (uint16_t)chunk.add_constant(Value::FromReal(4.0));
+    uint16_t limit = (uint16_t)chunk.add_constant(Value::FromInt(count));
+    chunk.set_locals(2);
+    chunk.emit(Opcode::Constant, one, 1);
+    chunk.emit(Opcode::SetLocal, 0, 1);
+    chunk.emit(Opcode::Pop, 1);
+    chunk.emit(Opcode::Constant, zero, 1);
+    chunk.emit(Opcode::SetLocal, 1, 1);
+    chunk.emit(Opcode::Pop, 1);
+
+    size_t loop = chunk.size();
+    chunk.emit(Opcode::GetLocal, 1, 2);
+    chunk.emit(Opcode::Constant, limit, 2);
+    chunk.emit(Opcode::Less, 2);
+    size_t exit = chunk.emit_jump(Opcode::JumpIfFalse, 2);
+    chunk.emit(Opcode::GetLocal, 0, 3);
+    chunk.emit(Opcode::Constant, scale, 3);
+    chunk.emit(Opcode::Multiply, 3);
+    chunk.emit(Opcode::Constant, half, 3);
+    chunk.emit(Opcode::Plus, 3);
+    chunk.emit(Opcode::GetLocal, 0, 3);
+    chunk.emit(Opcode::Constant, four, 3);
+    chunk.emit(Opcode::Divide, 3);
+    chunk.emit(Opcode::Minus, 3);
+    chunk.emit(Opcode::SetLocal, 0, 3);
+    chunk.emit(Opcode::Pop, 3);
+    chunk.emit(Opcode::GetLocal, 1, 4);
+    chunk.emit(Opcode::Increment, 4);
+    chunk.emit(Opcode::SetLocal, 1, 4);
+    chunk.emit(Opcode::Pop, 4);
+    chunk.emit_loop(loop, 4);
+    chunk.patch_jump(exit);
+
+    chunk.emit(Opcode::GetLocal, 0, 5);
+    chunk.emit(Opcode::Return, 5);
+    return 20;
+}
+
+static void run_loop(benchmark::State & state,
+    size_t (*build)(Chunk &, int64_t))
+{
+    Chunk chunk;
+    size_t per_iteration = build(chunk, state.range(0));
+    Interpreter interpreter;
+    for (auto _ : state) {
+        if (interpreter.run(chunk) != Interpreter::Ok) {
+            state.SkipWithError("run failed");
+            break;
+        }
+        benchmark::DoNotOptimize(interpreter.result());
+    }
+    // Instructions dispatched per second
+    state.counters["ops"] = benchmark::Counter(
+        (double)(per_iteration * state.range(0)) * state.iterations(),
+        benchmark::Counter::kIsRate);
+}
+
+static void BM_Interpreter_IntLoop(benchmark::State & state) {
+    run_loop(state, int_loop);
+}
+BENCHMARK(BM_Interpreter_IntLoop)->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_Interpreter_RealLoop(benchmark::State & state) {
+    run_loop(state, real_loop);
+}
+BENCHMARK(BM_Interpreter_RealLoop)->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+// The same loops compiled from source, once untyped and once with every
+// variable typed. {} is replaced by the number of iterations.
+static const char * _g_IntGeneric =
+    "i = 0\n"
+    "sum = 0\n"
+    "while i < {} {\n"
+    "    sum = sum + i * 3\n"
+    "    i++\n"
+    "}\n"
+    "return sum\n";
+
+static const char * _g_IntTyped =
+    "int64 i = 0\n"
+    "int64 sum = 0\n"
+    "while i < {} {\n"
+    "    sum = sum + i * 3\n"
+    "    i++\n"
+    "}\n"
+    "return sum\n";
+
+static const char * _g_RealGeneric =
+    "x = 1.0\n"
+    "i = 0\n"
+    "while i < {} {\n"
+    "    x = x * 1.0000001 + 0.5 - x / 4.0\n"
+    "    i++\n"
+    "}\n"
+    "return x\n";
+
+static const char * _g_RealTyped =
+    "double x = 1.0\n"
+    "int64 i = 0\n"
+    "while i < {} {\n"
+    "    x = x * 1.0000001 + 0.5 - x / 4.0\n"
+    "    i++\n"
+    "}\n"
+    "return x\n";
+
+// Instructions dispatched for each time round the last loop of a Chunk,
+// whose body runs straight through
+static size_t loop_dispatches(const Chunk & chunk) {
+    size_t count = 0;
+    for (size_t offset = 0; offset < chunk.size();) {
+        Opcode op = (Opcode)chunk.code()[offset];
+        size_t next = offset + Chunk::Length(op);
+        if (op == Opcode::Jump) {
+            int32_t jump;
+            std::memcpy(&jump, chunk.code() + offset + 1, sizeof(jump));
+            if (jump < 0) {
+                count = 0;
+                for (size_t at = next + jump; at < next;
+                    at += Chunk::Length((Opcode)chunk.code()[at]))
+                {
+                    count += 1;
+                }
+            }
+        }
+        offset = next;
+    }
+    return count;
+}
+
+static void BM_Interpreter_Script(benchmark::State & state,
+    const char * script)
+{
+    std::string source = script;
+    source.replace(source.find("{}"), 2, std::to_string(state.range(0)));
+    Lexer lexer;
+    lexer.read((const uint8_t *)source.data(), source.size());
+    Chunk chunk;
+    Compiler compiler(lexer, chunk);
+    if (!compiler.compile()) {
+        state.SkipWithError(compiler.error().c_str());
+        return;
+    }
+    if (state.range(1)) {
+        chunk.optimize();
+    }
+    Interpreter interpreter;
+    for (auto _ : state) {
+        if (interpreter.run(chunk) != Interpreter::Ok) {
+            state.SkipWithError("run failed");
+            break;
+        }
+        benchmark::DoNotOptimize(interpreter.result());
+    }
+    // Iterations of the script's loop per second, and the instructions
+    // each of them dispatches
+    state.counters["loops"] = benchmark::Counter(
+        (double)state.range(0) * state.iterations(),
+        benchmark::Counter::kIsRate);
+    state.counters["dispatches"] = (double)loop_dispatches(chunk);
+}
+
+// Without and with Chunk::optimize()
+#define SCRIPT_ARGS \
+    ArgNames({ "loops", "optimized" }) \
+        ->Args({ 1 << 20, 0 })->Args({ 1 << 20, 1 }) \
+        ->Unit(benchmark::kMillisecond)
+
+BENCHMARK_CAPTURE(BM_Interpreter_Script, int_generic, _g_IntGeneric)
+    ->SCRIPT_ARGS;
+BENCHMARK_CAPTURE(BM_Interpreter_Script, int_typed, _g_IntTyped)
+    ->SCRIPT_ARGS;
+BENCHMARK_CAPTURE(BM_Interpreter_Script, real_generic, _g_RealGeneric)
+    ->SCRIPT_ARGS;
+BENCHMARK_CAPTURE(BM_Interpreter_Script, real_typed, _g_RealTyped)
+    ->SCRIPT_ARGS;
+
+// A straight line program of lines statements, for start up
+static std::string long_script(int64_t lines) {
+    std::string source = "x = 0\ns = \"\"\n";
+    for (int64_t i = 0; i < lines; ++i) {
+        std::string number = std::to_string(i);
+        source += (i % 4 == 3 ? "s = \"line " + number + "\"\n"
+            : "x = x * 3 + " + number + "\n");
+    }
+    source += "return x\n";
+    return source;
+}
+
+// From nothing to the result of a short run, by compiling and optimizing
+// the source or by mapping an Image stored from it
+static void BM_Interpreter_Start(benchmark::State & state) {
+    std::string source = long_script(state.range(0));
+    const char * filename = "tsbl_bench.image";
+    {
+        Lexer lexer;
+        lexer.read((const uint8_t *)source.data(), source.size());
+        Chunk chunk;
+        Compiler compiler(lexer, chunk);
+        if (!compiler.compile()) {
+            state.SkipWithError(compiler.error().c_str());
+            return;
+        }
+        chunk.optimize();
+        if (!Image::Store(chunk, filename)) {
+            state.SkipWithError("could not store the image");
+            return;
+        }
+    }
+    Interpreter interpreter;
+    for (auto _ : state) {
+        Interpreter::Status status;
+        if (state.range(1)) {
+            Image image;
+            if (!image.load(filename)) {
+                state.SkipWithError("could not load the image");
+                break;
+            }
+            status = interpreter.run(image.program());
+        }
+        else {
+            Lexer lexer;
+            lexer.read((const uint8_t *)source.data(), source.size());
+            Chunk chunk;
+            Compiler compiler(lexer, chunk);
+            compiler.compile();
+            chunk.optimize();
+            status = interpreter.run(chunk);
+        }
+        if (status != Interpreter::Ok) {
+            state.SkipWithError("run failed");
+            break;
+        }
+        benchmark::DoNotOptimize(interpreter.result());
+    }
+    state.SetBytesProcessed((int64_t)source.size() * state.iterations());
+}
+BENCHMARK(BM_Interpreter_Start)->ArgNames({ "lines", "image" })
+    ->Args({ 1 << 14, 0 })->Args({ 1 << 14, 1 })
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,257 @@
+#include <benchmark/benchmark.h>
+
+#include <thread>
+
+#include "corpus.hpp"
+#include "tsbl/incremental_lexer.hpp"
+#include "tsbl/lexer.hpp"
+#include "tsbl/token_cache.hpp"
+
+using namespace tsbl;
+
+// Lex to the end of the input, stepping over characters which are not
+// tokens yet
+template <typename LexerT>
+static size_t drain(LexerT & lexer) {
+    size_t count = 0;
+    Token::Id id;
+    while ((id = lexer.next().id()) != Token::Id::EndOfFile
+        && id != Token::Id::BadEncoding)
+    {
+        count += 1;
+    }
+    return count;
+}
+
+// Every corpus, from 64 KB up to 16 MB
+#define LEXER_CORPORA(bm) \
+    BENCHMARK_CAPTURE(bm, ascii, bench::Corpus::Ascii) \
+        ->Range(1 << 16, 1 << 24)->Unit(benchmark::kMillisecond); \
+    BENCHMARK_CAPTURE(bm, identifiers, bench::Corpus::Identifiers) \
+        ->Range(1 << 16, 1 << 24)->Unit(benchmark::kMillisecond); \
+    BENCHMARK_CAPTURE(bm, strings, bench::Corpus::Strings) \
+        ->Range(1 << 16, 1 << 24)->Unit(benchmark::kMillisecond); \
+    BENCHMARK_CAPTURE(bm, numeric, bench::Corpus::Numeric) \
+        ->Range(1 << 16, 1 << 24)->Unit(benchmark::kMillisecond); \
+    BENCHMARK_CAPTURE(bm, cjk, bench::Corpus::Cjk) \
+        ->Range(1 << 16, 1 << 24)->Unit(benchmark::kMillisecond)
+
+static void report(benchmark::State & state, size_t tokens, size_t chunks) {
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    state.counters["tokens"] = benchmark::Counter((double)tokens,
+        benchmark::Counter::kIsRate);
+    // Heap allocations made through the Lexer's Arena for each run
+    state.counters["chunks"] = benchmark::Counter(
+        (double)(Arena::Allocations() - chunks),
+        benchmark::Counter::kAvgIterations);
+}
+
+template <typename LexerT>
+static void lex_string_reader(benchmark::State & state, bench::Corpus kind) {
+    std::string data = bench::make_corpus((size_t)state.range(0), kind);
+    size_t tokens = 0;
+    size_t chunks = Arena::Allocations();
+    for (auto _ : state) {
+        utf8::StringReader reader((const uint8_t *)data.c_str());
+        LexerT lexer;
+        lexer.read(reader);
+        tokens += drain(lexer);
+    }
+    report(state, tokens, chunks);
+}
+
+// Every codepoint through the vtable of the utf8::Reader
+static void BM_Lexer_StringReader(benchmark::State & state,
+    bench::Corpus kind)
+{
+    lex_string_reader<Lexer>(state, kind);
+}
+LEXER_CORPORA(BM_Lexer_StringReader);
+
+// The same, with StringReader::next() inlined into the Lexer
+static void BM_Lexer_BasicStringReader(benchmark::State & state,
+    bench::Corpus kind)
+{
+    lex_string_reader<BasicLexer<utf8::StringReader>>(state, kind);
+}
+LEXER_CORPORA(BM_Lexer_BasicStringReader);
+
+static void BM_Lexer_Buffer(benchmark::State & state, bench::Corpus kind) {
+    std::string data = bench::make_corpus((size_t)state.range(0), kind);
+    size_t tokens = 0;
+    size_t chunks = Arena::Allocations();
+    for (auto _ : state) {
+        Lexer lexer;
+        lexer.read((const uint8_t *)data.data(), data.size());
+        tokens += drain(lexer);
+    }
+    report(state, tokens, chunks);
+}
+LEXER_CORPORA(BM_Lexer_Buffer);
+
+static void BM_Lexer_Batch(benchmark::State & state) {
+    std::string data = bench::make_corpus((size_t)state.range(0));
+    size_t tokens = 0;
+    size_t chunks = Arena::Allocations();
+    TokenBuffer buffer(1024);
+    for (auto _ : state) {
+        Lexer lexer;
+        lexer.read((const uint8_t *)data.data(), data.size());
+        for (;;) {
+            size_t count = lexer.next_batch(buffer, 1024);
+            Token::Id last = buffer.id(count - 1);
+            if (last == Token::Id::EndOfFile
+                || last == Token::Id::BadEncoding)
+            {
+                tokens += count - 1;
+                break;
+            }
+            tokens += count;
+        }
+    }
+    report(state, tokens, chunks);
+}
+BENCHMARK(BM_Lexer_Batch)->Range(1 << 16, 1 << 24)
+    ->Unit(benchmark::kMillisecond);
+
+// Lex the numeric corpus and decode every literal, the worst case for lazy
+// decoding
+static void BM_Lexer_NumericDecode(benchmark::State & state) {
+    std::string data = bench::make_corpus((size_t)state.range(0),
+        bench::Corpus::Numeric);
+    size_t tokens = 0;
+    size_t chunks = Arena::Allocations();
+    for (auto _ : state) {
+        Lexer lexer;
+        lexer.read((const uint8_t *)data.data(), data.size());
+        Token tok;
+        Token::Value value;
+        while ((tok = lexer.next()).id() != Token::Id::EndOfFile) {
+            if (Token::IsNumeric(tok.id())) {
+                benchmark::DoNotOptimize(lexer.number(tok, value));
+            }
+            tokens += 1;
+        }
+    }
+    report(state, tokens, chunks);
+}
+BENCHMARK(BM_Lexer_NumericDecode)->Range(1 << 16, 1 << 24)
+    ->Unit(benchmark::kMillisecond);
+
+// 64 MB lexed with 1 thread up to one per core, to show how it scales
+static void parallel_threads(benchmark::internal::Benchmark * bm) {
+    size_t cores = std::thread::hardware_concurrency();
+    for (size_t threads = 1; threads <= (cores > 0 ? cores : 1); ++threads) {
+        bm->Args({ 1 << 26, (int64_t)threads });
+    }
+    bm->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+static void BM_Lexer_Parallel(benchmark::State & state) {
+    std::string data = bench::make_corpus((size_t)state.range(0));
+    size_t tokens = 0;
+    size_t chunks = Arena::Allocations();
+    TokenBuffer buffer;
+    for (auto _ : state) {
+        Lexer lexer;
+        tokens += lexer.lex_parallel((const uint8_t *)data.data(),
+            data.size(), buffer, (size_t)state.range(1));
+    }
+    report(state, tokens, chunks);
+}
+BENCHMARK(BM_Lexer_Parallel)->Apply(parallel_threads);
+
+// A warm start: hashing the buffer, mapping its TokenCache file and loading
+// the Tokens from it, to compare with BM_Lexer_Buffer
+static void BM_Lexer_CacheLoad(benchmark::State & state, bench::Corpus kind) {
+    const char * directory = "tsbl_bench_cache";
+    std::string data = bench::make_corpus((size_t)state.range(0), kind);
+    const uint8_t * bytes = (const uint8_t *)data.data();
+    TokenBuffer buffer;
+    {
+        Lexer lexer;
+        lexer.lex_parallel(bytes, data.size(), buffer, 1);
+        TokenCache cache(directory);
+        if (!cache.store(bytes, data.size(), lexer, buffer)) {
+            state.SkipWithError("Could not write the TokenCache");
+            return;
+        }
+    }
+
+    size_t tokens = 0;
+    size_t chunks = Arena::Allocations();
+    for (auto _ : state) {
+        TokenCache cache(directory);
+        Lexer lexer;
+        if (!cache.load(bytes, data.size())) {
+            state.SkipWithError("The TokenCache missed");
+            break;
+        }
+        tokens += lexer.load(bytes, data.size(), cache, buffer);
+    }
+    report(state, tokens, chunks);
+}
+LEXER_CORPORA(BM_Lexer_CacheLoad);
+
+// Typing and deleting one character in the middle of a 50k line file
+static void BM_Lexer_IncrementalEdit(benchmark::State & state) {
+    std::string data = bench::make_corpus(1 << 24);
+    size_t lines = 0, end = 0;
+    while (end < data.size() && lines < 50000) {
+        lines += (data[end++] == '\n');
+    }
+    data.resize(end);
+
+    IncrementalLexer lexer;
+    lexer.read((const uint8_t *)data.data(), data.size());
+    size_t offset = data.size() / 2;
+    const uint8_t typed = 'x';
+    size_t tokens = 0;
+    for (auto _ : state) {
+        tokens += lexer.edit(offset, 0, &typed, 1).inserted;
+        tokens += lexer.edit(offset, 1, nullptr, 0).inserted;
+    }
+    state.counters["relexed"] = benchmark::Counter((double)tokens,
+        benchmark::Counter::kAvgIterations);
+    state.counters["file_tokens"] = (double)lexer.size();
+}
+BENCHMARK(BM_Lexer_IncrementalEdit)->Unit(benchmark::kMicrosecond);
+
+// Typing into a string with escapes, whose text the Lexer adds again on
+// every edit, and reading the file again every 1024 edits to drop it. Fails
+// if the memory of the Lexer keeps growing after the first 1024.
+static void BM_Lexer_IncrementalString(benchmark::State & state) {
+    std::string data = bench::make_corpus(1 << 24);
+    size_t lines = 0, end = 0;
+    while (end < data.size() && lines < 50000) {
+        lines += (data[end++] == '\n');
+    }
+    data.resize(end);
+    size_t offset = data.size() / 2;
+    while (offset < data.size() && data[offset - 1] != '\n') {
+        offset += 1;
+    }
+    data.insert(offset, "s = \"tab\\tnew\\nline\"\n");
+    offset += 5;
+
+    IncrementalLexer lexer;
+    lexer.read((const uint8_t *)data.data(), data.size());
+    const uint8_t typed = 'x';
+    size_t edits = 0, bound = 0;
+    for (auto _ : state) {
+        lexer.edit(offset, 0, &typed, 1);
+        lexer.edit(offset, 1, nullptr, 0);
+        if (++edits % 1024 == 0) {
+            if (edits == 1024) {
+                bound = 2 * lexer.lexer().arena().used();
+            }
+            std::string text(lexer.text());
+            lexer.read((const uint8_t *)text.data(), text.size());
+        }
+    }
+    if (bound > 0 && lexer.lexer().arena().used() > bound) {
+        state.SkipWithError("The Lexer kept the text of old Tokens");
+    }
+    state.counters["arena_bytes"] = (double)lexer.lexer().arena().used();
+}
+BENCHMARK(BM_Lexer_IncrementalString)->Unit(benchmark::kMicrosecond);
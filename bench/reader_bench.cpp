@@ -0,0 +1,91 @@
+#include <benchmark/benchmark.h>
+
+#include "corpus.hpp"
+#include "tsbl/utf8.hpp"
+
+using namespace tsbl;
+
+// Files from 1 MB up to 1 GB
+static void reader_sizes(benchmark::internal::Benchmark * bm) {
+    bm->RangeMultiplier(32)->Range(1 << 20, 1 << 30)
+        ->Unit(benchmark::kMillisecond);
+}
+
+template <typename ReaderT>
+static void drain(ReaderT & reader) {
+    size_t count = 0;
+    for (reader.next(); reader.good(); reader.next()) {
+        count += 1;
+    }
+    benchmark::DoNotOptimize(count);
+}
+
+template <typename ReaderT>
+static void drain_bulk(ReaderT & reader) {
+    static utf8::codepoint_t buffer[4096];
+    size_t count = 0, written;
+    while ((written = reader.write(buffer, 4096)) > 0) {
+        count += written;
+    }
+    benchmark::DoNotOptimize(count);
+}
+
+static void BM_FileReader(benchmark::State & state) {
+    std::string path = bench::corpus_file((size_t)state.range(0));
+    for (auto _ : state) {
+        utf8::FileReader reader(path.c_str());
+        drain(reader);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FileReader)->Apply(reader_sizes);
+
+static void BM_MappedFileReader(benchmark::State & state) {
+    std::string path = bench::corpus_file((size_t)state.range(0));
+    for (auto _ : state) {
+        utf8::MappedFileReader reader(path.c_str());
+        drain(reader);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MappedFileReader)->Apply(reader_sizes);
+
+static void BM_StringReader(benchmark::State & state) {
+    std::string data = bench::make_corpus((size_t)state.range(0));
+    for (auto _ : state) {
+        utf8::StringReader reader((const uint8_t *)data.c_str());
+        drain(reader);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StringReader)->Apply(reader_sizes);
+
+static void BM_FileReader_write(benchmark::State & state) {
+    std::string path = bench::corpus_file((size_t)state.range(0));
+    for (auto _ : state) {
+        utf8::FileReader reader(path.c_str());
+        drain_bulk(reader);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FileReader_write)->Apply(reader_sizes);
+
+static void BM_MappedFileReader_write(benchmark::State & state) {
+    std::string path = bench::corpus_file((size_t)state.range(0));
+    for (auto _ : state) {
+        utf8::MappedFileReader reader(path.c_str());
+        drain_bulk(reader);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MappedFileReader_write)->Apply(reader_sizes);
+
+static void BM_StringReader_write(benchmark::State & state) {
+    std::string data = bench::make_corpus((size_t)state.range(0));
+    for (auto _ : state) {
+        utf8::StringReader reader((const uint8_t *)data.c_str());
+        drain_bulk(reader);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StringReader_write)->Apply(reader_sizes);
@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+
+#include <utility>
+#include <vector>
+
+#include "corpus.hpp"
+#include "tsbl/lexer.hpp"
+
+using namespace tsbl;
+
+// The Tokens of a 1 MB corpus, kept for copying around
+static std::vector<Token> tokens() {
+    static std::string data = bench::make_corpus(1 << 20);
+    std::vector<Token> result;
+    Lexer lexer;
+    lexer.read((const uint8_t *)data.data(), data.size());
+    for (Token tok = lexer.next(); tok.id() != Token::Id::EndOfFile;
+        tok = lexer.next())
+    {
+        result.push_back(tok);
+    }
+    return result;
+}
+
+static void BM_Token_Copy(benchmark::State & state) {
+    std::vector<Token> source = tokens();
+    std::vector<Token> dest(source.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < source.size(); ++i) {
+            dest[i] = source[i];
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * source.size());
+    state.SetBytesProcessed(state.iterations() * source.size()
+        * sizeof(Token));
+}
+BENCHMARK(BM_Token_Copy);
+
+static void BM_Token_Move(benchmark::State & state) {
+    std::vector<Token> source = tokens();
+    std::vector<Token> dest(source.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < source.size(); ++i) {
+            dest[i] = std::move(source[i]);
+        }
+        std::swap(source, dest);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * source.size());
+    state.SetBytesProcessed(state.iterations() * source.size()
+        * sizeof(Token));
+}
+BENCHMARK(BM_Token_Move);
+
+static void BM_Token_Construct(benchmark::State & state) {
+    std::vector<Token> dest(4096);
+    for (auto _ : state) {
+        for (size_t i = 0; i < dest.size(); ++i) {
+            dest[i] = Token(Token::Id::Identifier, i);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * dest.size());
+}
+BENCHMARK(BM_Token_Construct);
@@ -0,0 +1,62 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "corpus.hpp"
+#include "tsbl/char_class.hpp"
+#include "tsbl/utf8.hpp"
+
+using namespace tsbl;
+
+// Decode a corpus up front so only the category lookup is measured
+static std::vector<utf8::codepoint_t> codepoints(bench::Corpus kind) {
+    std::string data = bench::make_corpus(1 << 20, kind);
+    std::vector<utf8::codepoint_t> result(data.size());
+    auto counts = utf8::decode((const uint8_t *)data.data(), data.size(),
+        result.data(), result.size());
+    result.resize(counts.second);
+    return result;
+}
+
+static void BM_Category(benchmark::State & state, bench::Corpus kind) {
+    std::vector<utf8::codepoint_t> points = codepoints(kind);
+    for (auto _ : state) {
+        size_t spaces = 0;
+        for (utf8::codepoint_t pt : points) {
+            spaces += (utf8::category(pt) == utf8::Category::ZS);
+        }
+        benchmark::DoNotOptimize(spaces);
+    }
+    state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK_CAPTURE(BM_Category, ascii, bench::Corpus::Ascii);
+BENCHMARK_CAPTURE(BM_Category, cjk, bench::Corpus::Cjk);
+
+static void BM_CharClass(benchmark::State & state, bench::Corpus kind) {
+    std::vector<utf8::codepoint_t> points = codepoints(kind);
+    for (auto _ : state) {
+        size_t spaces = 0;
+        for (utf8::codepoint_t pt : points) {
+            spaces += (utf8::char_class(pt) & utf8::CC_Space);
+        }
+        benchmark::DoNotOptimize(spaces);
+    }
+    state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK_CAPTURE(BM_CharClass, ascii, bench::Corpus::Ascii);
+BENCHMARK_CAPTURE(BM_CharClass, cjk, bench::Corpus::Cjk);
+
+static void BM_Encode(benchmark::State & state, bench::Corpus kind) {
+    std::vector<utf8::codepoint_t> points = codepoints(kind);
+    std::vector<uint8_t> out(points.size() * 4);
+    for (auto _ : state) {
+        uint8_t * cursor = out.data();
+        for (utf8::codepoint_t pt : points) {
+            cursor += utf8::encode(pt, cursor);
+        }
+        benchmark::DoNotOptimize(cursor);
+    }
+    state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK_CAPTURE(BM_Encode, ascii, bench::Corpus::Ascii);
+BENCHMARK_CAPTURE(BM_Encode, cjk, bench::Corpus::Cjk);
@@ -0,0 +1,123 @@
+
+#pragma once
+#ifndef TSBL_ARENA_HPP
+#define TSBL_ARENA_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tsbl {
+    /**
+     * \brief A bump allocator for everything made while compiling one source
+     *
+     * Memory is handed out from a list of chunks and is never freed on its
+     * own. Instead the whole Arena is released at once by reset() or the
+     * destructor, which is O(chunks). Objects made in an Arena are not
+     * destroyed, so they should be trivially destructible or only own other
+     * Arena memory.
+     */
+    class Arena {
+    public:
+        static constexpr size_t DefaultChunkSize = 64 * 1024;
+        static constexpr size_t MaxChunkSize = 16 * 1024 * 1024;
+
+        Arena();
+        explicit Arena(size_t chunk_size);
+        ~Arena();
+
+        Arena(const Arena &) = delete;
+        Arena & operator=(const Arena &) = delete;
+
+        void * allocate(size_t size, size_t align = alignof(max_align_t));
+        void reset();
+
+        template<typename T, typename... Args>
+        T * create(Args &&... args) {
+            return new (allocate(sizeof(T), alignof(T)))
+                T(std::forward<Args>(args)...);
+        }
+
+        size_t chunks() const;
+        size_t used() const;
+
+        static size_t Allocations();
+    private:
+        struct Chunk {
+            Chunk * next;
+            size_t size;  //< Bytes after the header
+        };
+
+        Chunk * m_Head;     //< Newest chunk, which is being allocated from
+        uint8_t * m_Cursor;
+        uint8_t * m_End;
+        size_t m_ChunkSize; //< Size of the next chunk
+        size_t m_Chunks;
+        size_t m_Used;
+
+        void * grow(size_t size, size_t align);
+    };
+
+    /**
+     * \brief A standard allocator over an Arena
+     *
+     * Deallocation does nothing, the memory goes back when the Arena is
+     * reset. Without an Arena it falls back to the global heap, so the same
+     * container type works either way.
+     */
+    template<typename T>
+    class ArenaAllocator {
+    public:
+        typedef T value_type;
+
+        ArenaAllocator() : m_Arena(nullptr) { }
+        ArenaAllocator(Arena & arena) : m_Arena(&arena) { }
+        ArenaAllocator(Arena * arena) : m_Arena(arena) { }
+
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U> & other) :
+            m_Arena(other.arena())
+        { }
+
+        T * allocate(size_t count) {
+            if (m_Arena == nullptr) {
+                return (T *)::operator new(count * sizeof(T));
+            }
+            return (T *)m_Arena->allocate(count * sizeof(T), alignof(T));
+        }
+
+        void deallocate(T * pointer, size_t) {
+            if (m_Arena == nullptr) {
+                ::operator delete(pointer);
+            }
+        }
+
+        Arena * arena() const {
+            return m_Arena;
+        }
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U> & other) const {
+            return m_Arena == other.arena();
+        }
+
+        template<typename U>
+        bool operator!=(const ArenaAllocator<U> & other) const {
+            return m_Arena != other.arena();
+        }
+    private:
+        Arena * m_Arena;
+    };
+
+    typedef std::basic_string<char, std::char_traits<char>,
+        ArenaAllocator<char>> ArenaString;
+
+    template<typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
+
+#endif
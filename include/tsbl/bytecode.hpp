@@ -0,0 +1,220 @@
+
+#pragma once
+#ifndef TSBL_BYTECODE_HPP
+#define TSBL_BYTECODE_HPP
+
+#include <stdint.h>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include "tsbl/value.hpp"
+
+// Every opcode with the bytes of operand after it. The operators take their
+// names from the Token::Id they come from.
+#define TSBL_OPCODES(X) \
+    X(Constant, 2)      /* u16 constant index, push it */ \
+    X(Null, 0) \
+    X(True, 0) \
+    X(False, 0) \
+    X(Pop, 0) \
+    X(GetLocal, 2)      /* u16 slot, push it */ \
+    X(SetLocal, 2)      /* u16 slot, store the top without popping it */ \
+    X(Plus, 0) \
+    X(Minus, 0) \
+    X(Multiply, 0) \
+    X(Divide, 0) \
+    X(Power, 0) \
+    X(Negate, 0) \
+    X(Not, 0) \
+    X(Increment, 0) \
+    X(Decrement, 0) \
+    X(Equals, 0) \
+    X(NotEquals, 0) \
+    X(Greater, 0) \
+    X(GreaterEquals, 0) \
+    X(Less, 0) \
+    X(LessEquals, 0) \
+    X(LShift, 0) \
+    X(RShift, 0) \
+    X(Jump, 4)          /* i32 offset from the next instruction */ \
+    X(JumpIfFalse, 4)   /* i32 offset, taken if the popped top is false */ \
+    X(Return, 0)        /* Stop, with the popped top as the result */ \
+    X(TypedConstant, 2) /* u16 typed constant index, push its bits */ \
+    X(String, 2)        /* u16 string index, push it */ \
+    TSBL_FUSED_OPCODES(X) \
+    TSBL_TYPED_OPCODES(X, I8) TSBL_SHIFT_OPCODES(X, I8) \
+    TSBL_TYPED_OPCODES(X, I16) TSBL_SHIFT_OPCODES(X, I16) \
+    TSBL_TYPED_OPCODES(X, I32) TSBL_SHIFT_OPCODES(X, I32) \
+    TSBL_TYPED_OPCODES(X, I64) TSBL_SHIFT_OPCODES(X, I64) \
+    TSBL_TYPED_OPCODES(X, U8) TSBL_SHIFT_OPCODES(X, U8) \
+    TSBL_TYPED_OPCODES(X, U16) TSBL_SHIFT_OPCODES(X, U16) \
+    TSBL_TYPED_OPCODES(X, U32) TSBL_SHIFT_OPCODES(X, U32) \
+    TSBL_TYPED_OPCODES(X, U64) TSBL_SHIFT_OPCODES(X, U64) \
+    TSBL_TYPED_OPCODES(X, F32) \
+    TSBL_TYPED_OPCODES(X, F64)
+
+// Superinstructions, which Chunk::optimize() fuses out of the sequences
+// above that are run the most
+#define TSBL_FUSED_OPCODES(X) \
+    X(StoreLocal, 2)            /* SetLocal, Pop */ \
+    X(IncrementLocal, 2)        /* GetLocal, Increment, StoreLocal */ \
+    X(DecrementLocal, 2)        /* GetLocal, Decrement, StoreLocal */ \
+    X(PlusConstant, 2)          /* Constant, Plus */ \
+    X(MinusConstant, 2)         /* Constant, Minus */ \
+    X(MultiplyConstant, 2)      /* Constant, Multiply */ \
+    X(GetLocals, 4)             /* GetLocal, GetLocal */ \
+    X(JumpIfNotLessLocals, 8)   /* GetLocals, Less, JumpIfFalse */ \
+    X(JumpIfNotLessConstant, 8) /* GetLocal, Constant, Less, JumpIfFalse */
+
+// The opcodes for the values of one static Type. Their operands are raw in
+// the stack slots rather than Values, so they skip every type check. Box
+// turns the raw value at a depth below the top into a Value and Unbox turns
+// the top back, failing if it is not a number which fits. The last few are
+// superinstructions like those of TSBL_FUSED_OPCODES, with TypedConstant.
+#define TSBL_TYPED_OPCODES(X, T) \
+    X(Add##T, 0) \
+    X(Sub##T, 0) \
+    X(Mul##T, 0) \
+    X(Div##T, 0) \
+    X(Neg##T, 0) \
+    X(Equals##T, 0) \
+    X(NotEquals##T, 0) \
+    X(Greater##T, 0) \
+    X(GreaterEquals##T, 0) \
+    X(Less##T, 0) \
+    X(LessEquals##T, 0) \
+    X(Box##T, 2)        /* u16 depth below the top */ \
+    X(Unbox##T, 0) \
+    X(AddConstant##T, 2) \
+    X(SubConstant##T, 2) \
+    X(MulConstant##T, 2) \
+    X(JumpIfNotLessLocals##T, 8) \
+    X(JumpIfNotLessConstant##T, 8)
+
+#define TSBL_SHIFT_OPCODES(X, T) \
+    X(Shl##T, 0) \
+    X(Shr##T, 0)
+
+// The static types with the C type each is kept as, in the same order as
+// their keywords in Token::Id
+#define TSBL_INTEGER_TYPES(X) \
+    X(I8, int8_t) \
+    X(I16, int16_t) \
+    X(I32, int32_t) \
+    X(I64, int64_t) \
+    X(U8, uint8_t) \
+    X(U16, uint16_t) \
+    X(U32, uint32_t) \
+    X(U64, uint64_t)
+
+#define TSBL_REAL_TYPES(X) \
+    X(F32, float) \
+    X(F64, double)
+
+#define TSBL_TYPES(X) TSBL_INTEGER_TYPES(X) TSBL_REAL_TYPES(X)
+
+namespace tsbl {
+    /**
+     * \brief The static type of an expression
+     *
+     * Any is a Value which may hold anything. The others are kept raw in
+     * the first bytes of a stack slot, as their C type.
+     */
+    enum class Type : uint8_t {
+        Any,
+#define TSBL_TYPE_ENUM(name, type) name,
+        TSBL_TYPES(TSBL_TYPE_ENUM)
+#undef TSBL_TYPE_ENUM
+        _COUNT //< Used for bounds checking - not a type
+    };
+
+    enum class Opcode : uint8_t {
+#define TSBL_OPCODE_ENUM(name, operands) name,
+        TSBL_OPCODES(TSBL_OPCODE_ENUM)
+#undef TSBL_OPCODE_ENUM
+        _COUNT //< Used for bounds checking - not an opcode
+    };
+
+    /**
+     * \brief The parts of a compiled program, as the Interpreter runs it
+     *
+     * Only pointers, into a Chunk or a mapped Image, which must outlive it.
+     * Nothing in them is an address, so the same bytes run wherever they
+     * are: strings are found by their offset in the string table.
+     */
+    struct Program {
+        const uint8_t * code;
+        size_t size;
+        const uint32_t * lines;         //< Source line of each code byte
+        const Value * constants;
+        const uint64_t * typed_constants;
+        const uint32_t * string_offsets; //< Of each string in strings
+        const char * strings;
+        size_t locals;
+    };
+
+    /**
+     * \brief A block of bytecode with the constants it uses
+     *
+     * Each instruction is an Opcode byte followed by its operands, stored
+     * little endian and unaligned. The source line of every byte is kept for
+     * errors. String constants are copied into the Chunk's own string table,
+     * so the Chunk can outlive the source it was compiled from.
+     *
+     * Every jump ends in an i32 offset from the next instruction, after any
+     * u16 operands.
+     */
+    class Chunk {
+    public:
+        Chunk();
+        ~Chunk();
+
+        Chunk(const Chunk &) = delete;
+        Chunk & operator=(const Chunk &) = delete;
+
+        size_t emit(Opcode op, size_t line);
+        size_t emit(Opcode op, uint16_t operand, size_t line);
+        size_t emit_jump(Opcode op, size_t line);
+        void patch_jump(size_t jump);
+        void emit_loop(size_t target, size_t line);
+        void patch(size_t offset, Opcode op, uint16_t operand);
+
+        size_t add_constant(const Value & value);
+        size_t add_typed_constant(uint64_t bits);
+        size_t add_string(std::string_view text);
+        void set_locals(size_t count);
+        void optimize();
+        void clear();
+
+        const uint8_t * code() const;
+        size_t size() const;
+        const Value & constant(size_t index) const;
+        size_t constants() const;
+        const uint64_t & typed_constant(size_t index) const;
+        size_t typed_constants() const;
+        std::string_view string(size_t index) const;
+        size_t strings() const;
+        size_t locals() const;
+        size_t line(size_t offset) const;
+        Program program() const;
+
+        size_t disassemble(std::ostream & out, size_t offset) const;
+        void disassemble(std::ostream & out) const;
+
+        static const char * Name(Opcode op);
+        static size_t Length(Opcode op);
+        static bool IsJump(Opcode op);
+    private:
+        std::vector<uint8_t> m_Code;
+        std::vector<uint32_t> m_Lines;  //< Source line of each code byte
+        std::vector<Value> m_Constants;
+        std::vector<uint64_t> m_TypedConstants; //< Raw slot bits
+        std::vector<char> m_Strings;    //< Each a u32 length, text and a NUL
+        std::vector<uint32_t> m_StringOffsets;
+        size_t m_Locals;
+
+        void write(const void * data, size_t size, size_t line);
+    };
+}
+
+#endif
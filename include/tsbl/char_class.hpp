@@ -0,0 +1,48 @@
+
+#pragma once
+#ifndef TSBL_CHAR_CLASS_HPP
+#define TSBL_CHAR_CLASS_HPP
+
+#include <stdint.h>
+#include "tsbl/utf8.hpp"
+
+namespace tsbl::utf8 {
+    /**
+     * \brief What the Lexer needs to know about a codepoint, as bit flags
+     */
+    enum CharClass : uint8_t {
+        CC_Space = 0x01,      //< Category ZS, whitespace which is not a new line
+        CC_NewLine = 0x02,    //< \n or \r
+        CC_IdStart = 0x04,    //< May start an identifier
+        CC_IdContinue = 0x08  //< May continue an identifier
+    };
+
+    //< Codepoints are looked up in blocks of 1 << CharClassShift
+    static constexpr uint32_t CharClassShift = 7;
+
+    // Generated at build time from utf8proc by tsbl_gen_char_class, see
+    // tools/gen_char_class.cpp
+    extern const uint8_t _g_CharClassAscii[128];
+    extern const uint8_t _g_CharClassStage1[];
+    extern const uint8_t _g_CharClassStage2[];
+
+    /**
+     * \brief Get the CharClass flags of a codepoint
+     *
+     * ASCII is one load, everything else is two. Error codepoints have no
+     * flags.
+     */
+    inline uint8_t char_class(codepoint_t pt) {
+        if (pt < 0x80) {
+            return _g_CharClassAscii[pt];
+        }
+        if (pt > 0x10FFFF) {
+            return 0;
+        }
+        uint32_t block = _g_CharClassStage1[pt >> CharClassShift];
+        return _g_CharClassStage2[(block << CharClassShift)
+            | (pt & ((1u << CharClassShift) - 1))];
+    }
+}
+
+#endif
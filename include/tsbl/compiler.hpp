@@ -0,0 +1,171 @@
+
+#pragma once
+#ifndef TSBL_COMPILER_HPP
+#define TSBL_COMPILER_HPP
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "tsbl/bytecode.hpp"
+#include "tsbl/lexer.hpp"
+#include "tsbl/token.hpp"
+#include "tsbl/token_buffer.hpp"
+
+namespace tsbl {
+    /**
+     * \brief Compiles the Tokens of a Lexer straight into a Chunk
+     *
+     * A single pass with one Token of lookahead: statements are parsed by
+     * recursive descent and expressions by precedence climbing, and the
+     * bytecode is emitted as each piece is recognised. No tree is built, so
+     * time and memory grow only with the code emitted.
+     *
+     * A program is a list of statements, one per line:
+     *
+     *     type name = expression
+     *     name = expression
+     *     expression
+     *     if expression { ... } elif expression { ... } else { ... }
+     *     while expression { ... }
+     *     break, continue, return [expression]
+     *
+     * The code is emitted as it is parsed, with no optimization. Run
+     * Chunk::optimize() on the Chunk afterwards for faster code.
+     *
+     * Every variable is a local of the Chunk, created by its first
+     * assignment. A variable declared with one of the type keywords, int8
+     * to uint64, float or double, always holds that type: what is assigned
+     * to it is converted, or fails if it is not a number which fits. Where
+     * both sides of an operator have the same static type, the typed
+     * Opcode for it is emitted, which runs without any type checks. Number
+     * literals take the type of the other side if they fit it, and a type
+     * suffix (5i8, 2.0f) gives a literal its own.
+     *
+     * The Tokens can also come already lexed, from Lexer::lex_parallel() or
+     * Lexer::load(), in which case the Lexer is only asked about them.
+     */
+    class Compiler {
+    public:
+        Compiler(Lexer & lexer, Chunk & chunk);
+        Compiler(Lexer & lexer, const TokenBuffer & tokens, Chunk & chunk);
+        ~Compiler();
+
+        bool compile();
+
+        const std::string & error() const;
+        size_t error_line() const;
+        size_t error_column() const;
+    private:
+        enum Precedence {
+            None,
+            Assignment, //< =
+            Equality,   //< == !=
+            Comparison, //< < <= > >=
+            Shift,      //< << >>
+            Term,       //< + -
+            Factor,     //< * /
+            Unary,      //< - !
+            Exponent,   //< **, right associative and tighter than -
+            Postfix,    //< ++ --
+            Primary
+        };
+
+        typedef void (Compiler::*ParseFn)(bool assignable);
+
+        struct Rule {
+            ParseFn prefix, infix;
+            Precedence precedence;
+        };
+
+        struct Literal {
+            size_t offset;      //< Of its Opcode::Constant
+            Token::Value value;
+            bool real;
+        };
+
+        struct Loop {
+            size_t start;               //< Where continue jumps to
+            std::vector<size_t> breaks; //< Jumps to patch to the loop end
+        };
+
+        static constexpr uint32_t NoSlot = UINT32_MAX;
+
+        Lexer & m_Lexer;
+        const TokenBuffer * m_Tokens;  //< Read instead of m_Lexer if set
+        size_t m_Next;                 //< Index of the next of m_Tokens
+        Chunk & m_Chunk;
+        Token m_Current, m_Previous;
+        size_t m_Line;                 //< Line of m_Previous, for the Chunk
+        bool m_Failed;
+        std::string m_Error;
+        size_t m_ErrorLine, m_ErrorColumn;
+        size_t m_Parens;               //< Depth of open parentheses
+
+        std::vector<uint32_t> m_Slots; //< Local slot of each symbol
+        size_t m_Locals;
+        size_t m_LastGet;              //< Offset of the last GetLocal
+        std::vector<Type> m_Types;     //< Static type of each local slot
+        Type m_Type;                   //< Static type of the last expression
+        Literal m_Literal;             //< The last number literal
+        std::vector<Loop> m_Loops;
+
+        // Each constant is only added to the Chunk once
+        std::unordered_map<int64_t, uint16_t> m_Ints;
+        std::unordered_map<uint64_t, uint16_t> m_Reals; //< By their bits
+        std::unordered_map<std::string, uint16_t> m_Strings;
+        std::unordered_map<uint64_t, uint16_t> m_TypedConstants;
+
+        void advance();
+        Token next_token();
+        bool check(Token::Id id) const;
+        bool match(Token::Id id);
+        void expect(Token::Id id, const char * message);
+        void skip_newlines();
+
+        void statement();
+        void end_statement();
+        void block();
+        void if_statement();
+        void while_statement();
+        void typed_declaration();
+        void jump_statement();
+        void return_statement();
+
+        void expression();
+        void parse(Precedence precedence);
+        void literal(bool assignable);
+        void number(bool assignable);
+        void string(bool assignable);
+        void variable(bool assignable);
+        void grouping(bool assignable);
+        void unary(bool assignable);
+        void prefix_step(bool assignable);
+        void binary(bool assignable);
+        void postfix_step(bool assignable);
+        void step(Token::Id op);
+        void coerce(Type type);
+        bool last_is_literal() const;
+        bool type_literal(const Literal & literal, Type type);
+
+        size_t emit(Opcode op);
+        size_t emit(Opcode op, uint16_t operand);
+        void emit_constant(const Value & value);
+        uint16_t add_constant(const Value & value);
+        uint16_t add_typed_constant(uint64_t bits);
+        uint32_t slot(SymbolTable::Symbol symbol) const;
+        uint32_t declare(SymbolTable::Symbol symbol, Type type);
+        void fail(const Token & at, const std::string & message);
+
+        static Rule GetRule(Token::Id id);
+        static Opcode BinaryOpcode(Token::Id id);
+        static Opcode TypedOpcode(Opcode op, Type type);
+        static Opcode BoxOpcode(Type type);
+        static Opcode UnboxOpcode(Type type);
+        static bool LiteralBits(const Literal & literal, Type type,
+            uint64_t & bits);
+    };
+}
+
+#endif
@@ -0,0 +1,56 @@
+
+#pragma once
+#ifndef TSBL_IMAGE_HPP
+#define TSBL_IMAGE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tsbl/bytecode.hpp"
+
+namespace tsbl {
+    /**
+     * \brief A compiled program in a file, run straight from its mapping
+     *
+     * Store() writes out the Program of a Chunk, each part of it as its own
+     * aligned section: the constants, the typed constants, the line of each
+     * code byte, the offset of each string, the code and the strings. None
+     * of them holds an address, so load() only maps the file read only and
+     * checks it, and program() points into the mapping. Nothing is copied
+     * or relocated, and processes running the same Image share its pages.
+     *
+     * An Image is only read on the kind of machine which wrote it. One of
+     * another Version, Opcode set or size of Value does not load, and nor
+     * does one whose sections do not fit, whose hash does not match, whose
+     * constants are not numbers, null or bools or whose code fails the
+     * checks the Interpreter leaves to the Compiler. The hash only catches
+     * damage, as whoever writes an Image writes its hash too.
+     */
+    class Image {
+    public:
+        //< Bump whenever the Opcodes or the file layout change meaning
+        static constexpr uint32_t Version = 1;
+
+        Image();
+        ~Image();
+
+        Image(const Image &) = delete;
+        Image & operator=(const Image &) = delete;
+
+        bool load(const char * filename);
+        void close();
+
+        bool loaded() const;
+        const Program & program() const;
+
+        static bool Store(const Chunk & chunk, const char * filename);
+    private:
+        const uint8_t * m_Mapped; //< The whole file, null if not loaded
+        size_t m_MappedSize;
+        void * m_Mapping;         //< HANDLE of the file mapping on Windows
+        Program m_Program;
+
+        bool map(const char * filename);
+    };
+}
+
+#endif
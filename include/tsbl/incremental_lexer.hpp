@@ -0,0 +1,77 @@
+
+#pragma once
+#ifndef TSBL_INCREMENTAL_LEXER_HPP
+#define TSBL_INCREMENTAL_LEXER_HPP
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tsbl/arena.hpp"
+#include "tsbl/lexer.hpp"
+#include "tsbl/token.hpp"
+
+namespace tsbl {
+    /**
+     * \brief Keeps the Tokens of an editable text up to date
+     *
+     * The IncrementalLexer owns a copy of the text and every Token in it,
+     * along with the Lexer::State after each Token. An edit only re-lexes
+     * from just before it until the new Tokens meet the old ones again, and
+     * the Tokens after that are kept.
+     *
+     * Tokens are held in a gap buffer with the gap at the last edit. Those
+     * after the gap are stored as they were before the edits since, and are
+     * moved on by m_Bytes when read. So an edit only touches the
+     * Tokens between it and the edit before, not every Token after it.
+     */
+    class IncrementalLexer {
+    public:
+        /**
+         * \brief Which Tokens an edit replaced
+         */
+        struct Change {
+            size_t first;    //< Index of the first replaced Token
+            size_t removed;  //< Number of old Tokens taken out
+            size_t inserted; //< Number of new Tokens put in their place
+        };
+
+        IncrementalLexer();
+        explicit IncrementalLexer(Arena & arena);
+        ~IncrementalLexer();
+
+        bool read(const uint8_t * data, size_t size);
+        Change edit(size_t offset, size_t removed, const uint8_t * data,
+            size_t size);
+
+        size_t size() const;
+        Token token(size_t index) const;
+        Lexer::State state(size_t index) const;
+        std::string_view text() const;
+
+        Lexer & lexer();
+        const Lexer & lexer() const;
+    private:
+        std::string m_Text;
+        Lexer m_Lexer;
+        std::vector<Token> m_Tokens;
+        std::vector<Lexer::State> m_States; //< State after each Token
+        size_t m_Gap, m_GapEnd;             //< Unused slots of both arrays
+        ptrdiff_t m_Bytes;                  //< Moves Tokens after the gap
+
+        // Reused by every edit
+        std::vector<Token> m_NewTokens;
+        std::vector<Lexer::State> m_NewStates;
+
+        size_t find(size_t offset) const;
+        void move_gap(size_t index);
+        void reserve_gap(size_t count);
+
+        static Token moved(const Token & token, ptrdiff_t bytes);
+        static Lexer::State moved(const Lexer::State & state,
+            ptrdiff_t bytes);
+        static bool stop(const Token & token);
+    };
+}
+
+#endif
@@ -1,18 +1,47 @@
-
 #pragma once
 #ifndef TSBL_INTERPRETER_HPP
 #define TSBL_INTERPRETER_HPP
 
 #include <stdint.h>
+#include <vector>
+#include "tsbl/bytecode.hpp"
+#include "tsbl/value.hpp"
 
 namespace tsbl {
+    /**
+     * \brief A stack machine which runs a Chunk of bytecode, or an Image
+     *
+     * Values live in one contiguous stack, with the Chunk's locals at the
+     * bottom. Errors stop the run and are reported through the returned
+     * Status, along with the line of the instruction which failed.
+     */
     class Interpreter {
     public:
+        enum Status {
+            Ok,
+            TypeError,     //< An operator was given Values it does not take
+            DivideByZero,  //< An int was divided by 0
+            StackOverflow, //< The stack ran out of slots
+            BadCode        //< The Chunk held an unknown Opcode
+        };
+
+        static constexpr size_t DefaultStackSize = 64 * 1024;
+
         Interpreter();
+        explicit Interpreter(size_t stack_size);
         ~Interpreter();
 
+        Interpreter::Status run(const Chunk & chunk);
+        Interpreter::Status run(const Program & program);
+
+        const Value & result() const;
+        size_t error_line() const;
+
+        static const char * Name(Interpreter::Status status);
     private:
-        
+        std::vector<Value> m_Stack;
+        Value m_Result;
+        size_t m_ErrorLine;
     };
 }
 
@@ -4,45 +4,157 @@
 #define TSBL_LEXER_HPP
 
 #include <stdint.h>
+#include <string_view>
+#include "tsbl/arena.hpp"
+#include "tsbl/source_map.hpp"
+#include "tsbl/symbol_table.hpp"
 #include "tsbl/token.hpp"
+#include "tsbl/token_buffer.hpp"
 #include "tsbl/utf8.hpp"
 
 namespace tsbl {
-    class Lexer {
+    class TokenCache;
+
+    /**
+     * \brief Everything a Lexer does which does not depend on its Reader
+     *
+     * Holds the position, the SymbolTable and the string text, and does all
+     * of the lexing of buffers given to read(const uint8_t *, size_t). Only
+     * lexing from a utf8::Reader is left to BasicLexer.
+     */
+    class LexerBase {
     public:
-        Lexer();
-        ~Lexer();
+        /**
+         * \brief Where a Lexer reading a buffer is, enough to carry on from
+         */
+        struct State {
+            size_t index;     //< Byte offset into the buffer
+        };
 
-        void read(utf8::Reader & reader);
+        //< The largest buffer, as Token offsets are u32
+        static constexpr size_t MaxSize = UINT32_MAX;
 
-        size_t column() const;
-        size_t line() const;
+        ~LexerBase();
 
-        Token next();
+        bool read(const uint8_t * data, size_t size);
+        void reset();
+
+        const SourceMap & source_map() const;
+        State state() const;
+        void restore(const State & state);
+
+        size_t lex_parallel(const uint8_t * data, size_t size,
+            TokenBuffer & tokens, size_t threads = 0);
+        size_t load(const uint8_t * data, size_t size,
+            const TokenCache & cache, TokenBuffer & tokens);
 
-        utf8::codepoint_t next_cp();
         utf8::codepoint_t current_cp() const;
         utf8::codepoint_t peek_cp() const;
-        utf8::codepoint_t peek_next_cp();
 
         bool identifier(utf8::codepoint_t pt) const;
         bool identifier_start(utf8::codepoint_t pt) const;
-    private:
-        size_t m_CharColumn, m_Line, m_StartLine, m_StartColumn;
+
+        Arena & arena();
+        SymbolTable & symbols();
+        const SymbolTable & symbols() const;
+        std::string_view string(const Token & token) const;
+        Token::Id number(const Token & token, Token::Value & value) const;
+        uint64_t integer(const Token & token) const;
+        double real(const Token & token) const;
+
+        static Token::Id keyword(const uint8_t * data, size_t size);
+        static Token::Id numeric_value(std::string_view text, bool real,
+            Token::Value & value);
+    protected:
+        friend class TokenCache;
+
         utf8::codepoint_t m_Current, m_Next;
-        utf8::Reader * m_Reader;
+        utf8::Reader * m_Reader; //< Null in buffer mode
+        size_t m_Offset;       //< Reader mode, bytes up to after m_Current
+        size_t m_Start;        //< Reader mode, where the current Token starts
+        size_t m_Skew;         //< Reader mode, see SourceMap::add_skew()
+        SourceMap m_Map;
+        Arena m_LocalArena;    //< Used when no Arena is given
+        Arena * m_Arena;
+        SymbolTable m_Symbols;
+        ArenaString m_Name;    //< UTF-8 text of the identifier being read
+        ArenaString m_Strings; //< UTF-8 text of every string Token
+
+        // Buffer mode, see read(const uint8_t *, size_t)
+        const uint8_t * m_Data;
+        size_t m_Size, m_Index;
+
+        LexerBase();
+        explicit LexerBase(Arena & arena);
+
+        Token next_buffer();
+        void lex_range(size_t end, TokenBuffer & tokens);
+        void append_chunk(LexerBase & chunk, const TokenBuffer & buffer,
+            TokenBuffer & tokens);
+        static bool stopped(const TokenBuffer & tokens);
+        Token scan_identifier(size_t start);
+        Token scan_numeric(size_t start);
+        size_t digit_run(size_t index) const;
+        Token scan_string(size_t start);
+        bool scan_escape(size_t & index, utf8::codepoint_t & failure);
+        utf8::codepoint_t decode_buffer(size_t index, size_t & length) const;
+
+        static Token::Id numeric_suffix(std::string_view suffix);
+        static uint64_t numeric_max(Token::Id type);
+        void append_string(utf8::codepoint_t pt);
+        Token span_token(Token::Id id, size_t offset, Token::Span span) const;
+        std::string_view span_text(const Token::Span & span) const;
 
-        Token consume_keyword(Token::Id id, size_t start_idx);
+        static utf8::codepoint_t escape_value(utf8::codepoint_t pt);
+        static size_t escape_digits(utf8::codepoint_t pt);
+        static int hex_digit(utf8::codepoint_t pt);
+        static utf8::codepoint_t escape_digit_error(utf8::codepoint_t pt);
+        static bool escape_error(utf8::codepoint_t pt);
 
-        Token consume_identifier(const char32_t * start_val);
+        Token error(utf8::codepoint_t pt, size_t start, size_t at) const;
+    };
+
+    /**
+     * \brief Lexer which pulls codepoints from a ReaderT
+     *
+     * Every call to ReaderT::next() is made on the ReaderT itself, so for
+     * one of the final Readers it is inlined into the lexing loops rather
+     * than going through the vtable. Lexer is the instantiation for
+     * utf8::Reader, which lexes from any Reader through the vtable.
+     *
+     * The members are defined in lexer.cpp and only instantiated there, for
+     * utf8::Reader and each concrete Reader in utf8.hpp.
+     */
+    template <typename ReaderT>
+    class BasicLexer : public LexerBase {
+    public:
+        BasicLexer();
+        explicit BasicLexer(Arena & arena);
+        ~BasicLexer();
+
+        using LexerBase::read;
+        void read(ReaderT & reader);
+
+        Token next();
+        size_t next_batch(TokenBuffer & buffer, size_t max);
+
+        utf8::codepoint_t next_cp();
+        utf8::codepoint_t peek_next_cp();
+    private:
+        Token next_reader();
         Token consume_identifier(utf8::codepoint_t pt);
-        void consume_identifier(Token & token);
-        Token consume_string(bool dbl, bool longstr);
+        Token consume_string(utf8::codepoint_t quote);
         Token consume_numeric();
-        utf8::codepoint_t consume_escape(size_t hex_digits);
-
-        Token error(utf8::codepoint_t pt) const;
+        utf8::codepoint_t consume_escape();
     };
+
+    typedef BasicLexer<utf8::Reader> Lexer;
+
+    extern template class BasicLexer<utf8::Reader>;
+    extern template class BasicLexer<utf8::FileReader>;
+    extern template class BasicLexer<utf8::FdReader>;
+    extern template class BasicLexer<utf8::MappedFileReader>;
+    extern template class BasicLexer<utf8::StringReader>;
 }
 
 #endif
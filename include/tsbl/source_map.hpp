@@ -0,0 +1,58 @@
+
+#pragma once
+#ifndef TSBL_SOURCE_MAP_HPP
+#define TSBL_SOURCE_MAP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tsbl {
+    /**
+     * \brief Turns the byte offsets of Tokens into lines and columns
+     *
+     * Tokens only carry the byte offset they start at, so the Lexer does no
+     * bookkeeping per character. Lines and columns are worked out here,
+     * only for the Tokens a diagnostic or debugger asks about.
+     *
+     * Given the text with read(), the new lines are found by a vector scan
+     * the first time a line is asked for. Without the text, as when lexing
+     * from a utf8::Reader, the Lexer adds each new line as it goes, and
+     * how many bytes were not the first of a codepoint at each Token it
+     * starts. Then only those offsets have an exact column.
+     *
+     * Lines are counted from 0 and columns in codepoints from 1, and a line
+     * ends after \n, \n\r or \r, the same as Token::Id::NewLine.
+     */
+    class SourceMap {
+    public:
+        SourceMap();
+        ~SourceMap();
+
+        void read(const uint8_t * data, size_t size);
+        void clear();
+        void add_line(size_t offset);
+        void add_skew(size_t offset, size_t skew);
+
+        size_t lines() const;
+        size_t line_start(size_t line) const;
+        size_t line(size_t offset) const;
+        size_t column(size_t offset) const;
+    private:
+        struct Skew {
+            uint32_t offset; //< From here on
+            uint32_t skew;   //< Bytes before which are not a codepoint start
+        };
+
+        const uint8_t * m_Data;
+        size_t m_Size;
+        mutable std::vector<uint32_t> m_Lines; //< Where each line starts
+        mutable bool m_Scanned;                //< m_Lines has all of m_Data
+        std::vector<Skew> m_Skews;
+
+        void scan() const;
+        size_t skew(size_t offset) const;
+    };
+}
+
+#endif
@@ -0,0 +1,125 @@
+
+#pragma once
+#ifndef TSBL_STATS_HPP
+#define TSBL_STATS_HPP
+
+#include <stdint.h>
+#include "tsbl/token.hpp"
+
+// Build with TSBL_STATS=1 (the TSBL_STATS CMake option) to count where
+// lexing time goes. Without it the counting macros expand to nothing.
+#ifndef TSBL_STATS
+#define TSBL_STATS 0
+#endif
+
+#if TSBL_STATS
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+namespace tsbl {
+    /**
+     * \brief A snapshot of the lexing counters of the calling thread
+     *
+     * Each thread counts on its own, so counting never contends and Get()
+     * never races with lexing elsewhere. The workers of
+     * Lexer::lex_parallel() count on their own threads and it adds their
+     * counts to the calling thread once they are done, so its cycles are
+     * summed over every thread rather than the time it took.
+     *
+     * Only counted when built with TSBL_STATS. Otherwise Get() gives all
+     * zeros.
+     */
+    struct Stats {
+        enum Phase {
+            Whitespace,
+            Identifier,
+            String,
+            Numeric,
+            _COUNT
+        };
+
+        //< Token::Id counts are indexed by the Token::Id plus this, as the
+        //< error Token::Id values are negative
+        static constexpr int32_t ErrorIds = 8;
+        static constexpr size_t TokenIds = ErrorIds + Token::Id::_COUNT;
+
+        static constexpr bool Enabled = (TSBL_STATS != 0);
+
+        uint64_t codepoints;  //< Decoded by a utf8::Reader or the Lexer
+        uint64_t refills;     //< Reads into the buffer of a FileReader
+        uint64_t allocations; //< Heap chunks taken for symbols and text
+        uint64_t tokens[TokenIds];
+        uint64_t cycles[Stats::Phase::_COUNT];
+
+        uint64_t token_count(Token::Id id) const;
+        uint64_t token_total() const;
+
+        static Stats Get();
+        static void Reset();
+        static void Add(const Stats & stats);
+        static const char * Name(Stats::Phase phase);
+
+#if TSBL_STATS
+        static uint64_t Cycles();
+
+        /**
+         * \brief Adds the cycles from its construction to its destruction
+         * to a Phase
+         */
+        class Timer {
+        public:
+            explicit Timer(Stats::Phase phase);
+            ~Timer();
+        private:
+            Stats::Phase m_Phase;
+            uint64_t m_Start;
+        };
+#endif
+    };
+
+#if TSBL_STATS
+    extern thread_local Stats _g_Stats;
+
+    /**
+     * \brief Read the cycle counter, or a nanosecond clock where there is
+     * none
+     */
+    inline uint64_t Stats::Cycles() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    inline Stats::Timer::Timer(Stats::Phase phase) :
+        m_Phase(phase), m_Start(Stats::Cycles())
+    { }
+
+    inline Stats::Timer::~Timer() {
+        _g_Stats.cycles[m_Phase] += Stats::Cycles() - m_Start;
+    }
+
+#define TSBL_STATS_ADD(counter, count) \
+    (::tsbl::_g_Stats.counter += (uint64_t)(count))
+#define TSBL_STATS_TOKEN(id) \
+    (::tsbl::_g_Stats.tokens[(id) + ::tsbl::Stats::ErrorIds] += 1)
+#define TSBL_STATS_TIME(phase) \
+    ::tsbl::Stats::Timer _stats_timer(::tsbl::Stats::Phase::phase)
+#else
+#define TSBL_STATS_ADD(counter, count) ((void)0)
+#define TSBL_STATS_TOKEN(id) ((void)0)
+#define TSBL_STATS_TIME(phase) ((void)0)
+#endif
+}
+
+#endif
@@ -0,0 +1,51 @@
+
+#pragma once
+#ifndef TSBL_SYMBOL_TABLE_HPP
+#define TSBL_SYMBOL_TABLE_HPP
+
+#include <stdint.h>
+#include <string_view>
+#include "tsbl/arena.hpp"
+
+namespace tsbl {
+    /**
+     * \brief Interns identifier names and hands out dense 32-bit ids
+     *
+     * Names are stored once, back to back as UTF-8, and looked up through an
+     * open-addressing hash table. The same name always gets the same Symbol,
+     * so anything after the Lexer can compare names as integers. Symbols are
+     * assigned in order of first appearance, starting at 0.
+     *
+     * Storage comes from the heap, or from an Arena if one is given.
+     */
+    class SymbolTable {
+    public:
+        typedef uint32_t Symbol;
+        static constexpr Symbol Invalid = 0xFFFFFFFF;
+
+        SymbolTable();
+        explicit SymbolTable(Arena & arena);
+        ~SymbolTable();
+
+        Symbol intern(const uint8_t * data, size_t size);
+        Symbol find(const uint8_t * data, size_t size) const;
+
+        std::string_view name(Symbol symbol) const;
+        size_t size() const;
+        void clear();
+    private:
+        struct Entry {
+            uint32_t offset, length, hash;
+        };
+
+        ArenaString m_Text;              //< Every name, back to back
+        ArenaVector<Entry> m_Entries;    //< Indexed by Symbol
+        ArenaVector<uint32_t> m_Slots;   //< Symbol + 1 per slot, 0 is empty
+
+        static uint32_t hash(const uint8_t * data, size_t size);
+        size_t slot(uint32_t hash, const uint8_t * data, size_t size) const;
+        void grow();
+    };
+}
+
+#endif
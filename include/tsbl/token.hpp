@@ -4,10 +4,17 @@
 #define TSBL_TOKEN_HPP
 
 #include <stdint.h>
-#include <string>
-#include "tsbl/utf8.hpp"
+#include <type_traits>
+#include "tsbl/symbol_table.hpp"
 
 namespace tsbl {
+    /**
+     * \brief One lexed Token: its Token::Id, where it starts and its value
+     *
+     * Offsets are u32 bytes from the start of the source, so a source can be
+     * at most 4 GiB - 1 bytes. LexerBase::read() and lex_parallel() refuse
+     * a larger buffer. Past that much of a utf8::Reader, offsets wrap.
+     */
     class Token {
     public:
         enum Id : int32_t {
@@ -108,7 +115,48 @@ namespace tsbl {
             UnexpectedEscapeEOF = -8  //< An EOF was encountered while parsing a \x, \u, or \U escape
         };
 
-        typedef std::basic_string<char32_t> U32String;
+        /**
+         * \brief A slice of the text of the Lexer which produced a Token
+         *
+         * Tokens hold no text of their own, so they can stay trivially
+         * copyable. Use Lexer::string() to get at the text.
+         *
+         * A span either slices the source buffer given to Lexer::read() or,
+         * when the text had to be decoded (escapes, or a utf8::Reader
+         * source), the text materialized by the Lexer. The top bit of length
+         * tells which, so a Lexer only materializes up to 2 GiB - 1 bytes of
+         * text. A string or number which would go past that is an Invalid
+         * Token instead.
+         */
+        struct Span {
+            uint32_t offset, length;
+
+            //< Set in length when the span is of materialized text
+            static constexpr uint32_t Materialized = 0x80000000;
+
+            inline constexpr uint32_t size() const {
+                return length & ~Materialized;
+            }
+
+            inline constexpr bool materialized() const {
+                return (length & Materialized) != 0;
+            }
+        };
+
+        /**
+         * \brief The value of a Token, which one depends on the Token::Id
+         */
+        union Value {
+            uint64_t integer;
+            double real;
+            SymbolTable::Symbol symbol;
+            Token::Span span;
+        };
+
+        //< The keyword Token::Id values are the contiguous range
+        //< [FirstKeyword, LastKeyword]
+        static constexpr Token::Id FirstKeyword = Token::Id::True;
+        static constexpr Token::Id LastKeyword = Token::Id::Throw;
 
         static const char * Name(Token::Id id);
         static const char32_t * Name32(Token::Id id);
@@ -116,50 +164,102 @@ namespace tsbl {
         /**
          * \brief Check if the given Token::Id value holds a string
          * 
-         * This is used to check if the value stored in m_Data is a
-         * heap-allocated Token::U32String instance.
+         * This is used to check if the value stored in m_Data is a Span of
+         * string text, see Lexer::string().
          * 
          * \param id The Token::Id to check
          * \return If the Token denoted by the Id holds a string value
          */
         static inline constexpr bool IsString(Token::Id id) {
-            return (id == Token::Id::String || id == Token::Id::LongString
-                || id == Token::Id::Identifier
-            );
+            return (id == Token::Id::StringValue || id == Token::Id::LongString);
         }
 
-    public:
-        Token();
-        Token(Token::Id id, size_t line_no, size_t column);
-        Token(const Token & source);
-        Token(Token && source);
-        ~Token();
+        /**
+         * \brief Check if the given Token::Id value holds a numeric literal
+         *
+         * Numeric Tokens hold a Span of the literal's text, which is only
+         * decoded when asked for, see Lexer::number().
+         *
+         * \param id The Token::Id to check
+         * \return If the Token denoted by the Id holds numeric text
+         */
+        static inline constexpr bool IsNumeric(Token::Id id) {
+            return (id == Token::Id::IntegerValue || id == Token::Id::RealValue);
+        }
 
-        Token & operator=(const Token & source);
-        Token & operator=(Token && source);
+        /**
+         * \brief Check if the given Token::Id value holds a symbol
+         *
+         * Identifier names are interned in the Lexer's SymbolTable, and the
+         * Token only holds the SymbolTable::Symbol.
+         *
+         * \param id The Token::Id to check
+         * \return If the Token denoted by the Id holds a symbol value
+         */
+        static inline constexpr bool IsSymbol(Token::Id id) {
+            return id == Token::Id::Identifier;
+        }
 
-        Token::U32String * take_string();
+    public:
+        Token();
+        Token(Token::Id id, size_t offset);
+        Token(Token::Id id, size_t offset, const Token::Value & value);
 
-        Token::U32String & string();
-        const Token::U32String & string() const;
         uint64_t & integer();
         const uint64_t & integer() const;
         double & real();
         const double & real() const;
+        SymbolTable::Symbol & symbol();
+        const SymbolTable::Symbol & symbol() const;
+        Token::Span & span();
+        const Token::Span & span() const;
+        const Token::Value & value() const;
 
         Token::Id id() const;
-        size_t line() const;
-        size_t column() const;
+        size_t offset() const;
         const char * name() const;
     private:
-        size_t m_Line, m_Column;
-        Token::Id m_Id;
-        union {
-            Token::U32String * str_ptr;
-            uint64_t integer;
-            double real;
-        } m_Data;
+        friend class TokenBuffer;
+
+        // 16 bytes in total: the offset and id share 8 bytes and the value
+        // takes the other 8. Lines and columns come from a SourceMap.
+        uint32_t m_Offset;
+        int8_t m_Id;        //< Token::Id, stored as a signed byte
+        Token::Value m_Data;
+    };
+
+    static_assert(std::is_trivially_copyable<Token>::value,
+        "Token must stay trivially copyable");
+    static_assert(sizeof(Token) == 16, "Token must stay 16 bytes");
+
+    /**
+     * \brief The name of every Token::Id, indexed by the Token::Id value
+     *
+     * Keyword names are the keyword text itself. This is visible here rather
+     * than private to token.cpp so the Lexer can build its keyword table from
+     * it at compile time.
+     */
+    inline constexpr const char * TokenNames[] = {
+        "\\n",
+
+        "+", "++", "-", "--", "/", "*", "**", "(", ")", "[", "]", "{", "}",
+        ".", "=", "!", "==", "!=", ">", ">=", "<", "<=", ">>", "<<",
+
+        "true", "false", "null",
+
+        "int8", "int16", "int32", "int64", "uint8", "uint16", "uint32",
+        "uint64", "float", "double", "char", "string",
+
+        "struct", "class", "public", "private", "protected", "super", "def",
+        "return", "pure", "for", "while", "if", "else", "elif", "switch",
+        "break", "continue",
+
+        "try", "catch", "throw",
+
+        "int", "float", "string", "docstring", "identifier"
     };
+    static_assert(sizeof(TokenNames) / sizeof(TokenNames[0]) == Token::_COUNT,
+        "TokenNames must have a name for every Token::Id");
 }
 
 #endif
\ No newline at end of file
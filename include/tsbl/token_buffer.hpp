@@ -0,0 +1,51 @@
+
+#pragma once
+#ifndef TSBL_TOKEN_BUFFER_HPP
+#define TSBL_TOKEN_BUFFER_HPP
+
+#include <stdint.h>
+#include <vector>
+#include "tsbl/token.hpp"
+
+namespace tsbl {
+    /**
+     * \brief A reusable block of Tokens, stored as parallel arrays
+     *
+     * Filled by Lexer::next_batch(). Ids, offsets and values each live in
+     * their own array, so a consumer which only looks at ids walks one byte
+     * per token. The arrays keep their capacity across clear(), so the same
+     * buffer can be refilled without allocating.
+     */
+    class TokenBuffer {
+    public:
+        TokenBuffer();
+        explicit TokenBuffer(size_t capacity);
+        ~TokenBuffer();
+
+        void push(const Token & token);
+        void append(const int8_t * ids, const uint32_t * offsets,
+            const Token::Value * values, size_t count);
+        void reserve(size_t capacity);
+        void clear();
+
+        size_t size() const;
+        size_t capacity() const;
+        bool empty() const;
+
+        Token::Id id(size_t index) const;
+        size_t offset(size_t index) const;
+        const Token::Value & value(size_t index) const;
+        Token token(size_t index) const;
+
+        const int8_t * ids() const;               //< Token::Id values
+        const uint32_t * offsets() const;         //< Byte offsets
+        const Token::Value * values() const;
+    private:
+        size_t m_Size;
+        std::vector<int8_t> m_Ids;
+        std::vector<uint32_t> m_Offsets;
+        std::vector<Token::Value> m_Values;
+    };
+}
+
+#endif
@@ -0,0 +1,77 @@
+
+#pragma once
+#ifndef TSBL_TOKEN_CACHE_HPP
+#define TSBL_TOKEN_CACHE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include "tsbl/lexer.hpp"
+#include "tsbl/token.hpp"
+#include "tsbl/token_buffer.hpp"
+
+namespace tsbl {
+    /**
+     * \brief A directory of lexed sources, keyed by a hash of their text
+     *
+     * Each source gets one file, named after its Hash(), holding its Tokens
+     * as the parallel arrays of a TokenBuffer along with the symbol names
+     * and materialized text they refer to. load() maps the file and checks
+     * it was written for the same text by the same Version, after which
+     * LexerBase::load() hands out its Tokens without lexing anything.
+     *
+     * Files are written whole under a temporary name and then renamed, so
+     * processes sharing a directory never see half of one. A file which is
+     * missing, stale or damaged is a miss, never an error.
+     */
+    class TokenCache {
+    public:
+        //< Bump whenever Tokens or the file layout change meaning
+        static constexpr uint32_t Version = 1;
+
+        explicit TokenCache(const char * directory);
+        ~TokenCache();
+
+        TokenCache(const TokenCache &) = delete;
+        TokenCache & operator=(const TokenCache &) = delete;
+
+        bool load(const uint8_t * data, size_t size);
+        bool store(const uint8_t * data, size_t size,
+            const LexerBase & lexer, const TokenBuffer & tokens);
+        void close();
+
+        bool loaded() const;
+        std::string path(uint64_t hash) const;
+
+        size_t size() const;
+        size_t end() const;
+        const int8_t * ids() const;
+        const uint32_t * offsets() const;
+        const Token::Value * values() const;
+        size_t symbols() const;
+        std::string_view symbol(size_t index) const;
+        std::string_view strings() const;
+
+        static uint64_t Hash(const uint8_t * data, size_t size,
+            uint64_t seed = 0);
+    private:
+        std::string m_Directory;
+        const uint8_t * m_Mapped; //< The whole file, null if not loaded
+        size_t m_MappedSize;
+        void * m_Mapping;         //< HANDLE of the file mapping on Windows
+
+        // Sections of the mapped file
+        size_t m_Tokens, m_Symbols, m_End;
+        const int8_t * m_Ids;
+        const uint32_t * m_Offsets;
+        const Token::Value * m_Values;
+        const uint32_t * m_NameEnds;  //< End of each name in m_Names
+        const char * m_Names;
+        std::string_view m_Strings;
+
+        bool map(const std::string & filename);
+    };
+}
+
+#endif
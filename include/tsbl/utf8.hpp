@@ -3,8 +3,10 @@
 #ifndef TSBL_UTF8_HPP
 #define TSBL_UTF8_HPP
 
+#include <stddef.h>
 #include <stdint.h>
 #include <utility>
+#include "tsbl/stats.hpp"
 
 namespace tsbl::utf8 {
 	typedef char32_t codepoint_t;
@@ -88,6 +90,11 @@ namespace tsbl::utf8 {
     const char * category_name(Category cat);
 	std::pair<intmax_t, codepoint_t>
 		iterate(const uint8_t *string, int32_t strlen);
+	size_t encode(codepoint_t codepoint, uint8_t * buffer);
+	size_t ascii_prefix(const uint8_t * data, size_t size);
+	size_t find_line_break(const uint8_t * data, size_t size);
+	std::pair<size_t, size_t> decode(const uint8_t * data, size_t size,
+		codepoint_t * buffer, size_t count);
 
 	class Reader {
 	public:
@@ -106,30 +113,140 @@ namespace tsbl::utf8 {
 		codepoint_t m_Current;
 	};
 
-	// TODO: Look into memory mapped files instead of FILE * streams
-	class FileReader : public Reader {
+	/**
+	 * \brief Reader which decodes a file through a buffer
+	 *
+	 * The concrete Readers are final and decode ASCII inline in next(), so
+	 * code which knows the Reader type, like BasicLexer, calls next()
+	 * directly and only leaves the inlined code for the rest.
+	 */
+	class FileReader final : public Reader {
 	public:
 		FileReader(const char * filename, size_t buffsize = 4096);
 		virtual ~FileReader();
 
-		virtual codepoint_t next();
+		virtual codepoint_t next() {
+			// With 4 bytes left no refill is needed. A bad sequence is
+			// never stepped over, so an error state never gets here.
+			if (m_BufferData - m_BufferIndex >= 4
+				&& m_Buffer[m_BufferIndex] < 0x80)
+			{
+				m_Current = m_Buffer[m_BufferIndex++];
+				TSBL_STATS_ADD(codepoints, 1);
+				return m_Current;
+			}
+			return next_sequence();
+		}
+		virtual size_t write(codepoint_t * buffer, size_t count);
 
 		virtual bool bad() const;
 	protected:
 		void * m_FilePtr; //< FILE *, handles the buffering for us
 		uint8_t * m_Buffer;
 		size_t m_BufferIndex, m_BufferSize, m_BufferData;
+
+		codepoint_t next_sequence();
+	};
+
+	/**
+	 * \brief Reader which streams from a file descriptor through a ring buffer
+	 *
+	 * Works with stdin, pipes and sockets, blocking or not. fill() takes
+	 * whatever the descriptor has without blocking, so it can be called
+	 * whenever poll/epoll says the descriptor is readable. A full ring buffer
+	 * is not read into, which leaves the data in the pipe and pushes back on
+	 * the writer. next() and write() wait for more data only when they run
+	 * out, so a codepoint split across reads is always decoded whole.
+	 *
+	 * In an event loop, lex while ready() says a whole line is buffered and
+	 * call fill() otherwise. The descriptor is not closed by the Reader.
+	 */
+	class FdReader final : public Reader {
+	public:
+		FdReader(int fd, size_t buffsize = 4096);
+		virtual ~FdReader();
+
+		virtual codepoint_t next();
+		virtual size_t write(codepoint_t * buffer, size_t count);
+
+		virtual bool bad() const;
+
+		size_t fill();
+		bool wait();
+		bool ready() const;
+		bool closed() const;
+		size_t buffered() const;
+		int fd() const;
+	protected:
+		int m_Fd;
+		uint8_t * m_Buffer;
+		size_t m_Mask;      //< Capacity - 1, the capacity is a power of 2
+		size_t m_Head;      //< Bytes taken out of the buffer so far
+		size_t m_Tail;      //< Bytes put into the buffer so far
+		size_t m_LineEnd;   //< Just after the last \n put into the buffer
+		bool m_Closed;      //< The descriptor has nothing more to give
+
+		ptrdiff_t read_some(uint8_t * buffer, size_t size, bool block);
 	};
 
-	class StringReader : public Reader {
+	/**
+	 * \brief Reader which decodes directly from a read-only file mapping
+	 *
+	 * The whole file is mapped into memory on construction and decoded in
+	 * place, so there is no intermediate buffer and no refill logic. The
+	 * mapping is hinted as sequential access so the OS reads ahead. An empty
+	 * file is not mapped at all: data() is null, size() is 0 and the Reader
+	 * starts at EndOfFile. As bad() is true at EndOfFile too, is_open() is
+	 * what tells it apart from a file which could not be opened.
+	 */
+	class MappedFileReader final : public Reader {
+	public:
+		MappedFileReader(const char * filename);
+		virtual ~MappedFileReader();
+
+		virtual codepoint_t next() {
+			if (m_Index < m_Size && m_Data[m_Index] < 0x80) {
+				m_Current = m_Data[m_Index++];
+				TSBL_STATS_ADD(codepoints, 1);
+				return m_Current;
+			}
+			return next_sequence();
+		}
+		virtual size_t write(codepoint_t * buffer, size_t count);
+
+		virtual bool bad() const;
+
+		bool is_open() const;
+		const uint8_t * data() const;
+		size_t size() const;
+	protected:
+		void * m_Mapping; //< HANDLE of the file mapping on Windows
+		const uint8_t * m_Data;
+		size_t m_Size, m_Index;
+		bool m_Open; //< Mapped, or found to be empty
+
+		codepoint_t next_sequence();
+	};
+
+	class StringReader final : public Reader {
 	public:
 		StringReader(const uint8_t * data);
 		virtual ~StringReader();
 
-		virtual codepoint_t next();
+		virtual codepoint_t next() {
+			if (m_Index < m_Size && m_Data[m_Index] < 0x80) {
+				m_Current = m_Data[m_Index++];
+				TSBL_STATS_ADD(codepoints, 1);
+				return m_Current;
+			}
+			return next_sequence();
+		}
+		virtual size_t write(codepoint_t * buffer, size_t count);
 	protected:
 		const uint8_t * m_Data;
-		size_t m_Index;
+		size_t m_Size, m_Index;
+
+		codepoint_t next_sequence();
 	};
 }
 
@@ -0,0 +1,127 @@
+
+#pragma once
+#ifndef TSBL_VALUE_HPP
+#define TSBL_VALUE_HPP
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace tsbl {
+    /**
+     * \brief A value on the Interpreter stack or in a Chunk's constants
+     *
+     * NaN-boxed into 8 bytes, so each stack slot is one register. A real is
+     * stored as its own bits, and the negative quiet NaNs above the one the
+     * hardware makes carry everything else in their low 48 bits:
+     *
+     *     0xFFF9 << 48 | int     ints, 48 bits wide, wrapping on overflow
+     *     0xFFFA << 48 | 0, 1, 3 null, false and true
+     *     0xFFFB << 48 | pointer strings
+     *
+     * Strings point at a u32 length followed by the text, in the strings of
+     * the Chunk or Image they came from. They are only made as the program
+     * runs, so no constant the Compiler makes holds an address, and
+     * Image::load() refuses any constant which is not a number, null or a
+     * bool.
+     */
+    class Value {
+    public:
+        enum Kind : uint8_t {
+            Null,
+            Bool,
+            Int,
+            Real,
+            String
+        };
+
+        static constexpr int64_t MaxInt = ((int64_t)1 << 47) - 1;
+        static constexpr int64_t MinInt = -((int64_t)1 << 47);
+
+        Value() : m_Bits(Value::NullBits) { }
+
+        static Value FromBool(bool boolean) {
+            return Value(Value::FalseBits | ((uint64_t)boolean << 1));
+        }
+
+        //< Keeps the low 48 bits, so larger ints wrap around
+        static Value FromInt(int64_t integer) {
+            return Value(Value::IntTag
+                | ((uint64_t)integer & Value::PayloadMask));
+        }
+
+        //< A NaN with one of the tags in its bits becomes a plain NaN
+        static Value FromReal(double real) {
+            uint64_t bits;
+            std::memcpy(&bits, &real, sizeof(bits));
+            return Value(bits < Value::IntTag ? bits : Value::NaNBits);
+        }
+
+        //< A u32 length then the text, see Chunk::add_string()
+        static Value FromString(const char * string) {
+            return Value(Value::StringTag
+                | ((uint64_t)(uintptr_t)string & Value::PayloadMask));
+        }
+
+        Value::Kind kind() const;
+        bool is_null() const { return m_Bits == Value::NullBits; }
+        bool is_bool() const { return (m_Bits | 2) == Value::TrueBits; }
+        bool is_int() const {
+            return (m_Bits & Value::TagMask) == Value::IntTag;
+        }
+        bool is_real() const { return m_Bits < Value::IntTag; }
+        bool is_number() const { return m_Bits < Value::SpecialTag; }
+        bool is_string() const {
+            return (m_Bits & Value::TagMask) == Value::StringTag;
+        }
+
+        bool as_bool() const { return m_Bits == Value::TrueBits; }
+        int64_t as_int() const { return (int64_t)(m_Bits << 16) >> 16; }
+        double as_real() const {
+            double real;
+            std::memcpy(&real, &m_Bits, sizeof(real));
+            return real;
+        }
+        std::string_view as_string() const {
+            const char * string = (const char *)(uintptr_t)
+                (m_Bits & Value::PayloadMask);
+            uint32_t size;
+            std::memcpy(&size, string, sizeof(size));
+            return std::string_view(string + sizeof(size), size);
+        }
+
+        //< Ints and reals both as a double
+        double as_number() const {
+            return (is_int() ? (double)as_int() : as_real());
+        }
+
+        //< Only null and false are false, and they differ in one bit
+        bool truthy() const {
+            return (m_Bits & ~(uint64_t)1) != Value::NullBits;
+        }
+
+        std::string to_string() const;
+
+        static bool Equal(const Value & left, const Value & right);
+        static const char * Name(Value::Kind kind);
+    private:
+        static constexpr uint64_t NaNBits = 0x7FF8000000000000ull;
+        static constexpr uint64_t TagMask = 0xFFFF000000000000ull;
+        static constexpr uint64_t PayloadMask = 0x0000FFFFFFFFFFFFull;
+        static constexpr uint64_t IntTag = 0xFFF9000000000000ull;
+        static constexpr uint64_t SpecialTag = 0xFFFA000000000000ull;
+        static constexpr uint64_t StringTag = 0xFFFB000000000000ull;
+        static constexpr uint64_t NullBits = Value::SpecialTag | 0;
+        static constexpr uint64_t FalseBits = Value::SpecialTag | 1;
+        static constexpr uint64_t TrueBits = Value::SpecialTag | 3;
+
+        explicit Value(uint64_t bits) : m_Bits(bits) { }
+
+        uint64_t m_Bits;
+    };
+
+    static_assert(sizeof(Value) == 8, "Value must fit in one register");
+}
+
+#endif
@@ -0,0 +1,129 @@
+
+#include "tsbl/arena.hpp"
+#include "tsbl/stats.hpp"
+
+#include <atomic>
+#include <cstdlib>
+
+using namespace tsbl;
+
+static std::atomic<size_t> _g_ArenaAllocations(0);
+
+const size_t Arena::DefaultChunkSize;
+const size_t Arena::MaxChunkSize;
+
+Arena::Arena() :
+    Arena(Arena::DefaultChunkSize)
+{ }
+
+/**
+ * \brief Create an Arena
+ *
+ * No memory is taken until the first allocation.
+ *
+ * \param chunk_size The size of the first chunk, at least 1 as it is
+ *     doubled until an allocation fits. Each chunk after that is twice as
+ *     big as the last, up to Arena::MaxChunkSize.
+ */
+Arena::Arena(size_t chunk_size) :
+    m_Head(nullptr), m_Cursor(nullptr), m_End(nullptr),
+    m_ChunkSize(chunk_size > 0 ? chunk_size : 1), m_Chunks(0), m_Used(0)
+{ }
+
+Arena::~Arena() {
+    while (m_Head != nullptr) {
+        Chunk * next = m_Head->next;
+        std::free(m_Head);
+        m_Head = next;
+    }
+}
+
+/**
+ * \brief Allocate memory which lives until the Arena is reset
+ *
+ * \param size The number of bytes to allocate
+ * \param align The alignment of the memory, a power of two
+ * \return The memory, never null
+ */
+void * Arena::allocate(size_t size, size_t align) {
+    uintptr_t cursor = ((uintptr_t)m_Cursor + (align - 1))
+        & ~(uintptr_t)(align - 1);
+    if (m_Cursor == nullptr || cursor + size > (uintptr_t)m_End) {
+        return grow(size, align);
+    }
+    m_Cursor = (uint8_t *)(cursor + size);
+    m_Used += size;
+    return (void *)cursor;
+}
+
+/**
+ * \brief Release everything allocated from the Arena
+ *
+ * The newest chunk, which is also the biggest, is kept for reuse and every
+ * other chunk is freed.
+ */
+void Arena::reset() {
+    if (m_Head == nullptr) {
+        return;
+    }
+    Chunk * chunk = m_Head->next;
+    while (chunk != nullptr) {
+        Chunk * next = chunk->next;
+        std::free(chunk);
+        chunk = next;
+    }
+    m_Head->next = nullptr;
+    m_Cursor = (uint8_t *)(m_Head + 1);
+    m_End = m_Cursor + m_Head->size;
+    m_Chunks = 1;
+    m_Used = 0;
+}
+
+/**
+ * \brief Get the number of chunks the Arena holds
+ */
+size_t Arena::chunks() const {
+    return m_Chunks;
+}
+
+/**
+ * \brief Get the number of bytes allocated since the last reset
+ */
+size_t Arena::used() const {
+    return m_Used;
+}
+
+/**
+ * \brief Get the number of chunks every Arena has taken from the heap
+ *
+ * This only goes up, so the difference across some work is the number of
+ * heap allocations the work made through Arenas.
+ */
+size_t Arena::Allocations() {
+    return _g_ArenaAllocations.load(std::memory_order_relaxed);
+}
+
+void * Arena::grow(size_t size, size_t align) {
+    size_t needed = size + align;
+    size_t chunk_size = m_ChunkSize;
+    while (chunk_size < needed) {
+        chunk_size *= 2;
+    }
+    if (m_ChunkSize < Arena::MaxChunkSize) {
+        m_ChunkSize *= 2;
+    }
+
+    Chunk * chunk = (Chunk *)std::malloc(sizeof(Chunk) + chunk_size);
+    if (chunk == nullptr) {
+        throw std::bad_alloc();
+    }
+    _g_ArenaAllocations.fetch_add(1, std::memory_order_relaxed);
+    TSBL_STATS_ADD(allocations, 1);
+    chunk->next = m_Head;
+    chunk->size = chunk_size;
+    m_Head = chunk;
+    m_Chunks += 1;
+    m_Cursor = (uint8_t *)(chunk + 1);
+    m_End = m_Cursor + chunk_size;
+    return allocate(size, align);
+}
@@ -0,0 +1,307 @@
+
+#include "tsbl/bytecode.hpp"
+
+#include <cstring>
+#include <iomanip>
+
+using namespace tsbl;
+
+extern const char * _g_OpcodeNames[];
+extern const uint8_t _g_OpcodeOperands[];
+
+Chunk::Chunk() :
+    m_Locals(0)
+{ }
+
+Chunk::~Chunk() { }
+
+/**
+ * \brief Append an instruction without operands
+ *
+ * \return The offset of the instruction
+ */
+size_t Chunk::emit(Opcode op, size_t line) {
+    size_t offset = m_Code.size();
+    write(&op, 1, line);
+    return offset;
+}
+
+/**
+ * \brief Append an instruction with a u16 operand
+ *
+ * \return The offset of the instruction
+ */
+size_t Chunk::emit(Opcode op, uint16_t operand, size_t line) {
+    size_t offset = emit(op, line);
+    write(&operand, sizeof(operand), line);
+    return offset;
+}
+
+/**
+ * \brief Append a jump whose target is not known yet
+ *
+ * \return What to give patch_jump() once the target is reached
+ */
+size_t Chunk::emit_jump(Opcode op, size_t line) {
+    emit(op, line);
+    int32_t placeholder = 0;
+    write(&placeholder, sizeof(placeholder), line);
+    return m_Code.size();
+}
+
+/**
+ * \brief Make a jump from emit_jump() land on the next instruction
+ */
+void Chunk::patch_jump(size_t jump) {
+    int32_t offset = (int32_t)(m_Code.size() - jump);
+    std::memcpy(&m_Code[jump - sizeof(offset)], &offset, sizeof(offset));
+}
+
+/**
+ * \brief Append a jump back to an earlier instruction
+ */
+void Chunk::emit_loop(size_t target, size_t line) {
+    emit(Opcode::Jump, line);
+    int32_t offset = (int32_t)target
+        - (int32_t)(m_Code.size() + sizeof(offset));
+    write(&offset, sizeof(offset), line);
+}
+
+/**
+ * \brief Rewrite an instruction with a u16 operand as another one
+ */
+void Chunk::patch(size_t offset, Opcode op, uint16_t operand) {
+    m_Code[offset] = (uint8_t)op;
+    std::memcpy(&m_Code[offset + 1], &operand, sizeof(operand));
+}
+
+/**
+ * \brief Add a Value to the constants
+ *
+ * \return The index of the constant. Only the first 65536 can be loaded by
+ *     Opcode::Constant.
+ */
+size_t Chunk::add_constant(const Value & value) {
+    m_Constants.push_back(value);
+    return m_Constants.size() - 1;
+}
+
+/**
+ * \brief Add the raw bits of a stack slot, for Opcode::TypedConstant
+ *
+ * \return The index of the constant. Only the first 65536 can be loaded.
+ */
+size_t Chunk::add_typed_constant(uint64_t bits) {
+    m_TypedConstants.push_back(bits);
+    return m_TypedConstants.size() - 1;
+}
+
+/**
+ * \brief Copy text into the string table, for Opcode::String
+ *
+ * It is kept as Value::FromString() points at it, after its u32 length
+ * and before a NUL.
+ *
+ * \return The index of the string. Only the first 65536 can be loaded.
+ */
+size_t Chunk::add_string(std::string_view text) {
+    uint32_t size = (uint32_t)text.size();
+    size_t offset = m_Strings.size();
+    m_Strings.resize(offset + sizeof(size) + text.size() + 1);
+    std::memcpy(&m_Strings[offset], &size, sizeof(size));
+    std::memcpy(&m_Strings[offset + sizeof(size)], text.data(), text.size());
+    m_Strings.back() = '\0';
+    m_StringOffsets.push_back((uint32_t)offset);
+    return m_StringOffsets.size() - 1;
+}
+
+/**
+ * \brief Set the number of local slots the code uses
+ *
+ * The Interpreter sets this many slots to null at the bottom of the stack
+ * before running the Chunk.
+ */
+void Chunk::set_locals(size_t count) {
+    m_Locals = count;
+}
+
+/**
+ * \brief Remove all code, constants and strings
+ */
+void Chunk::clear() {
+    m_Code.clear();
+    m_Lines.clear();
+    m_Constants.clear();
+    m_TypedConstants.clear();
+    m_Strings.clear();
+    m_StringOffsets.clear();
+    m_Locals = 0;
+}
+
+const uint8_t * Chunk::code() const {
+    return m_Code.data();
+}
+
+size_t Chunk::size() const {
+    return m_Code.size();
+}
+
+const Value & Chunk::constant(size_t index) const {
+    return m_Constants[index];
+}
+
+size_t Chunk::constants() const {
+    return m_Constants.size();
+}
+
+const uint64_t & Chunk::typed_constant(size_t index) const {
+    return m_TypedConstants[index];
+}
+
+size_t Chunk::typed_constants() const {
+    return m_TypedConstants.size();
+}
+
+std::string_view Chunk::string(size_t index) const {
+    return Value::FromString(&m_Strings[m_StringOffsets[index]]).as_string();
+}
+
+size_t Chunk::strings() const {
+    return m_StringOffsets.size();
+}
+
+size_t Chunk::locals() const {
+    return m_Locals;
+}
+
+/**
+ * \brief Get the source line an offset in the code was compiled from
+ */
+size_t Chunk::line(size_t offset) const {
+    return (offset < m_Lines.size() ? m_Lines[offset] : 0);
+}
+
+/**
+ * \brief Get the code and constants for the Interpreter
+ *
+ * Adding to the Chunk may move them, so get it again after.
+ */
+Program Chunk::program() const {
+    Program program;
+    program.code = m_Code.data();
+    program.size = m_Code.size();
+    program.lines = m_Lines.data();
+    program.constants = m_Constants.data();
+    program.typed_constants = m_TypedConstants.data();
+    program.string_offsets = m_StringOffsets.data();
+    program.strings = m_Strings.data();
+    program.locals = m_Locals;
+    return program;
+}
+
+/**
+ * \brief Write one instruction in a readable form
+ *
+ * \return The offset of the next instruction
+ */
+size_t Chunk::disassemble(std::ostream & out, size_t offset) const {
+    Opcode op = (Opcode)m_Code[offset];
+    size_t length = Chunk::Length(op);
+    size_t end = offset + length - (Chunk::IsJump(op) ? 4 : 0);
+    out << std::setw(6) << offset << std::setw(5) << line(offset) << "  "
+        << Chunk::Name(op);
+    uint16_t operand = 0;
+    for (size_t at = offset + 1; at + 2 <= end; at += 2) {
+        std::memcpy(&operand, &m_Code[at], sizeof(operand));
+        out << " " << operand;
+    }
+    if (op == Opcode::Constant && operand < m_Constants.size()) {
+        out << " (" << m_Constants[operand].to_string() << ")";
+    }
+    else if (op == Opcode::String && operand < m_StringOffsets.size()) {
+        out << " (" << string(operand) << ")";
+    }
+    else if (op == Opcode::TypedConstant
+        && operand < m_TypedConstants.size())
+    {
+        out << " (0x" << std::hex << m_TypedConstants[operand]
+            << std::dec << ")";
+    }
+    if (Chunk::IsJump(op)) {
+        int32_t jump;
+        std::memcpy(&jump, &m_Code[end], sizeof(jump));
+        out << " -> " << (offset + length + jump);
+    }
+    out << "\n";
+    return offset + Chunk::Length(op);
+}
+
+/**
+ * \brief Write every instruction in a readable form
+ */
+void Chunk::disassemble(std::ostream & out) const {
+    size_t offset = 0;
+    while (offset < m_Code.size()) {
+        offset = disassemble(out, offset);
+    }
+}
+
+/**
+ * \brief Get the name of an Opcode
+ */
+const char * Chunk::Name(Opcode op) {
+    if (op >= Opcode::_COUNT) {
+        return "Unknown";
+    }
+    return _g_OpcodeNames[(size_t)op];
+}
+
+/**
+ * \brief Get the length of an instruction, operands included
+ */
+size_t Chunk::Length(Opcode op) {
+    if (op >= Opcode::_COUNT) {
+        return 1;
+    }
+    return 1 + _g_OpcodeOperands[(size_t)op];
+}
+
+/**
+ * \brief Check if an Opcode ends in a jump offset
+ */
+bool Chunk::IsJump(Opcode op) {
+    switch (op) {
+    case Opcode::Jump:
+    case Opcode::JumpIfFalse:
+    case Opcode::JumpIfNotLessLocals:
+    case Opcode::JumpIfNotLessConstant:
+#define TSBL_TYPED_JUMPS(name, type) \
+    case Opcode::JumpIfNotLessLocals##name: \
+    case Opcode::JumpIfNotLessConstant##name:
+    TSBL_TYPES(TSBL_TYPED_JUMPS)
+#undef TSBL_TYPED_JUMPS
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Chunk::write(const void * data, size_t size, size_t line) {
+    const uint8_t * bytes = (const uint8_t *)data;
+    m_Code.insert(m_Code.end(), bytes, bytes + size);
+    m_Lines.insert(m_Lines.end(), size, (uint32_t)line);
+}
+
+//===========================================================================
+// Data definitions
+const char * _g_OpcodeNames[] = {
+#define TSBL_OPCODE_NAME(name, operands) #name,
+    TSBL_OPCODES(TSBL_OPCODE_NAME)
+#undef TSBL_OPCODE_NAME
+};
+
+const uint8_t _g_OpcodeOperands[] = {
+#define TSBL_OPCODE_OPERANDS(name, operands) operands,
+    TSBL_OPCODES(TSBL_OPCODE_OPERANDS)
+#undef TSBL_OPCODE_OPERANDS
+};
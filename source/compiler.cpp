@@ -0,0 +1,933 @@
+
+#include "tsbl/compiler.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace tsbl;
+
+namespace {
+    // The columns of _g_TypedOpcodes
+    enum TypedForm {
+        TypedAdd,
+        TypedSub,
+        TypedMul,
+        TypedDiv,
+        TypedNeg,
+        TypedEquals,
+        TypedNotEquals,
+        TypedGreater,
+        TypedGreaterEquals,
+        TypedLess,
+        TypedLessEquals,
+        TypedBox,
+        TypedUnbox,
+        TypedShl,
+        TypedShr,
+        TypedForms
+    };
+}
+
+extern const Opcode _g_TypedOpcodes[][TypedForms];
+
+const uint32_t Compiler::NoSlot;
+
+/**
+ * \brief Create a Compiler reading from a Lexer and writing to a Chunk
+ *
+ * The Lexer must already be reading its source, and the Chunk should be
+ * empty.
+ */
+Compiler::Compiler(Lexer & lexer, Chunk & chunk) :
+    m_Lexer(lexer), m_Tokens(nullptr), m_Next(0), m_Chunk(chunk), m_Line(0),
+    m_Failed(false), m_ErrorLine(0), m_ErrorColumn(0), m_Parens(0),
+    m_Locals(0), m_LastGet(SIZE_MAX), m_Type(Type::Any),
+    m_Literal{ SIZE_MAX, Token::Value(), false }
+{ }
+
+/**
+ * \brief Create a Compiler reading Tokens the Lexer has already lexed
+ *
+ * The TokenBuffer must hold every Token of the source, up to and including
+ * the EndOfFile or error which ended it, as Lexer::lex_parallel() and
+ * Lexer::load() give.
+ */
+Compiler::Compiler(Lexer & lexer, const TokenBuffer & tokens, Chunk & chunk) :
+    m_Lexer(lexer), m_Tokens(&tokens), m_Next(0), m_Chunk(chunk), m_Line(0),
+    m_Failed(false), m_ErrorLine(0), m_ErrorColumn(0), m_Parens(0),
+    m_Locals(0), m_LastGet(SIZE_MAX), m_Type(Type::Any),
+    m_Literal{ SIZE_MAX, Token::Value(), false }
+{ }
+
+Compiler::~Compiler() { }
+
+/**
+ * \brief Compile the whole source
+ *
+ * Compiling stops at the first error. The Chunk returns null if it runs
+ * off the end without a return.
+ *
+ * \return False if there was an error, see error()
+ */
+bool Compiler::compile() {
+    advance();
+    skip_newlines();
+    while (!check(Token::Id::EndOfFile)) {
+        statement();
+        skip_newlines();
+    }
+    emit(Opcode::Null);
+    emit(Opcode::Return);
+    m_Chunk.set_locals(m_Locals);
+    return !m_Failed;
+}
+
+/**
+ * \brief Get the message of the error which stopped compiling
+ */
+const std::string & Compiler::error() const {
+    return m_Error;
+}
+
+size_t Compiler::error_line() const {
+    return m_ErrorLine;
+}
+
+size_t Compiler::error_column() const {
+    return m_ErrorColumn;
+}
+
+/**
+ * \brief Move on to the next Token
+ *
+ * New lines inside parentheses are skipped. Lexer errors fail the compile.
+ * Once it has failed only EndOfFile comes out, which unwinds every rule.
+ *
+ * Tokens only hold their byte offset. Their line is found by walking the
+ * SourceMap along with them, as they only ever move forward.
+ */
+void Compiler::advance() {
+    m_Previous = m_Current;
+    const SourceMap & map = m_Lexer.source_map();
+    while (m_Line + 1 < map.lines()
+        && map.line_start(m_Line + 1) <= m_Previous.offset())
+    {
+        m_Line += 1;
+    }
+    if (m_Failed) {
+        return;
+    }
+    m_Current = next_token();
+    while (m_Parens > 0 && m_Current.id() == Token::Id::NewLine) {
+        m_Current = next_token();
+    }
+    if (m_Current.id() < 0 && m_Current.id() != Token::Id::EndOfFile) {
+        fail(m_Current, Token::Name(m_Current.id()));
+    }
+}
+
+/**
+ * \brief Get the next Token from the TokenBuffer or else the Lexer
+ *
+ * The last Token of the TokenBuffer repeats, as it would from the Lexer.
+ */
+Token Compiler::next_token() {
+    if (m_Tokens == nullptr) {
+        return m_Lexer.next();
+    }
+    if (m_Tokens->empty()) {
+        return Token(Token::Id::EndOfFile, 0);
+    }
+    if (m_Next < m_Tokens->size()) {
+        return m_Tokens->token(m_Next++);
+    }
+    return m_Tokens->token(m_Tokens->size() - 1);
+}
+
+bool Compiler::check(Token::Id id) const {
+    return m_Current.id() == id;
+}
+
+bool Compiler::match(Token::Id id) {
+    if (!check(id)) {
+        return false;
+    }
+    advance();
+    return true;
+}
+
+void Compiler::expect(Token::Id id, const char * message) {
+    if (!match(id)) {
+        fail(m_Current, message);
+    }
+}
+
+void Compiler::skip_newlines() {
+    while (match(Token::Id::NewLine)) { }
+}
+
+void Compiler::statement() {
+    switch (m_Current.id()) {
+    case Token::Id::If:
+        advance();
+        if_statement();
+        break;
+    case Token::Id::While:
+        advance();
+        while_statement();
+        break;
+    case Token::Id::Break:
+    case Token::Id::Continue:
+        advance();
+        jump_statement();
+        break;
+    case Token::Id::Return:
+        advance();
+        return_statement();
+        break;
+    case Token::Id::OpenBrace:
+        advance();
+        block();
+        break;
+    case Token::Id::Int8:
+    case Token::Id::Int16:
+    case Token::Id::Int32:
+    case Token::Id::Int64:
+    case Token::Id::UInt8:
+    case Token::Id::UInt16:
+    case Token::Id::UInt32:
+    case Token::Id::UInt64:
+    case Token::Id::Float:
+    case Token::Id::Double:
+        advance();
+        typed_declaration();
+        break;
+    default:
+        expression();
+        emit(Opcode::Pop);
+        break;
+    }
+    end_statement();
+}
+
+/**
+ * \brief Check a statement is followed by a new line, the end or a }
+ */
+void Compiler::end_statement() {
+    if (!match(Token::Id::NewLine) && !check(Token::Id::EndOfFile)
+        && !check(Token::Id::CloseBrace))
+    {
+        fail(m_Current, "Expected the end of the statement");
+    }
+}
+
+/**
+ * \brief Compile statements up to the } ending a block, whose { is read
+ */
+void Compiler::block() {
+    skip_newlines();
+    while (!check(Token::Id::CloseBrace) && !check(Token::Id::EndOfFile)) {
+        statement();
+        skip_newlines();
+    }
+    expect(Token::Id::CloseBrace, "Expected } to end the block");
+}
+
+/**
+ * \brief Compile an if after the if or elif Token
+ *
+ * An elif is compiled as an if in the else block.
+ */
+void Compiler::if_statement() {
+    expression();
+    coerce(Type::Any);
+    size_t skip = m_Chunk.emit_jump(Opcode::JumpIfFalse, m_Line);
+    expect(Token::Id::OpenBrace, "Expected { after the if condition");
+    block();
+
+    if (check(Token::Id::Elif) || check(Token::Id::Else)) {
+        size_t done = m_Chunk.emit_jump(Opcode::Jump, m_Line);
+        m_Chunk.patch_jump(skip);
+        if (match(Token::Id::Elif)) {
+            if_statement();
+        }
+        else {
+            advance();
+            expect(Token::Id::OpenBrace, "Expected { after else");
+            block();
+        }
+        m_Chunk.patch_jump(done);
+    }
+    else {
+        m_Chunk.patch_jump(skip);
+    }
+}
+
+void Compiler::while_statement() {
+    m_Loops.push_back(Loop{ m_Chunk.size(), {} });
+    expression();
+    coerce(Type::Any);
+    size_t exit = m_Chunk.emit_jump(Opcode::JumpIfFalse, m_Line);
+    expect(Token::Id::OpenBrace, "Expected { after the while condition");
+    block();
+    m_Chunk.emit_loop(m_Loops.back().start, m_Line);
+
+    m_Chunk.patch_jump(exit);
+    for (size_t jump : m_Loops.back().breaks) {
+        m_Chunk.patch_jump(jump);
+    }
+    m_Loops.pop_back();
+}
+
+/**
+ * \brief Compile a declaration of a typed variable, after the type
+ */
+void Compiler::typed_declaration() {
+    Type type = (Type)((int)Type::I8 + (m_Previous.id() - Token::Id::Int8));
+    if (!match(Token::Id::Identifier)) {
+        fail(m_Current, "Expected a variable name after the type");
+        return;
+    }
+    Token name = m_Previous;
+    if (slot(name.symbol()) != Compiler::NoSlot) {
+        fail(name, std::string(m_Lexer.symbols().name(name.symbol()))
+            + " is already declared");
+        return;
+    }
+    expect(Token::Id::Assign, "Expected = after the variable name");
+    expression();
+    coerce(type);
+    uint32_t index = declare(name.symbol(), type);
+    emit(Opcode::SetLocal, (uint16_t)index);
+    emit(Opcode::Pop);
+}
+
+/**
+ * \brief Compile a break or continue, after the Token
+ */
+void Compiler::jump_statement() {
+    if (m_Loops.empty()) {
+        fail(m_Previous, std::string(Token::Name(m_Previous.id()))
+            + " outside of a loop");
+        return;
+    }
+    if (m_Previous.id() == Token::Id::Break) {
+        m_Loops.back().breaks.push_back(
+            m_Chunk.emit_jump(Opcode::Jump, m_Line));
+    }
+    else {
+        m_Chunk.emit_loop(m_Loops.back().start, m_Line);
+    }
+}
+
+void Compiler::return_statement() {
+    if (check(Token::Id::NewLine) || check(Token::Id::EndOfFile)
+        || check(Token::Id::CloseBrace))
+    {
+        emit(Opcode::Null);
+    }
+    else {
+        expression();
+        coerce(Type::Any);
+    }
+    emit(Opcode::Return);
+}
+
+void Compiler::expression() {
+    parse(Compiler::Assignment);
+}
+
+/**
+ * \brief Compile an expression of operators at least as tight as precedence
+ */
+void Compiler::parse(Compiler::Precedence precedence) {
+    advance();
+    ParseFn prefix = GetRule(m_Previous.id()).prefix;
+    if (prefix == nullptr) {
+        fail(m_Previous, "Expected an expression");
+        return;
+    }
+    bool assignable = (precedence <= Compiler::Assignment);
+    (this->*prefix)(assignable);
+
+    while (precedence <= GetRule(m_Current.id()).precedence) {
+        advance();
+        (this->*GetRule(m_Previous.id()).infix)(assignable);
+    }
+    if (assignable && check(Token::Id::Assign)) {
+        fail(m_Current, "Can only assign to a variable");
+    }
+}
+
+void Compiler::literal(bool) {
+    m_Type = Type::Any;
+    switch (m_Previous.id()) {
+    case Token::Id::True:
+        emit(Opcode::True);
+        break;
+    case Token::Id::False:
+        emit(Opcode::False);
+        break;
+    default:
+        emit(Opcode::Null);
+        break;
+    }
+}
+
+/**
+ * \brief Compile a number literal as a Value
+ *
+ * It is remembered, so an operator can make it a typed constant instead.
+ * A literal with a type suffix is a typed constant of that type already,
+ * which the Lexer checked it fits.
+ */
+void Compiler::number(bool) {
+    Token::Value value;
+    m_Type = Type::Any;
+    m_Literal = Literal{ m_Chunk.size(), Token::Value(), false };
+    Token::Id type = m_Lexer.number(m_Previous, value);
+    switch (type) {
+    case Token::Id::Invalid:
+        fail(m_Previous, "Invalid number");
+        break;
+    case Token::Id::RealValue:
+        m_Literal.value = value;
+        m_Literal.real = true;
+        emit_constant(Value::FromReal(value.real));
+        break;
+    case Token::Id::IntegerValue:
+        m_Literal.value = value;
+        // Ints only have 48 bits, past that the literal is kept as a real
+        if (value.integer > (uint64_t)Value::MaxInt) {
+            emit_constant(Value::FromReal((double)value.integer));
+        }
+        else {
+            emit_constant(Value::FromInt((int64_t)value.integer));
+        }
+        break;
+    default: {
+        Literal literal{ SIZE_MAX, value,
+            type == Token::Id::Float || type == Token::Id::Double };
+        m_Literal.offset = SIZE_MAX;
+        m_Type = (Type)((int)Type::I8 + (type - Token::Id::Int8));
+        uint64_t bits = 0;
+        LiteralBits(literal, m_Type, bits);
+        emit(Opcode::TypedConstant, add_typed_constant(bits));
+        break;
+    }
+    }
+}
+
+void Compiler::string(bool) {
+    m_Type = Type::Any;
+    // Text materialized by the Lexer can move as it lexes on, so the keys
+    // are copies
+    std::string text(m_Lexer.string(m_Previous));
+    auto found = m_Strings.find(text);
+    if (found != m_Strings.end()) {
+        emit(Opcode::String, found->second);
+        return;
+    }
+    size_t index = m_Chunk.add_string(text);
+    if (index > UINT16_MAX) {
+        fail(m_Previous, "Too many strings");
+        index = 0;
+    }
+    m_Strings.emplace(text, (uint16_t)index);
+    emit(Opcode::String, (uint16_t)index);
+}
+
+/**
+ * \brief Compile a read of a variable, or an assignment to one
+ */
+void Compiler::variable(bool assignable) {
+    SymbolTable::Symbol symbol = m_Previous.symbol();
+    if (assignable && match(Token::Id::Assign)) {
+        expression();
+        uint32_t index = slot(symbol);
+        if (index == Compiler::NoSlot) {
+            index = declare(symbol, Type::Any);
+        }
+        if (m_Failed) {
+            return;
+        }
+        coerce(m_Types[index]);
+        emit(Opcode::SetLocal, (uint16_t)index);
+        return;
+    }
+
+    uint32_t index = slot(symbol);
+    if (index == Compiler::NoSlot) {
+        fail(m_Previous, "Unknown variable "
+            + std::string(m_Lexer.symbols().name(symbol)));
+        return;
+    }
+    m_LastGet = emit(Opcode::GetLocal, (uint16_t)index);
+    m_Type = m_Types[index];
+}
+
+void Compiler::grouping(bool) {
+    m_Parens += 1;
+    skip_newlines();
+    expression();
+    m_Parens -= 1;
+    expect(Token::Id::CloseParen, "Expected ) after the expression");
+}
+
+void Compiler::unary(bool) {
+    Token::Id op = m_Previous.id();
+    parse(Compiler::Unary);
+    if (op == Token::Id::Minus && m_Type != Type::Any) {
+        emit(TypedOpcode(Opcode::Negate, m_Type));
+        return;
+    }
+    coerce(Type::Any);
+    emit(op == Token::Id::Minus ? Opcode::Negate : Opcode::Not);
+}
+
+/**
+ * \brief Compile ++name or --name, which updates the variable
+ */
+void Compiler::prefix_step(bool) {
+    Token op = m_Previous;
+    if (!match(Token::Id::Identifier)) {
+        fail(op, std::string("Can only use ") + Token::Name(op.id())
+            + " on a variable");
+        return;
+    }
+    variable(false);
+    step(op.id());
+}
+
+/**
+ * \brief Compile a binary operator, typed if both sides have one type
+ *
+ * A number literal on one side takes the type of the other, if it fits.
+ * Anything else with mixed types, or an operator with no typed form, works
+ * on Values.
+ */
+void Compiler::binary(bool) {
+    Token::Id op = m_Previous.id();
+    Type left = m_Type;
+    Literal left_literal = m_Literal;
+    bool left_is_literal = last_is_literal();
+
+    Compiler::Precedence precedence = GetRule(op).precedence;
+    // ** is right associative, everything else is left associative
+    parse(op == Token::Id::Power ? precedence
+        : (Compiler::Precedence)(precedence + 1));
+    Type right = m_Type;
+
+    if (left == Type::Any && right != Type::Any && left_is_literal
+        && type_literal(left_literal, right))
+    {
+        left = right;
+    }
+    else if (right == Type::Any && left != Type::Any && last_is_literal()
+        && type_literal(m_Literal, left))
+    {
+        right = left;
+    }
+
+    Opcode generic = BinaryOpcode(op);
+    Opcode typed = (left == right ? TypedOpcode(generic, left)
+        : Opcode::_COUNT);
+    if (typed == Opcode::_COUNT) {
+        if (left != Type::Any) {
+            emit(BoxOpcode(left), 1);
+        }
+        if (right != Type::Any) {
+            emit(BoxOpcode(right), 0);
+        }
+        emit(generic);
+        m_Type = Type::Any;
+        return;
+    }
+    emit(typed);
+    // Comparisons give a bool Value
+    m_Type = (generic >= Opcode::Equals && generic <= Opcode::LessEquals ?
+        Type::Any : left);
+}
+
+/**
+ * \brief Compile name++ or name--, which updates the variable
+ *
+ * Both forms give the new value of the variable.
+ */
+void Compiler::postfix_step(bool) {
+    step(m_Previous.id());
+}
+
+/**
+ * \brief Step the variable just loaded by the last GetLocal up or down
+ */
+void Compiler::step(Token::Id op) {
+    if (m_Failed) {
+        return;
+    }
+    if (m_LastGet == SIZE_MAX || m_LastGet + 3 != m_Chunk.size()) {
+        fail(m_Previous, std::string("Can only use ") + Token::Name(op)
+            + " on a variable");
+        return;
+    }
+    uint16_t index;
+    std::memcpy(&index, m_Chunk.code() + m_LastGet + 1, sizeof(index));
+    Type type = m_Types[index];
+    if (type == Type::Any) {
+        emit(op == Token::Id::Increment ? Opcode::Increment
+            : Opcode::Decrement);
+    }
+    else {
+        Literal one{ SIZE_MAX, Token::Value(), false };
+        one.value.integer = 1;
+        uint64_t bits = 0;
+        LiteralBits(one, type, bits);
+        emit(Opcode::TypedConstant, add_typed_constant(bits));
+        emit(TypedOpcode(op == Token::Id::Increment ? Opcode::Plus
+            : Opcode::Minus, type));
+    }
+    emit(Opcode::SetLocal, index);
+    m_LastGet = SIZE_MAX;
+    m_Type = type;
+}
+
+/**
+ * \brief Convert the result of the last expression to a static type
+ *
+ * Typed values are boxed into Values and Values are unboxed, which fails
+ * when run if they do not fit. A number literal is made a typed constant,
+ * and one which does not fit fails to compile instead. As with Unbox, a
+ * real literal fits an integer type if it holds an integer in its range.
+ */
+void Compiler::coerce(Type type) {
+    if (m_Type == type || m_Failed) {
+        return;
+    }
+    if (type == Type::Any) {
+        emit(BoxOpcode(m_Type), 0);
+    }
+    else if (m_Type == Type::Any && last_is_literal()) {
+        Literal literal = m_Literal;
+        // Below 2^64, so the cast is exact, and LiteralBits() checks the
+        // rest of the range
+        if (literal.real && type < Type::F32
+            && literal.value.real == std::trunc(literal.value.real)
+            && literal.value.real < 18446744073709551616.0)
+        {
+            literal.value.integer = (uint64_t)literal.value.real;
+            literal.real = false;
+        }
+        if (!type_literal(literal, type)) {
+            Token::Id keyword = (Token::Id)(Token::Id::Int8
+                + ((int)type - (int)Type::I8));
+            fail(m_Previous, std::string("Number does not fit in ")
+                + Token::Name(keyword));
+        }
+    }
+    else {
+        if (m_Type != Type::Any) {
+            emit(BoxOpcode(m_Type), 0);
+        }
+        emit(UnboxOpcode(type));
+    }
+    m_Type = type;
+}
+
+/**
+ * \brief Check if the last instruction is the Constant of a number literal
+ *
+ * Every other expression ends in an instruction of its own, so the
+ * literal is then the whole expression just compiled.
+ */
+bool Compiler::last_is_literal() const {
+    return m_Literal.offset != SIZE_MAX
+        && m_Literal.offset + Chunk::Length(Opcode::Constant)
+            == m_Chunk.size();
+}
+
+/**
+ * \brief Rewrite the Constant of a number literal as a typed constant
+ *
+ * \return False if the literal can not have the type, a real for an
+ *     integer type
+ */
+bool Compiler::type_literal(const Literal & literal, Type type) {
+    uint64_t bits = 0;
+    if (!LiteralBits(literal, type, bits)) {
+        return false;
+    }
+    m_Chunk.patch(literal.offset, Opcode::TypedConstant,
+        add_typed_constant(bits));
+    return true;
+}
+
+size_t Compiler::emit(Opcode op) {
+    return m_Chunk.emit(op, m_Line);
+}
+
+size_t Compiler::emit(Opcode op, uint16_t operand) {
+    return m_Chunk.emit(op, operand, m_Line);
+}
+
+/**
+ * \brief Emit a load of a number, reusing the constant if it was seen
+ */
+void Compiler::emit_constant(const Value & value) {
+    if (value.is_int()) {
+        auto found = m_Ints.find(value.as_int());
+        if (found == m_Ints.end()) {
+            found = m_Ints.emplace(value.as_int(), add_constant(value)).first;
+        }
+        emit(Opcode::Constant, found->second);
+    }
+    else {
+        uint64_t bits;
+        double real = value.as_real();
+        std::memcpy(&bits, &real, sizeof(bits));
+        auto found = m_Reals.find(bits);
+        if (found == m_Reals.end()) {
+            found = m_Reals.emplace(bits, add_constant(value)).first;
+        }
+        emit(Opcode::Constant, found->second);
+    }
+}
+
+uint16_t Compiler::add_constant(const Value & value) {
+    size_t index = m_Chunk.add_constant(value);
+    if (index > UINT16_MAX) {
+        fail(m_Previous, "Too many constants");
+        return 0;
+    }
+    return (uint16_t)index;
+}
+
+uint16_t Compiler::add_typed_constant(uint64_t bits) {
+    auto found = m_TypedConstants.find(bits);
+    if (found != m_TypedConstants.end()) {
+        return found->second;
+    }
+    size_t index = m_Chunk.add_typed_constant(bits);
+    if (index > UINT16_MAX) {
+        fail(m_Previous, "Too many constants");
+        return 0;
+    }
+    m_TypedConstants.emplace(bits, (uint16_t)index);
+    return (uint16_t)index;
+}
+
+/**
+ * \brief Get the local slot of a variable, NoSlot if it was never assigned
+ */
+uint32_t Compiler::slot(SymbolTable::Symbol symbol) const {
+    if (symbol >= m_Slots.size()) {
+        return Compiler::NoSlot;
+    }
+    return m_Slots[symbol];
+}
+
+uint32_t Compiler::declare(SymbolTable::Symbol symbol, Type type) {
+    if (m_Locals > UINT16_MAX) {
+        fail(m_Previous, "Too many variables");
+        return 0;
+    }
+    if (symbol >= m_Slots.size()) {
+        m_Slots.resize(symbol + 1, Compiler::NoSlot);
+    }
+    m_Slots[symbol] = (uint32_t)m_Locals;
+    m_Types.push_back(type);
+    return (uint32_t)m_Locals++;
+}
+
+/**
+ * \brief Stop compiling with an error at a Token
+ *
+ * Only the first error is kept.
+ */
+void Compiler::fail(const Token & at, const std::string & message) {
+    if (m_Failed) {
+        return;
+    }
+    m_Failed = true;
+    m_Error = message;
+    const SourceMap & map = m_Lexer.source_map();
+    m_ErrorLine = map.line(at.offset());
+    m_ErrorColumn = map.column(at.offset());
+    m_Current = Token(Token::Id::EndOfFile, at.offset());
+}
+
+/**
+ * \brief Get how a Token::Id starts or continues an expression
+ */
+Compiler::Rule Compiler::GetRule(Token::Id id) {
+    switch (id) {
+    case Token::Id::OpenParen:
+        return Rule{ &Compiler::grouping, nullptr, Compiler::None };
+    case Token::Id::Minus:
+        return Rule{ &Compiler::unary, &Compiler::binary, Compiler::Term };
+    case Token::Id::Plus:
+        return Rule{ nullptr, &Compiler::binary, Compiler::Term };
+    case Token::Id::Multiply:
+    case Token::Id::Divide:
+        return Rule{ nullptr, &Compiler::binary, Compiler::Factor };
+    case Token::Id::Power:
+        return Rule{ nullptr, &Compiler::binary, Compiler::Exponent };
+    case Token::Id::Not:
+        return Rule{ &Compiler::unary, nullptr, Compiler::None };
+    case Token::Id::Increment:
+    case Token::Id::Decrement:
+        return Rule{ &Compiler::prefix_step, &Compiler::postfix_step,
+            Compiler::Postfix };
+    case Token::Id::Equals:
+    case Token::Id::NotEquals:
+        return Rule{ nullptr, &Compiler::binary, Compiler::Equality };
+    case Token::Id::Greater:
+    case Token::Id::GreaterEquals:
+    case Token::Id::Less:
+    case Token::Id::LessEquals:
+        return Rule{ nullptr, &Compiler::binary, Compiler::Comparison };
+    case Token::Id::LShift:
+    case Token::Id::RShift:
+        return Rule{ nullptr, &Compiler::binary, Compiler::Shift };
+    case Token::Id::True:
+    case Token::Id::False:
+    case Token::Id::Null:
+        return Rule{ &Compiler::literal, nullptr, Compiler::None };
+    case Token::Id::IntegerValue:
+    case Token::Id::RealValue:
+        return Rule{ &Compiler::number, nullptr, Compiler::None };
+    case Token::Id::StringValue:
+    case Token::Id::LongString:
+        return Rule{ &Compiler::string, nullptr, Compiler::None };
+    case Token::Id::Identifier:
+        return Rule{ &Compiler::variable, nullptr, Compiler::None };
+    default:
+        return Rule{ nullptr, nullptr, Compiler::None };
+    }
+}
+
+/**
+ * \brief Get the Opcode of a binary operator Token::Id
+ */
+Opcode Compiler::BinaryOpcode(Token::Id id) {
+    switch (id) {
+    case Token::Id::Plus: return Opcode::Plus;
+    case Token::Id::Minus: return Opcode::Minus;
+    case Token::Id::Multiply: return Opcode::Multiply;
+    case Token::Id::Divide: return Opcode::Divide;
+    case Token::Id::Power: return Opcode::Power;
+    case Token::Id::Equals: return Opcode::Equals;
+    case Token::Id::NotEquals: return Opcode::NotEquals;
+    case Token::Id::Greater: return Opcode::Greater;
+    case Token::Id::GreaterEquals: return Opcode::GreaterEquals;
+    case Token::Id::Less: return Opcode::Less;
+    case Token::Id::LessEquals: return Opcode::LessEquals;
+    case Token::Id::LShift: return Opcode::LShift;
+    default: return Opcode::RShift;
+    }
+}
+
+/**
+ * \brief Get the typed form of a generic Opcode
+ *
+ * \return Opcode::_COUNT if there is none for the Type
+ */
+Opcode Compiler::TypedOpcode(Opcode op, Type type) {
+    TypedForm form;
+    switch (op) {
+    case Opcode::Plus: form = TypedAdd; break;
+    case Opcode::Minus: form = TypedSub; break;
+    case Opcode::Multiply: form = TypedMul; break;
+    case Opcode::Divide: form = TypedDiv; break;
+    case Opcode::Negate: form = TypedNeg; break;
+    case Opcode::Equals: form = TypedEquals; break;
+    case Opcode::NotEquals: form = TypedNotEquals; break;
+    case Opcode::Greater: form = TypedGreater; break;
+    case Opcode::GreaterEquals: form = TypedGreaterEquals; break;
+    case Opcode::Less: form = TypedLess; break;
+    case Opcode::LessEquals: form = TypedLessEquals; break;
+    case Opcode::LShift: form = TypedShl; break;
+    case Opcode::RShift: form = TypedShr; break;
+    default: return Opcode::_COUNT;
+    }
+    return _g_TypedOpcodes[(size_t)type][form];
+}
+
+Opcode Compiler::BoxOpcode(Type type) {
+    return _g_TypedOpcodes[(size_t)type][TypedBox];
+}
+
+Opcode Compiler::UnboxOpcode(Type type) {
+    return _g_TypedOpcodes[(size_t)type][TypedUnbox];
+}
+
+/**
+ * \brief Get the bits of a number literal as a value of a Type
+ *
+ * \return False if the literal does not fit the type: a real with an
+ *     integer type, an integer past the largest of the type or a real past
+ *     the largest float. Also false for Type::Any.
+ */
+bool Compiler::LiteralBits(const Literal & literal, Type type,
+    uint64_t & bits)
+{
+    bits = 0;
+    switch (type) {
+#define TSBL_INTEGER_BITS(name, type) \
+    case Type::name: { \
+        if (literal.real || literal.value.integer \
+            > (uint64_t)std::numeric_limits<type>::max()) \
+        { \
+            return false; \
+        } \
+        type value = (type)literal.value.integer; \
+        std::memcpy(&bits, &value, sizeof(value)); \
+        return true; \
+    }
+#define TSBL_REAL_BITS(name, type) \
+    case Type::name: { \
+        if (literal.real && std::fabs(literal.value.real) \
+            > (double)std::numeric_limits<type>::max()) \
+        { \
+            return false; \
+        } \
+        type value = (literal.real ? (type)literal.value.real \
+            : (type)literal.value.integer); \
+        std::memcpy(&bits, &value, sizeof(value)); \
+        return true; \
+    }
+    TSBL_INTEGER_TYPES(TSBL_INTEGER_BITS)
+    TSBL_REAL_TYPES(TSBL_REAL_BITS)
+#undef TSBL_INTEGER_BITS
+#undef TSBL_REAL_BITS
+    default:
+        return false;
+    }
+}
+
+//===========================================================================
+// Data definitions
+const Opcode _g_TypedOpcodes[][TypedForms] = {
+    // Type::Any
+    {
+        Opcode::_COUNT, Opcode::_COUNT, Opcode::_COUNT, Opcode::_COUNT,
+        Opcode::_COUNT, Opcode::_COUNT, Opcode::_COUNT, Opcode::_COUNT,
+        Opcode::_COUNT, Opcode::_COUNT, Opcode::_COUNT, Opcode::_COUNT,
+        Opcode::_COUNT, Opcode::_COUNT, Opcode::_COUNT
+    },
+#define TSBL_TYPED_ROW(name) \
+        Opcode::Add##name, Opcode::Sub##name, Opcode::Mul##name, \
+        Opcode::Div##name, Opcode::Neg##name, Opcode::Equals##name, \
+        Opcode::NotEquals##name, Opcode::Greater##name, \
+        Opcode::GreaterEquals##name, Opcode::Less##name, \
+        Opcode::LessEquals##name, Opcode::Box##name, Opcode::Unbox##name
+#define TSBL_INTEGER_ROW(name, type) \
+    { TSBL_TYPED_ROW(name), Opcode::Shl##name, Opcode::Shr##name },
+#define TSBL_REAL_ROW(name, type) \
+    { TSBL_TYPED_ROW(name), Opcode::_COUNT, Opcode::_COUNT },
+    TSBL_INTEGER_TYPES(TSBL_INTEGER_ROW)
+    TSBL_REAL_TYPES(TSBL_REAL_ROW)
+#undef TSBL_TYPED_ROW
+#undef TSBL_INTEGER_ROW
+#undef TSBL_REAL_ROW
+};
@@ -0,0 +1,682 @@
+
+#include "tsbl/image.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "tsbl/interpreter.hpp"
+#include "tsbl/token_cache.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace tsbl;
+
+namespace {
+    /**
+     * \brief The start of every Image file
+     *
+     * The sections follow it in this order, each straight after the last:
+     * the constants, the typed constants, the line of every code byte, the
+     * offset of every string, the code and the strings. Largest first keeps
+     * each of them aligned.
+     */
+    struct ImageHeader {
+        char magic[8];            //< _g_ImageMagic
+        uint32_t version;         //< Image::Version
+        uint16_t opcodes;         //< Opcode::_COUNT
+        uint16_t value_size;      //< sizeof(Value)
+        uint64_t hash;            //< TokenCache::Hash() of the sections
+        uint64_t locals;
+        uint64_t constants;
+        uint64_t typed_constants;
+        uint64_t size;            //< Bytes of code, and so lines
+        uint64_t strings;
+        uint64_t strings_size;
+    };
+
+    static_assert(sizeof(ImageHeader) % 8 == 0,
+        "The constants section must stay aligned");
+
+    // What the u16 operands of an instruction index, for verify()
+    enum Operand : uint8_t {
+        None,
+        Local,
+        Constant,
+        Typed,
+        String,
+        Depth   //< Below the top of the stack
+    };
+
+    // The operands of an instruction and what it does to the stack: it
+    // needs pops slots on it and leaves pushes in their place. Generic
+    // opcodes read their slots and locals as Values, typed ones take raw
+    // bits, and either may leave raw bits behind.
+    struct Shape {
+        Operand operands[2];
+        uint8_t pops;
+        uint8_t pushes;
+        bool takes_raw;
+        bool leaves_raw;
+    };
+
+    Shape shape(Opcode op) {
+        switch (op) {
+        case Opcode::Constant:
+            return Shape{ { Operand::Constant, None }, 0, 1, false, false };
+        case Opcode::TypedConstant:
+            return Shape{ { Typed, None }, 0, 1, true, true };
+        case Opcode::String:
+            return Shape{ { Operand::String, None }, 0, 1, false, false };
+        case Opcode::GetLocal:
+            return Shape{ { Local, None }, 0, 1, true, false };
+        case Opcode::GetLocals:
+            return Shape{ { Local, Local }, 0, 2, true, false };
+        case Opcode::Null:
+        case Opcode::True:
+        case Opcode::False:
+            return Shape{ { None, None }, 0, 1, false, false };
+        case Opcode::Pop:
+            return Shape{ { None, None }, 1, 0, true, false };
+        case Opcode::JumpIfFalse:
+            return Shape{ { None, None }, 1, 0, false, false };
+        case Opcode::SetLocal:
+            return Shape{ { Local, None }, 1, 1, true, false };
+        case Opcode::StoreLocal:
+            return Shape{ { Local, None }, 1, 0, true, false };
+        case Opcode::IncrementLocal:
+        case Opcode::DecrementLocal:
+            return Shape{ { Local, None }, 0, 0, false, false };
+        case Opcode::PlusConstant:
+        case Opcode::MinusConstant:
+        case Opcode::MultiplyConstant:
+            return Shape{ { Operand::Constant, None }, 1, 1, false, false };
+        case Opcode::JumpIfNotLessLocals:
+            return Shape{ { Local, Local }, 0, 0, false, false };
+        case Opcode::JumpIfNotLessConstant:
+            return Shape{ { Local, Operand::Constant }, 0, 0, false, false };
+        case Opcode::Negate:
+        case Opcode::Not:
+        case Opcode::Increment:
+        case Opcode::Decrement:
+            return Shape{ { None, None }, 1, 1, false, false };
+        case Opcode::Plus:
+        case Opcode::Minus:
+        case Opcode::Multiply:
+        case Opcode::Divide:
+        case Opcode::Power:
+        case Opcode::Equals:
+        case Opcode::NotEquals:
+        case Opcode::Greater:
+        case Opcode::GreaterEquals:
+        case Opcode::Less:
+        case Opcode::LessEquals:
+        case Opcode::LShift:
+        case Opcode::RShift:
+            return Shape{ { None, None }, 2, 1, false, false };
+#define TSBL_TYPED_SHAPES(name, type) \
+        case Opcode::Add##name: \
+        case Opcode::Sub##name: \
+        case Opcode::Mul##name: \
+        case Opcode::Div##name: \
+            return Shape{ { None, None }, 2, 1, true, true }; \
+        case Opcode::Equals##name: \
+        case Opcode::NotEquals##name: \
+        case Opcode::Greater##name: \
+        case Opcode::GreaterEquals##name: \
+        case Opcode::Less##name: \
+        case Opcode::LessEquals##name: \
+            return Shape{ { None, None }, 2, 1, true, false }; \
+        case Opcode::Neg##name: \
+            return Shape{ { None, None }, 1, 1, true, true }; \
+        case Opcode::Unbox##name: \
+            return Shape{ { None, None }, 1, 1, false, true }; \
+        case Opcode::Box##name: \
+            return Shape{ { Depth, None }, 1, 1, true, false }; \
+        case Opcode::AddConstant##name: \
+        case Opcode::SubConstant##name: \
+        case Opcode::MulConstant##name: \
+            return Shape{ { Typed, None }, 1, 1, true, true }; \
+        case Opcode::JumpIfNotLessLocals##name: \
+            return Shape{ { Local, Local }, 0, 0, true, false }; \
+        case Opcode::JumpIfNotLessConstant##name: \
+            return Shape{ { Local, Typed }, 0, 0, true, false };
+        TSBL_TYPES(TSBL_TYPED_SHAPES)
+#undef TSBL_TYPED_SHAPES
+#define TSBL_SHIFT_SHAPES(name, type) \
+        case Opcode::Shl##name: \
+        case Opcode::Shr##name: \
+            return Shape{ { None, None }, 2, 1, true, true };
+        TSBL_INTEGER_TYPES(TSBL_SHIFT_SHAPES)
+#undef TSBL_SHIFT_SHAPES
+        default:
+            // Jump and Return, which returns the top as a Value
+            return Shape{ { None, None }, 0, 0, false, false };
+        }
+    }
+
+    /**
+     * \brief Whether each slot of a stack holds raw bits or a Value
+     *
+     * A stack is a node on top of the stack below it, so stacks share
+     * their slots and a push or a pop is one step. Equal stacks are always
+     * the same node, so two paths meet with the same kinds of slots if
+     * they meet with the same node.
+     */
+    class SlotKinds {
+    public:
+        static constexpr uint32_t Empty = 0;
+
+        SlotKinds() : m_Nodes(1, Node{ SlotKinds::Empty, false }) { }
+
+        uint32_t push(uint32_t stack, bool raw) {
+            uint64_t key = ((uint64_t)stack << 1) | (uint64_t)raw;
+            auto found = m_Interned.find(key);
+            if (found != m_Interned.end()) {
+                return found->second;
+            }
+            uint32_t node = (uint32_t)m_Nodes.size();
+            m_Nodes.push_back(Node{ stack, raw });
+            m_Interned.emplace(key, node);
+            return node;
+        }
+
+        uint32_t pop(uint32_t stack) const {
+            return m_Nodes[stack].below;
+        }
+
+        bool raw(uint32_t stack) const {
+            return m_Nodes[stack].raw;
+        }
+    private:
+        struct Node {
+            uint32_t below;
+            bool raw;
+        };
+
+        std::vector<Node> m_Nodes;
+        std::unordered_map<uint64_t, uint32_t> m_Interned;
+    };
+
+    /**
+     * \brief Follow every path through code which decodes, once
+     *
+     * The depth of the stack and the kind of each slot on it have to be the
+     * same wherever paths meet, the depth never below what an instruction
+     * takes and no raw bits ever where a Value is read. A local is raw from
+     * the start if anything raw is stored in it anywhere, which sets
+     * changed, as what was read from it before then was taken as a Value.
+     */
+    bool follow(const Program & program, const std::vector<bool> & starts,
+        SlotKinds & kinds, std::vector<bool> & raw_locals, bool & changed)
+    {
+        size_t size = program.size;
+        const uint8_t * code = program.code;
+        bool good = true;
+
+        // The depth above the locals before each instruction, or -1 if no
+        // path has got there yet, and the kinds of the slots
+        std::vector<int64_t> depths(size, -1);
+        std::vector<uint32_t> stacks(size, SlotKinds::Empty);
+        std::vector<size_t> pending(1, 0);
+        depths[0] = 0;
+        while (!pending.empty()) {
+            size_t offset = pending.back();
+            pending.pop_back();
+            Opcode op = (Opcode)code[offset];
+            size_t length = Chunk::Length(op);
+            Shape effect = shape(op);
+            int64_t depth = depths[offset];
+            uint32_t stack = stacks[offset];
+            uint16_t operands[2] = { 0, 0 };
+            for (size_t i = 0; i < 2 && 1 + 2 * (i + 1) <= length; ++i) {
+                std::memcpy(&operands[i], code + offset + 1 + 2 * i, 2);
+            }
+
+            // The Compiler only ever boxes one of the top two
+            size_t pops = effect.pops;
+            if (effect.operands[0] == Depth) {
+                if (operands[0] > 1) {
+                    return false;
+                }
+                pops = (size_t)operands[0] + 1;
+            }
+            if (depth < (int64_t)pops) {
+                return false;
+            }
+            for (size_t i = 0; i < 2; ++i) {
+                if (effect.operands[i] == Local && !effect.takes_raw
+                    && raw_locals[operands[i]])
+                {
+                    return false;
+                }
+            }
+
+            switch (op) {
+            case Opcode::GetLocal:
+                stack = kinds.push(stack, raw_locals[operands[0]]);
+                break;
+            case Opcode::GetLocals:
+                stack = kinds.push(stack, raw_locals[operands[0]]);
+                stack = kinds.push(stack, raw_locals[operands[1]]);
+                break;
+            case Opcode::SetLocal:
+            case Opcode::StoreLocal:
+                if (kinds.raw(stack) && !raw_locals[operands[0]]) {
+                    raw_locals[operands[0]] = true;
+                    changed = true;
+                }
+                if (op == Opcode::StoreLocal) {
+                    stack = kinds.pop(stack);
+                }
+                break;
+            case Opcode::Return:
+                if (depth > 0 && kinds.raw(stack)) {
+                    return false;
+                }
+                break;
+            default:
+                if (effect.operands[0] == Depth) {
+                    bool top = kinds.raw(stack);
+                    stack = kinds.pop(stack);
+                    if (pops == 2) {
+                        stack = kinds.push(kinds.pop(stack), false);
+                    }
+                    stack = kinds.push(stack, top && pops == 2);
+                    break;
+                }
+                for (size_t i = 0; i < pops; ++i) {
+                    if (kinds.raw(stack) && !effect.takes_raw) {
+                        return false;
+                    }
+                    stack = kinds.pop(stack);
+                }
+                for (size_t i = 0; i < effect.pushes; ++i) {
+                    stack = kinds.push(stack, effect.leaves_raw);
+                }
+                break;
+            }
+            if (effect.operands[0] != Depth) {
+                depth += (int64_t)effect.pushes - (int64_t)effect.pops;
+            }
+
+            size_t next[2];
+            size_t count = 0;
+            if (op != Opcode::Return && op != Opcode::Jump) {
+                next[count++] = offset + length;
+            }
+            if (Chunk::IsJump(op)) {
+                int32_t jump;
+                std::memcpy(&jump, code + offset + length - 4, sizeof(jump));
+                next[count++] = (size_t)((int64_t)(offset + length) + jump);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                if (next[i] >= size || !starts[next[i]]) {
+                    return false;
+                }
+                if (depths[next[i]] < 0) {
+                    depths[next[i]] = depth;
+                    stacks[next[i]] = stack;
+                    pending.push_back(next[i]);
+                }
+                else if (depths[next[i]] != depth
+                    || stacks[next[i]] != stack)
+                {
+                    // A local turning raw later on may yet make them agree
+                    good = false;
+                }
+            }
+        }
+        return good;
+    }
+
+    /**
+     * \brief Check the code of a Program can be run without reading or
+     * writing anything outside of it
+     *
+     * The Interpreter trusts what the Compiler gives it, so an Image has to
+     * hold code the Compiler could have given. Every instruction has to be
+     * whole, every index has to be in its section and every jump has to
+     * land on an instruction. Raw bits are never read as a Value, where
+     * they could pass for a string at any address, so they have to be
+     * boxed before a generic opcode or Return takes them. Paths are
+     * followed again until the locals which hold raw bits stop changing.
+     */
+    bool verify(const ImageHeader & header, const Program & program) {
+        size_t size = program.size;
+        const uint8_t * code = program.code;
+        std::vector<bool> starts(size, false);
+        size_t last = 0;
+        for (size_t offset = 0; offset < size;) {
+            Opcode op = (Opcode)code[offset];
+            size_t length = Chunk::Length(op);
+            if (op >= Opcode::_COUNT || length > size - offset) {
+                return false;
+            }
+            Shape kinds = shape(op);
+            for (size_t i = 0; i < 2; ++i) {
+                if (1 + 2 * (i + 1) > length) {
+                    break;
+                }
+                uint16_t index;
+                std::memcpy(&index, code + offset + 1 + 2 * i, 2);
+                if ((kinds.operands[i] == Local
+                        && index >= program.locals)
+                    || (kinds.operands[i] == Operand::Constant
+                        && index >= header.constants)
+                    || (kinds.operands[i] == Typed
+                        && index >= header.typed_constants)
+                    || (kinds.operands[i] == Operand::String
+                        && index >= header.strings))
+                {
+                    return false;
+                }
+            }
+            starts[offset] = true;
+            last = offset;
+            offset += length;
+        }
+        if ((Opcode)code[last] != Opcode::Return) {
+            return false;
+        }
+
+        // Each pass which changes a local adds one, so this ends
+        SlotKinds kinds;
+        std::vector<bool> raw_locals(program.locals, false);
+        for (;;) {
+            bool changed = false;
+            bool good = follow(program, starts, kinds, raw_locals, changed);
+            if (!changed) {
+                return good;
+            }
+        }
+    }
+}
+
+extern const char _g_ImageMagic[8];
+
+Image::Image() :
+    m_Mapped(nullptr), m_MappedSize(0), m_Mapping(nullptr), m_Program()
+{ }
+
+Image::~Image() {
+    close();
+}
+
+/**
+ * \brief Map an Image file and check it can be run
+ *
+ * Every page is read once, to check the hash and verify the code, but none
+ * is written, so they stay shared with the file and with any other process
+ * which maps it.
+ *
+ * \return False if the file is missing or is not an Image this build can
+ *     run. Otherwise program() points into it until close().
+ */
+bool Image::load(const char * filename) {
+    close();
+    if (!map(filename)) {
+        return false;
+    }
+
+    ImageHeader header;
+    if (m_MappedSize < sizeof(header)) {
+        close();
+        return false;
+    }
+    std::memcpy(&header, m_Mapped, sizeof(header));
+    if (std::memcmp(header.magic, _g_ImageMagic, sizeof(header.magic)) != 0
+        || header.version != Image::Version
+        || header.opcodes != (uint16_t)Opcode::_COUNT
+        || header.value_size != sizeof(Value)
+        || header.constants > m_MappedSize
+        || header.typed_constants > m_MappedSize
+        || header.size > m_MappedSize || header.strings > m_MappedSize
+        || header.size == 0
+        || header.locals > Interpreter::DefaultStackSize)
+    {
+        close();
+        return false;
+    }
+
+    // Every section has to fit exactly, a short file is a damaged one
+    size_t offset = sizeof(header);
+    size_t constants = offset;
+    offset += (size_t)header.constants * sizeof(Value);
+    size_t typed_constants = offset;
+    offset += (size_t)header.typed_constants * sizeof(uint64_t);
+    size_t lines = offset;
+    offset += (size_t)header.size * sizeof(uint32_t);
+    size_t string_offsets = offset;
+    offset += (size_t)header.strings * sizeof(uint32_t);
+    size_t code = offset;
+    offset += (size_t)header.size;
+    if (offset > m_MappedSize
+        || header.strings_size != m_MappedSize - offset
+        || header.hash != TokenCache::Hash(m_Mapped + sizeof(header),
+            m_MappedSize - sizeof(header)))
+    {
+        close();
+        return false;
+    }
+
+    m_Program.code = m_Mapped + code;
+    m_Program.size = (size_t)header.size;
+    m_Program.lines = (const uint32_t *)(m_Mapped + lines);
+    m_Program.constants = (const Value *)(m_Mapped + constants);
+    m_Program.typed_constants = (const uint64_t *)(m_Mapped
+        + typed_constants);
+    m_Program.string_offsets = (const uint32_t *)(m_Mapped
+        + string_offsets);
+    m_Program.strings = (const char *)(m_Mapped + offset);
+    m_Program.locals = (size_t)header.locals;
+    if (!verify(header, m_Program)) {
+        close();
+        return false;
+    }
+
+    // The Compiler only makes constants of numbers, and the hash does not
+    // stop anyone writing a string at any address into the file
+    for (size_t i = 0; i < (size_t)header.constants; ++i) {
+        const Value & constant = m_Program.constants[i];
+        if (!constant.is_number() && !constant.is_null()
+            && !constant.is_bool())
+        {
+            close();
+            return false;
+        }
+    }
+
+    // A string has to end before the section does
+    size_t strings_size = (size_t)header.strings_size;
+    for (size_t i = 0; i < (size_t)header.strings; ++i) {
+        uint32_t start = m_Program.string_offsets[i];
+        uint32_t length;
+        if (start > strings_size
+            || strings_size - start < sizeof(length) + 1)
+        {
+            close();
+            return false;
+        }
+        std::memcpy(&length, m_Program.strings + start, sizeof(length));
+        if (length > strings_size - start - sizeof(length) - 1) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Unmap the loaded file, if any
+ *
+ * Values the Interpreter returned which are strings point into it, so
+ * they are no good after this.
+ */
+void Image::close() {
+    if (m_Mapped != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile((LPCVOID)m_Mapped);
+        CloseHandle((HANDLE)m_Mapping);
+#else
+        munmap((void *)m_Mapped, m_MappedSize);
+#endif
+    }
+    m_Mapped = nullptr;
+    m_MappedSize = 0;
+    m_Mapping = nullptr;
+    m_Program = Program();
+}
+
+bool Image::loaded() const {
+    return m_Mapped != nullptr;
+}
+
+/**
+ * \brief Get the code and constants in the mapping, for Interpreter::run()
+ */
+const Program & Image::program() const {
+    return m_Program;
+}
+
+/**
+ * \brief Write a Chunk out as an Image file
+ *
+ * The file is written whole under a temporary name and then renamed over
+ * the old one, so a process still running the old one keeps its pages and
+ * none ever maps half a file.
+ *
+ * \param chunk The code to store, optimized or not
+ * \param filename Where to write it
+ * \return False if the file could not be written
+ */
+bool Image::Store(const Chunk & chunk, const char * filename) {
+    Program program = chunk.program();
+    if (program.size == 0) {
+        return false;
+    }
+    size_t strings = chunk.strings();
+    size_t strings_size = 0;
+    if (strings > 0) {
+        // Strings are added in order, each with a u32 length and a NUL
+        strings_size = program.string_offsets[strings - 1]
+            + sizeof(uint32_t) + chunk.string(strings - 1).size() + 1;
+    }
+
+    ImageHeader header;
+    std::memcpy(header.magic, _g_ImageMagic, sizeof(header.magic));
+    header.version = Image::Version;
+    header.opcodes = (uint16_t)Opcode::_COUNT;
+    header.value_size = (uint16_t)sizeof(Value);
+    header.hash = 0;
+    header.locals = program.locals;
+    header.constants = chunk.constants();
+    header.typed_constants = chunk.typed_constants();
+    header.size = program.size;
+    header.strings = strings;
+    header.strings_size = strings_size;
+
+    // The sections are laid out in one buffer to be hashed
+    std::string body;
+    body.append((const char *)program.constants,
+        chunk.constants() * sizeof(Value));
+    body.append((const char *)program.typed_constants,
+        chunk.typed_constants() * sizeof(uint64_t));
+    body.append((const char *)program.lines,
+        program.size * sizeof(uint32_t));
+    body.append((const char *)program.string_offsets,
+        strings * sizeof(uint32_t));
+    body.append((const char *)program.code, program.size);
+    body.append(program.strings, strings_size);
+    header.hash = TokenCache::Hash((const uint8_t *)body.data(),
+        body.size());
+
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = (int)getpid();
+#endif
+    std::string temporary = std::string(filename) + "."
+        + std::to_string(pid) + ".tmp";
+    std::FILE * file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool good = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(body.data(), 1, body.size(), file) == body.size();
+    good = (std::fclose(file) == 0) && good;
+
+    if (good && std::rename(temporary.c_str(), filename) != 0) {
+        std::remove(filename);
+        good = (std::rename(temporary.c_str(), filename) == 0);
+    }
+    if (!good) {
+        std::remove(temporary.c_str());
+    }
+    return good;
+}
+
+/**
+ * \brief Map a whole file read only
+ *
+ * \return False if it is not there or is empty
+ */
+bool Image::map(const char * filename) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0,
+            0, nullptr);
+        if (mapping != nullptr) {
+            m_Mapped = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ,
+                0, 0, 0);
+            if (m_Mapped != nullptr) {
+                m_Mapping = (void *)mapping;
+                m_MappedSize = (size_t)size.QuadPart;
+            }
+            else {
+                CloseHandle(mapping);
+            }
+        }
+    }
+    // The mapping keeps its own reference to the file
+    CloseHandle(file);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void * addr = mmap(nullptr, (size_t)info.st_size, PROT_READ,
+            MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            m_Mapped = (const uint8_t *)addr;
+            m_MappedSize = (size_t)info.st_size;
+        }
+    }
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+#endif
+    return m_Mapped != nullptr;
+}
+
+//===========================================================================
+// Data definitions
+const char _g_ImageMagic[8] = { 't', 's', 'b', 'l', 'i', 'm', 'g', '\0' };
@@ -0,0 +1,280 @@
+
+#include "tsbl/incremental_lexer.hpp"
+
+#include <algorithm>
+
+using namespace tsbl;
+
+//< The furthest the Lexer looks past the end of a Token, one UTF-8 sequence
+static const size_t _g_Lookahead = 4;
+
+IncrementalLexer::IncrementalLexer() :
+    m_Gap(0), m_GapEnd(0), m_Bytes(0)
+{ }
+
+/**
+ * \brief Create an IncrementalLexer whose Lexer allocates from an Arena
+ */
+IncrementalLexer::IncrementalLexer(Arena & arena) :
+    m_Lexer(arena), m_Gap(0), m_GapEnd(0), m_Bytes(0)
+{ }
+
+IncrementalLexer::~IncrementalLexer() { }
+
+/**
+ * \brief Replace the whole text and lex all of it
+ *
+ * The data is copied, so it does not need to outlive the call. The symbols
+ * and string text of the old Tokens are dropped, and the Lexer reuses
+ * their memory.
+ *
+ * \return False if the text is larger than Lexer::MaxSize, when nothing
+ *     changes
+ */
+bool IncrementalLexer::read(const uint8_t * data, size_t size) {
+    if (size > Lexer::MaxSize) {
+        return false;
+    }
+    m_Text.assign((const char *)data, size);
+    m_Tokens.clear();
+    m_States.clear();
+    m_Lexer.reset();
+    m_Lexer.read((const uint8_t *)m_Text.data(), m_Text.size());
+    for (;;) {
+        Token token = m_Lexer.next();
+        m_Tokens.push_back(token);
+        m_States.push_back(m_Lexer.state());
+        if (stop(token)) {
+            break;
+        }
+    }
+    m_Gap = m_GapEnd = m_Tokens.size();
+    m_Bytes = 0;
+    return true;
+}
+
+/**
+ * \brief Replace part of the text and bring the Tokens up to date
+ *
+ * Lexing restarts after the last Token which could not have seen the edit,
+ * and goes on until a new Token ends where an old Token after the edit
+ * ended. From there the old Tokens would come out again, so they are kept,
+ * only moved by the bytes the edit added. The Tokens are then
+ * exactly those lexing the new text from the start would give.
+ *
+ * Text of strings with escapes is added to the Lexer again each time they
+ * are re-lexed, so read() should be called now and then to drop it. An
+ * edit which would make the text larger than Lexer::MaxSize is not made,
+ * and replaces no Tokens.
+ *
+ * \param offset The byte offset of the edit
+ * \param removed The number of bytes removed at offset
+ * \param data The UTF-8 text inserted at offset
+ * \param size The number of bytes inserted
+ * \return The Tokens which were replaced
+ */
+IncrementalLexer::Change IncrementalLexer::edit(size_t offset,
+    size_t removed, const uint8_t * data, size_t size)
+{
+    offset = std::min(offset, m_Text.size());
+    removed = std::min(removed, m_Text.size() - offset);
+    if (size > Lexer::MaxSize - (m_Text.size() - removed)) {
+        return Change{ find(offset), 0, 0 };
+    }
+    m_Text.replace(offset, removed, (const char *)data, size);
+    m_Lexer.read((const uint8_t *)m_Text.data(), m_Text.size());
+
+    size_t count = this->size();
+    size_t first = find(offset);
+    if (first == count) {
+        // Lexing stopped before the edit, so only the last Token can change
+        first -= 1;
+    }
+    move_gap(first);
+    if (first > 0) {
+        m_Lexer.restore(m_States[first - 1]);
+    }
+
+    // Old Tokens ending past this offset are followed by unchanged text
+    size_t edit_end = offset + size;
+    ptrdiff_t delta = (ptrdiff_t)size - (ptrdiff_t)removed;
+    size_t old = first;
+    size_t last = count;  //< Replaced up to here, exclusive
+    m_NewTokens.clear();
+    m_NewStates.clear();
+    for (;;) {
+        Token lexed = m_Lexer.next();
+        Lexer::State after = m_Lexer.state();
+        m_NewTokens.push_back(lexed);
+        m_NewStates.push_back(after);
+        if (stop(lexed)) {
+            break;
+        }
+        if (after.index < edit_end) {
+            continue;
+        }
+
+        size_t target = (size_t)((ptrdiff_t)after.index - delta);
+        while (old < count && state(old).index < target) {
+            old += 1;
+        }
+        // The last Token can stay on its first byte, lexing carries on from
+        // there so it is never met
+        if (old < count && state(old).index == target
+            && !stop(token(old)))
+        {
+            last = old + 1;
+            break;
+        }
+    }
+
+    // The gap is at first, so the replaced Tokens are the first after it
+    m_GapEnd += last - first;
+    m_Bytes = (last < count ? m_Bytes + delta : 0);
+
+    reserve_gap(m_NewTokens.size());
+    std::copy(m_NewTokens.begin(), m_NewTokens.end(),
+        m_Tokens.begin() + m_Gap);
+    std::copy(m_NewStates.begin(), m_NewStates.end(),
+        m_States.begin() + m_Gap);
+    m_Gap += m_NewTokens.size();
+    return Change{ first, last - first, m_NewTokens.size() };
+}
+
+/**
+ * \brief Get the number of Tokens, including the last EndOfFile
+ */
+size_t IncrementalLexer::size() const {
+    return m_Tokens.size() - (m_GapEnd - m_Gap);
+}
+
+/**
+ * \brief Get a Token, where it is in the current text
+ */
+Token IncrementalLexer::token(size_t index) const {
+    if (index < m_Gap) {
+        return m_Tokens[index];
+    }
+    return moved(m_Tokens[index + (m_GapEnd - m_Gap)], m_Bytes);
+}
+
+/**
+ * \brief Get the Lexer::State after a Token
+ */
+Lexer::State IncrementalLexer::state(size_t index) const {
+    if (index < m_Gap) {
+        return m_States[index];
+    }
+    return moved(m_States[index + (m_GapEnd - m_Gap)], m_Bytes);
+}
+
+/**
+ * \brief Get the current text, which the Tokens refer to
+ */
+std::string_view IncrementalLexer::text() const {
+    return std::string_view(m_Text);
+}
+
+/**
+ * \brief Get the Lexer, for string(), number() and symbols() of the Tokens
+ */
+Lexer & IncrementalLexer::lexer() {
+    return m_Lexer;
+}
+
+const Lexer & IncrementalLexer::lexer() const {
+    return m_Lexer;
+}
+
+/**
+ * \brief Find the first Token the Lexer may have looked past offset for
+ */
+size_t IncrementalLexer::find(size_t offset) const {
+    size_t low = 0, high = size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (state(middle).index + _g_Lookahead <= offset) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * \brief Move the gap to just before a Token
+ *
+ * Each Token crossing the gap is moved on or back, so this costs the
+ * distance from the last edit.
+ */
+void IncrementalLexer::move_gap(size_t index) {
+    while (m_Gap > index) {
+        m_Gap -= 1;
+        m_GapEnd -= 1;
+        m_Tokens[m_GapEnd] = moved(m_Tokens[m_Gap], -m_Bytes);
+        m_States[m_GapEnd] = moved(m_States[m_Gap], -m_Bytes);
+    }
+    while (m_Gap < index) {
+        m_Tokens[m_Gap] = moved(m_Tokens[m_GapEnd], m_Bytes);
+        m_States[m_Gap] = moved(m_States[m_GapEnd], m_Bytes);
+        m_Gap += 1;
+        m_GapEnd += 1;
+    }
+}
+
+/**
+ * \brief Make the gap hold at least count Tokens
+ *
+ * The arrays at least double when they grow, so inserting is amortized
+ * O(1) per Token.
+ */
+void IncrementalLexer::reserve_gap(size_t count) {
+    if (m_GapEnd - m_Gap >= count) {
+        return;
+    }
+    size_t after = m_Tokens.size() - m_GapEnd;
+    size_t capacity = std::max(m_Tokens.size() * 2, size() + count + 64);
+    m_Tokens.resize(capacity);
+    m_States.resize(capacity);
+    std::move_backward(m_Tokens.begin() + m_GapEnd,
+        m_Tokens.begin() + m_GapEnd + after, m_Tokens.end());
+    std::move_backward(m_States.begin() + m_GapEnd,
+        m_States.begin() + m_GapEnd + after, m_States.end());
+    m_GapEnd = capacity - after;
+}
+
+/**
+ * \brief Move a Token by some bytes
+ *
+ * Tokens after the gap may hold offsets below zero, which wrap around and
+ * come back once moved on.
+ */
+Token IncrementalLexer::moved(const Token & token, ptrdiff_t bytes) {
+    Token::Id id = token.id();
+    Token::Value value = token.value();
+    if ((Token::IsString(id) || Token::IsNumeric(id))
+        && !value.span.materialized())
+    {
+        value.span.offset = (uint32_t)(value.span.offset + (size_t)bytes);
+    }
+    return Token(id, (uint32_t)(token.offset() + (size_t)bytes), value);
+}
+
+/**
+ * \brief Move a Lexer::State by some bytes
+ */
+Lexer::State IncrementalLexer::moved(const Lexer::State & state,
+    ptrdiff_t bytes)
+{
+    return Lexer::State{ state.index + (size_t)bytes };
+}
+
+/**
+ * \brief Check if a Token is the last one lexing gives
+ */
+bool IncrementalLexer::stop(const Token & token) {
+    return (token.id() == Token::Id::EndOfFile
+        || token.id() == Token::Id::BadEncoding);
+}
@@ -1,8 +1,748 @@
 
 #include "tsbl/interpreter.hpp"
 
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+// Dispatch with a table of label addresses where the compiler has them, so
+// each instruction ends in its own indirect jump. Build with
+// TSBL_COMPUTED_GOTO=0 to use the portable switch loop instead.
+#ifndef TSBL_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define TSBL_COMPUTED_GOTO 1
+#else
+#define TSBL_COMPUTED_GOTO 0
+#endif
+#endif
+
 using namespace tsbl;
 
-Interpreter::Interpreter() { }
+static const char * _g_StatusNames[] = {
+    "Ok", "TypeError", "DivideByZero", "StackOverflow", "BadCode"
+};
+
+const size_t Interpreter::DefaultStackSize;
+
+namespace {
+    inline uint16_t read_u16(const uint8_t * ip) {
+        uint16_t value;
+        std::memcpy(&value, ip, sizeof(value));
+        return value;
+    }
+
+    inline int32_t read_i32(const uint8_t * ip) {
+        int32_t value;
+        std::memcpy(&value, ip, sizeof(value));
+        return value;
+    }
+
+    // Int arithmetic wraps around instead of overflowing, and
+    // Value::FromInt() then keeps the low 48 bits
+    inline int64_t wrap_add(int64_t left, int64_t right) {
+        return (int64_t)((uint64_t)left + (uint64_t)right);
+    }
+
+    inline int64_t wrap_sub(int64_t left, int64_t right) {
+        return (int64_t)((uint64_t)left - (uint64_t)right);
+    }
+
+    inline int64_t wrap_mul(int64_t left, int64_t right) {
+        return (int64_t)((uint64_t)left * (uint64_t)right);
+    }
+
+    inline int64_t wrap_div(int64_t left, int64_t right) {
+        return (right == -1 ? wrap_sub(0, left) : left / right);
+    }
+
+    int64_t int_power(int64_t base, int64_t exponent) {
+        uint64_t result = 1, factor = (uint64_t)base;
+        while (exponent > 0) {
+            if (exponent & 1) {
+                result *= factor;
+            }
+            factor *= factor;
+            exponent >>= 1;
+        }
+        return (int64_t)result;
+    }
+
+    // Typed values sit raw in the first bytes of a stack slot
+    template<typename T>
+    inline T load(const void * slot) {
+        T value;
+        std::memcpy(&value, slot, sizeof(value));
+        return value;
+    }
+
+    template<typename T>
+    inline void store(Value * slot, T value) {
+        std::memcpy((void *)slot, &value, sizeof(value));
+    }
+
+    // Integer types wrap around at their width, through unsigned
+    // arithmetic to keep clear of signed overflow
+    template<typename T>
+    inline T typed_add(T left, T right) {
+        if constexpr (std::is_integral<T>::value) {
+            return (T)((uint64_t)left + (uint64_t)right);
+        }
+        else {
+            return left + right;
+        }
+    }
+
+    template<typename T>
+    inline T typed_sub(T left, T right) {
+        if constexpr (std::is_integral<T>::value) {
+            return (T)((uint64_t)left - (uint64_t)right);
+        }
+        else {
+            return left - right;
+        }
+    }
+
+    template<typename T>
+    inline T typed_mul(T left, T right) {
+        if constexpr (std::is_integral<T>::value) {
+            return (T)((uint64_t)left * (uint64_t)right);
+        }
+        else {
+            return left * right;
+        }
+    }
+
+    // The divisor of an integer type is checked for 0 before this
+    template<typename T>
+    inline T typed_div(T left, T right) {
+        if constexpr (std::is_integral<T>::value
+            && std::is_signed<T>::value)
+        {
+            return (T)wrap_div(left, right);
+        }
+        else {
+            return left / right;
+        }
+    }
+
+    template<typename T>
+    inline bool divides_by_zero(T right) {
+        if constexpr (std::is_integral<T>::value) {
+            return right == 0;
+        }
+        else {
+            return false;
+        }
+    }
+
+    // Shifts by the amount modulo the width of the type
+    template<typename T>
+    inline T typed_shl(T left, T right) {
+        return (T)((uint64_t)left << ((uint64_t)right & (sizeof(T) * 8 - 1)));
+    }
+
+    template<typename T>
+    inline T typed_shr(T left, T right) {
+        return (T)(left >> ((uint64_t)right & (sizeof(T) * 8 - 1)));
+    }
+
+    // Ints which do not fit in the 48 bits of a Value become reals
+    template<typename T>
+    inline Value box(T value) {
+        if constexpr (std::is_integral<T>::value
+            && std::is_signed<T>::value)
+        {
+            if ((int64_t)value >= Value::MinInt
+                && (int64_t)value <= Value::MaxInt)
+            {
+                return Value::FromInt((int64_t)value);
+            }
+        }
+        else if constexpr (std::is_integral<T>::value) {
+            if ((uint64_t)value <= (uint64_t)Value::MaxInt) {
+                return Value::FromInt((int64_t)value);
+            }
+        }
+        return Value::FromReal((double)value);
+    }
+
+    // Integer types take ints and reals which hold an integer in their
+    // range, the same as a literal given to the Compiler. Real types take
+    // any number.
+    template<typename T>
+    inline bool unbox(const Value & value, T & result) {
+        if constexpr (std::is_integral<T>::value) {
+            if (value.is_int()) {
+                int64_t integer = value.as_int();
+                if (integer < 0 ?
+                    integer < (int64_t)std::numeric_limits<T>::min()
+                    : (uint64_t)integer
+                        > (uint64_t)std::numeric_limits<T>::max())
+                {
+                    return false;
+                }
+                result = (T)integer;
+                return true;
+            }
+            // 2 * (max / 2 + 1) is max + 1, and exact as a double
+            double real = value.as_real();
+            if (!value.is_real() || real != std::trunc(real)
+                || !(real >= (double)std::numeric_limits<T>::min())
+                || !(real < 2.0 * (double)(std::numeric_limits<T>::max() / 2
+                    + 1)))
+            {
+                return false;
+            }
+            result = (T)real;
+            return true;
+        }
+        else {
+            if (!value.is_number()) {
+                return false;
+            }
+            result = (T)value.as_number();
+            return true;
+        }
+    }
+
+    // -1, 0 or 1 for two Values which can be ordered, 2 if they can not
+    inline int compare(const Value & left, const Value & right) {
+        if (left.is_int() && right.is_int()) {
+            return (left.as_int() > right.as_int())
+                - (left.as_int() < right.as_int());
+        }
+        if (left.is_number() && right.is_number()) {
+            double a = left.as_number(), b = right.as_number();
+            return (a > b) - (a < b);
+        }
+        if (left.is_string() && right.is_string()) {
+            int result = left.as_string().compare(right.as_string());
+            return (result > 0) - (result < 0);
+        }
+        return 2;
+    }
+}
+
+Interpreter::Interpreter() :
+    Interpreter(Interpreter::DefaultStackSize)
+{ }
+
+/**
+ * \brief Create an Interpreter with a stack of a number of Values
+ *
+ * The stack is allocated once here and never grows.
+ */
+Interpreter::Interpreter(size_t stack_size) :
+    m_Stack(stack_size), m_ErrorLine(0)
+{ }
+
 Interpreter::~Interpreter() { }
 
+/**
+ * \brief Run a Chunk until it returns or fails
+ *
+ * \param chunk The code to run, which must end in Opcode::Return
+ * \return See run(const Program &)
+ */
+Interpreter::Status Interpreter::run(const Chunk & chunk) {
+    return run(chunk.program());
+}
+
+/**
+ * \brief Run the code of a Chunk or a mapped Image until it returns or fails
+ *
+ * Ints wrap around at 48 bits on overflow and shift by their amount modulo
+ * 64. An int mixed with a real is treated as a real.
+ *
+ * \param program The code to run, which must end in Opcode::Return
+ * \return Interpreter::Ok with the returned Value in result(), or the error
+ *     which stopped it with the line in error_line()
+ */
+Interpreter::Status Interpreter::run(const Program & program) {
+    const uint8_t * code = program.code;
+    const uint8_t * ip = code;
+    const Value * constants = program.constants;
+    const uint64_t * typed_constants = program.typed_constants;
+    const uint32_t * string_offsets = program.string_offsets;
+    const char * strings = program.strings;
+    Value * stack = m_Stack.data();
+    Value * limit = stack + m_Stack.size();
+    Value * top = stack + program.locals;  //< The next free slot
+    Interpreter::Status status = Interpreter::Ok;
+
+    m_Result = Value();
+    m_ErrorLine = 0;
+    if (top > limit) {
+        return Interpreter::StackOverflow;
+    }
+    for (Value * local = stack; local < top; ++local) {
+        *local = Value();
+    }
+
+#define TSBL_PUSH(value) \
+    do { \
+        if (top == limit) { \
+            goto stack_overflow; \
+        } \
+        *top++ = (value); \
+    } while (0)
+
+// Ints stay ints, anything else with a real becomes a real. The result
+// replaces the left operand.
+#define TSBL_ARITHMETIC_ON(left_value, right_value, int_op, real_op) \
+    do { \
+        Value & left = (left_value); \
+        const Value & right = (right_value); \
+        if (left.is_int() && right.is_int()) { \
+            left = Value::FromInt(int_op(left.as_int(), right.as_int())); \
+        } \
+        else if (left.is_real() && right.is_real()) { \
+            left = Value::FromReal(left.as_real() real_op right.as_real()); \
+        } \
+        else if (left.is_number() && right.is_number()) { \
+            left = Value::FromReal(left.as_number() real_op \
+                right.as_number()); \
+        } \
+        else { \
+            goto type_error; \
+        } \
+    } while (0)
+
+#define TSBL_ARITHMETIC(int_op, real_op) \
+    do { \
+        TSBL_ARITHMETIC_ON(top[-2], top[-1], int_op, real_op); \
+        top -= 1; \
+    } while (0)
+
+#define TSBL_STEP(value, int_step, real_step) \
+    do { \
+        Value & stepped = (value); \
+        if (stepped.is_int()) { \
+            stepped = Value::FromInt(wrap_add(stepped.as_int(), int_step)); \
+        } \
+        else if (stepped.is_real()) { \
+            stepped = Value::FromReal(stepped.as_real() + real_step); \
+        } \
+        else { \
+            goto type_error; \
+        } \
+    } while (0)
+
+// The jump offset of a superinstruction follows its two u16 operands
+#define TSBL_JUMP_UNLESS(condition) \
+    do { \
+        bool taken = !(condition); \
+        int32_t offset = read_i32(ip + 4); \
+        ip += 8; \
+        if (taken) { \
+            ip += offset; \
+        } \
+    } while (0)
+
+#define TSBL_COMPARE(op) \
+    do { \
+        int order = compare(top[-2], top[-1]); \
+        if (order == 2) { \
+            goto type_error; \
+        } \
+        top[-2] = Value::FromBool(order op 0); \
+        top -= 1; \
+    } while (0)
+
+// Typed operands are raw, of the same C type, and never fail a type check
+#define TSBL_TYPED_BINARY(type, fn) \
+    do { \
+        store<type>(top - 2, fn(load<type>(top - 2), load<type>(top - 1))); \
+        top -= 1; \
+    } while (0)
+
+#define TSBL_TYPED_COMPARE(type, op) \
+    do { \
+        top[-2] = Value::FromBool(load<type>(top - 2) op \
+            load<type>(top - 1)); \
+        top -= 1; \
+    } while (0)
+
+#define TSBL_TYPED_CASES(T, type) \
+    TSBL_CASE(Add##T): \
+        TSBL_TYPED_BINARY(type, typed_add); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Sub##T): \
+        TSBL_TYPED_BINARY(type, typed_sub); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Mul##T): \
+        TSBL_TYPED_BINARY(type, typed_mul); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Div##T): \
+        if (divides_by_zero(load<type>(top - 1))) { \
+            goto divide_by_zero; \
+        } \
+        TSBL_TYPED_BINARY(type, typed_div); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Neg##T): \
+        store<type>(top - 1, typed_sub((type)0, load<type>(top - 1))); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Equals##T): \
+        TSBL_TYPED_COMPARE(type, ==); \
+        TSBL_NEXT(); \
+    TSBL_CASE(NotEquals##T): \
+        TSBL_TYPED_COMPARE(type, !=); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Greater##T): \
+        TSBL_TYPED_COMPARE(type, >); \
+        TSBL_NEXT(); \
+    TSBL_CASE(GreaterEquals##T): \
+        TSBL_TYPED_COMPARE(type, >=); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Less##T): \
+        TSBL_TYPED_COMPARE(type, <); \
+        TSBL_NEXT(); \
+    TSBL_CASE(LessEquals##T): \
+        TSBL_TYPED_COMPARE(type, <=); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Box##T): { \
+        Value * slot = top - 1 - read_u16(ip); \
+        *slot = box(load<type>(slot)); \
+        ip += 2; \
+        TSBL_NEXT(); \
+    } \
+    TSBL_CASE(Unbox##T): { \
+        type value; \
+        if (!unbox(top[-1], value)) { \
+            goto type_error; \
+        } \
+        store<type>(top - 1, value); \
+        TSBL_NEXT(); \
+    } \
+    TSBL_CASE(AddConstant##T): \
+        store<type>(top - 1, typed_add(load<type>(top - 1), \
+            load<type>(typed_constants + read_u16(ip)))); \
+        ip += 2; \
+        TSBL_NEXT(); \
+    TSBL_CASE(SubConstant##T): \
+        store<type>(top - 1, typed_sub(load<type>(top - 1), \
+            load<type>(typed_constants + read_u16(ip)))); \
+        ip += 2; \
+        TSBL_NEXT(); \
+    TSBL_CASE(MulConstant##T): \
+        store<type>(top - 1, typed_mul(load<type>(top - 1), \
+            load<type>(typed_constants + read_u16(ip)))); \
+        ip += 2; \
+        TSBL_NEXT(); \
+    TSBL_CASE(JumpIfNotLessLocals##T): \
+        TSBL_JUMP_UNLESS(load<type>(stack + read_u16(ip)) \
+            < load<type>(stack + read_u16(ip + 2))); \
+        TSBL_NEXT(); \
+    TSBL_CASE(JumpIfNotLessConstant##T): \
+        TSBL_JUMP_UNLESS(load<type>(stack + read_u16(ip)) \
+            < load<type>(typed_constants + read_u16(ip + 2))); \
+        TSBL_NEXT();
+
+#define TSBL_SHIFT_CASES(T, type) \
+    TSBL_CASE(Shl##T): \
+        TSBL_TYPED_BINARY(type, typed_shl); \
+        TSBL_NEXT(); \
+    TSBL_CASE(Shr##T): \
+        TSBL_TYPED_BINARY(type, typed_shr); \
+        TSBL_NEXT();
+
+#if TSBL_COMPUTED_GOTO
+    void * labels[256];
+    for (size_t i = 0; i < 256; ++i) {
+        labels[i] = &&bad_code;
+    }
+#define TSBL_OPCODE_LABEL(name, operands) \
+    labels[(size_t)Opcode::name] = &&op_##name;
+    TSBL_OPCODES(TSBL_OPCODE_LABEL)
+#undef TSBL_OPCODE_LABEL
+
+#define TSBL_CASE(name) op_##name
+#define TSBL_NEXT() goto *labels[*ip++]
+    TSBL_NEXT();
+    {
+#else
+#define TSBL_CASE(name) case Opcode::name
+#define TSBL_NEXT() continue
+    for (;;) {
+        switch ((Opcode)*ip++) {
+#endif
+
+    TSBL_CASE(Constant): {
+        TSBL_PUSH(constants[read_u16(ip)]);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(Null):
+        TSBL_PUSH(Value());
+        TSBL_NEXT();
+    TSBL_CASE(True):
+        TSBL_PUSH(Value::FromBool(true));
+        TSBL_NEXT();
+    TSBL_CASE(False):
+        TSBL_PUSH(Value::FromBool(false));
+        TSBL_NEXT();
+    TSBL_CASE(Pop):
+        top -= 1;
+        TSBL_NEXT();
+    TSBL_CASE(GetLocal): {
+        TSBL_PUSH(stack[read_u16(ip)]);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(SetLocal): {
+        stack[read_u16(ip)] = top[-1];
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(Plus):
+        TSBL_ARITHMETIC(wrap_add, +);
+        TSBL_NEXT();
+    TSBL_CASE(Minus):
+        TSBL_ARITHMETIC(wrap_sub, -);
+        TSBL_NEXT();
+    TSBL_CASE(Multiply):
+        TSBL_ARITHMETIC(wrap_mul, *);
+        TSBL_NEXT();
+    TSBL_CASE(Divide): {
+        if (top[-2].is_int() && top[-1].is_int() && top[-1].as_int() == 0) {
+            goto divide_by_zero;
+        }
+        TSBL_ARITHMETIC(wrap_div, /);
+        TSBL_NEXT();
+    }
+    TSBL_CASE(Power): {
+        Value & left = top[-2];
+        const Value & right = top[-1];
+        if (left.is_int() && right.is_int() && right.as_int() >= 0) {
+            left = Value::FromInt(int_power(left.as_int(), right.as_int()));
+        }
+        else if (left.is_number() && right.is_number()) {
+            left = Value::FromReal(std::pow(left.as_number(),
+                right.as_number()));
+        }
+        else {
+            goto type_error;
+        }
+        top -= 1;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(Negate): {
+        Value & value = top[-1];
+        if (value.is_int()) {
+            value = Value::FromInt(wrap_sub(0, value.as_int()));
+        }
+        else if (value.is_real()) {
+            value = Value::FromReal(-value.as_real());
+        }
+        else {
+            goto type_error;
+        }
+        TSBL_NEXT();
+    }
+    TSBL_CASE(Not):
+        top[-1] = Value::FromBool(!top[-1].truthy());
+        TSBL_NEXT();
+    TSBL_CASE(Increment):
+        TSBL_STEP(top[-1], 1, 1.0);
+        TSBL_NEXT();
+    TSBL_CASE(Decrement):
+        TSBL_STEP(top[-1], -1, -1.0);
+        TSBL_NEXT();
+    TSBL_CASE(Equals):
+        top[-2] = Value::FromBool(Value::Equal(top[-2], top[-1]));
+        top -= 1;
+        TSBL_NEXT();
+    TSBL_CASE(NotEquals):
+        top[-2] = Value::FromBool(!Value::Equal(top[-2], top[-1]));
+        top -= 1;
+        TSBL_NEXT();
+    TSBL_CASE(Greater):
+        TSBL_COMPARE(>);
+        TSBL_NEXT();
+    TSBL_CASE(GreaterEquals):
+        TSBL_COMPARE(>=);
+        TSBL_NEXT();
+    TSBL_CASE(Less):
+        TSBL_COMPARE(<);
+        TSBL_NEXT();
+    TSBL_CASE(LessEquals):
+        TSBL_COMPARE(<=);
+        TSBL_NEXT();
+    TSBL_CASE(LShift): {
+        if (!top[-2].is_int() || !top[-1].is_int()) {
+            goto type_error;
+        }
+        top[-2] = Value::FromInt((int64_t)((uint64_t)top[-2].as_int()
+            << (top[-1].as_int() & 63)));
+        top -= 1;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(RShift): {
+        if (!top[-2].is_int() || !top[-1].is_int()) {
+            goto type_error;
+        }
+        top[-2] = Value::FromInt(top[-2].as_int()
+            >> (top[-1].as_int() & 63));
+        top -= 1;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(Jump): {
+        int32_t offset = read_i32(ip);
+        ip += 4 + offset;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(JumpIfFalse): {
+        int32_t offset = read_i32(ip);
+        ip += 4;
+        top -= 1;
+        if (!top->truthy()) {
+            ip += offset;
+        }
+        TSBL_NEXT();
+    }
+    TSBL_CASE(Return):
+        if (top > stack + program.locals) {
+            m_Result = top[-1];
+        }
+        return Interpreter::Ok;
+    TSBL_CASE(TypedConstant): {
+        if (top == limit) {
+            goto stack_overflow;
+        }
+        store<uint64_t>(top++, typed_constants[read_u16(ip)]);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(String): {
+        TSBL_PUSH(Value::FromString(strings
+            + string_offsets[read_u16(ip)]));
+        ip += 2;
+        TSBL_NEXT();
+    }
+
+    TSBL_CASE(StoreLocal): {
+        stack[read_u16(ip)] = *--top;
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(IncrementLocal): {
+        TSBL_STEP(stack[read_u16(ip)], 1, 1.0);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(DecrementLocal): {
+        TSBL_STEP(stack[read_u16(ip)], -1, -1.0);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(PlusConstant): {
+        TSBL_ARITHMETIC_ON(top[-1], constants[read_u16(ip)], wrap_add, +);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(MinusConstant): {
+        TSBL_ARITHMETIC_ON(top[-1], constants[read_u16(ip)], wrap_sub, -);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(MultiplyConstant): {
+        TSBL_ARITHMETIC_ON(top[-1], constants[read_u16(ip)], wrap_mul, *);
+        ip += 2;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(GetLocals): {
+        if (limit - top < 2) {
+            goto stack_overflow;
+        }
+        top[0] = stack[read_u16(ip)];
+        top[1] = stack[read_u16(ip + 2)];
+        top += 2;
+        ip += 4;
+        TSBL_NEXT();
+    }
+    TSBL_CASE(JumpIfNotLessLocals): {
+        int order = compare(stack[read_u16(ip)], stack[read_u16(ip + 2)]);
+        if (order == 2) {
+            goto type_error;
+        }
+        TSBL_JUMP_UNLESS(order < 0);
+        TSBL_NEXT();
+    }
+    TSBL_CASE(JumpIfNotLessConstant): {
+        int order = compare(stack[read_u16(ip)],
+            constants[read_u16(ip + 2)]);
+        if (order == 2) {
+            goto type_error;
+        }
+        TSBL_JUMP_UNLESS(order < 0);
+        TSBL_NEXT();
+    }
+
+    TSBL_TYPES(TSBL_TYPED_CASES)
+    TSBL_INTEGER_TYPES(TSBL_SHIFT_CASES)
+
+#if TSBL_COMPUTED_GOTO
+    }
+#else
+        default:
+            goto bad_code;
+        }
+    }
+#endif
+
+#undef TSBL_CASE
+#undef TSBL_NEXT
+#undef TSBL_PUSH
+#undef TSBL_ARITHMETIC_ON
+#undef TSBL_ARITHMETIC
+#undef TSBL_STEP
+#undef TSBL_JUMP_UNLESS
+#undef TSBL_COMPARE
+#undef TSBL_TYPED_BINARY
+#undef TSBL_TYPED_COMPARE
+#undef TSBL_TYPED_CASES
+#undef TSBL_SHIFT_CASES
+
+bad_code:
+    status = Interpreter::BadCode;
+    goto failed;
+type_error:
+    status = Interpreter::TypeError;
+    goto failed;
+divide_by_zero:
+    status = Interpreter::DivideByZero;
+    goto failed;
+stack_overflow:
+    status = Interpreter::StackOverflow;
+failed:
+    // Every error is found before the operands are read, so ip is just
+    // past the opcode which failed
+    size_t offset = (size_t)(ip - 1 - code);
+    m_ErrorLine = (offset < program.size ? program.lines[offset] : 0);
+    return status;
+}
+
+/**
+ * \brief Get the Value the last run returned, null if it failed
+ */
+const Value & Interpreter::result() const {
+    return m_Result;
+}
+
+/**
+ * \brief Get the source line of the instruction the last run failed on
+ */
+size_t Interpreter::error_line() const {
+    return m_ErrorLine;
+}
+
+/**
+ * \brief Get the name of an Interpreter::Status
+ */
+const char * Interpreter::Name(Interpreter::Status status) {
+    if ((size_t)status >= sizeof(_g_StatusNames) / sizeof(*_g_StatusNames)) {
+        return "Unknown";
+    }
+    return _g_StatusNames[status];
+}
@@ -1,176 +1,496 @@
 
 #include "tsbl/lexer.hpp"
 
+#include <cfloat>
+#include <charconv>
 #include <cmath>
+#include <cstring>
+
+#include "tsbl/char_class.hpp"
+#include "tsbl/stats.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace tsbl;
 
-extern const bool _g_CategoryIdentifier[];
-extern const bool _g_CategoryIdentifier_Start[];
+namespace {
+    /**
+     * \brief Classes of a single byte of UTF-8 input, see _g_ByteClass
+     *
+     * Every ASCII byte maps straight onto its class. Any byte with the high
+     * bit set is only flagged as part of a multi-byte sequence, which the
+     * buffer lexer has to decode to classify. The low bits are the same as
+     * utf8::CharClass.
+     */
+    enum ByteClass : uint8_t {
+        BC_Space = utf8::CC_Space,
+        BC_NewLine = utf8::CC_NewLine,
+        BC_IdStart = utf8::CC_IdStart,
+        BC_IdContinue = utf8::CC_IdContinue,
+        BC_Digit = 0x10,      //< [0-9]
+        BC_Multibyte = 0x20,  //< Part of a multi-byte sequence
+
+        SP = BC_Space,
+        NL = BC_NewLine,
+        ID = BC_IdStart | BC_IdContinue,
+        DG = BC_Digit | BC_IdContinue,
+        BM = BC_Multibyte
+    };
+
+    /**
+     * \brief Count the leading [0-9] bytes of the 8 bytes at data
+     *
+     * All 8 are tested at once: a byte is a digit when its high nibble is 3
+     * and adding 6 leaves it 3. A carry out of a byte which is not a digit
+     * can only spoil the bytes after it, which are not counted anyway.
+     */
+    inline size_t digit_count8(const uint8_t * data) {
+        uint64_t bytes;
+        std::memcpy(&bytes, data, sizeof(bytes));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        bytes = __builtin_bswap64(bytes);
+#endif
+        const uint64_t high = 0xF0F0F0F0F0F0F0F0ull;
+        const uint64_t threes = 0x3030303030303030ull;
+        uint64_t other = ((bytes & high) ^ threes)
+            | (((bytes + 0x0606060606060606ull) & high) ^ threes);
+        if (other == 0) {
+            return 8;
+        }
+#ifdef _MSC_VER
+        unsigned long bit;
+        _BitScanForward64(&bit, other);
+        return bit / 8;
+#else
+        return (size_t)__builtin_ctzll(other) / 8;
+#endif
+    }
+}
+
+namespace {
+    /**
+     * \brief Perfect hash of every keyword in Token::TokenNames
+     *
+     * The table is built at compile time: seeds are tried until every keyword
+     * lands in its own slot. Classifying an identifier then costs one hash of
+     * its text and one comparison against the single candidate keyword.
+     */
+    struct KeywordTable {
+        static constexpr size_t Bits = 7;
+        static constexpr size_t Size = (size_t)1 << Bits;
+
+        uint32_t seed;
+        size_t min_length, max_length;
+        int8_t slots[Size]; //< The Token::Id in each slot, or -1
+    };
+
+    template <typename CharT>
+    constexpr size_t keyword_slot(uint32_t seed, const CharT * data,
+        size_t size)
+    {
+        // FNV-1a, salted with the seed; the top bits pick the slot
+        uint32_t hash = 2166136261u ^ seed;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ (uint32_t)data[i]) * 16777619u;
+        }
+        return (size_t)(hash >> (32 - KeywordTable::Bits));
+    }
+
+    constexpr size_t name_length(const char * name) {
+        size_t length = 0;
+        while (name[length] != '\0') {
+            length += 1;
+        }
+        return length;
+    }
+
+    constexpr KeywordTable build_keyword_table() {
+        for (uint32_t seed = 1; seed < 100000; ++seed) {
+            KeywordTable table = { seed, KeywordTable::Size, 0, {} };
+            for (size_t i = 0; i < KeywordTable::Size; ++i) {
+                table.slots[i] = -1;
+            }
+
+            bool perfect = true;
+            for (int32_t id = Token::FirstKeyword;
+                perfect && id <= Token::LastKeyword; ++id)
+            {
+                const char * name = TokenNames[id];
+                size_t length = name_length(name);
+                size_t slot = keyword_slot(seed, name, length);
+                if (table.slots[slot] != -1) {
+                    perfect = false;
+                }
+                else {
+                    table.slots[slot] = (int8_t)id;
+                }
+                if (length < table.min_length) {
+                    table.min_length = length;
+                }
+                if (length > table.max_length) {
+                    table.max_length = length;
+                }
+            }
+            if (perfect) {
+                return table;
+            }
+        }
+        return KeywordTable{ 0, 0, 0, {} };
+    }
+
+    constexpr KeywordTable _g_Keywords = build_keyword_table();
+    static_assert(_g_Keywords.seed != 0,
+        "No perfect hash found for the keywords, grow KeywordTable::Bits");
 
-Lexer::Lexer() :
-    m_CharColumn(0), m_Line(0),
-    m_Current(utf8::Codepoint::Invalid), m_Next(utf8::Codepoint::Invalid)
+    template <typename CharT>
+    inline Token::Id keyword_lookup(const CharT * data, size_t size) {
+        if (size < _g_Keywords.min_length || size > _g_Keywords.max_length) {
+            return Token::Id::Identifier;
+        }
+        int8_t id = _g_Keywords.slots[keyword_slot(_g_Keywords.seed, data,
+            size)];
+        if (id < 0) {
+            return Token::Id::Identifier;
+        }
+        const char * name = TokenNames[id];
+        for (size_t i = 0; i < size; ++i) {
+            if ((uint32_t)(uint8_t)name[i] != (uint32_t)data[i]) {
+                return Token::Id::Identifier;
+            }
+        }
+        // The text may only be a prefix of the candidate keyword
+        return (name[size] == '\0' ? (Token::Id)id : Token::Id::Identifier);
+    }
+}
+
+extern const uint8_t _g_ByteClass[];
+
+LexerBase::LexerBase() :
+    LexerBase(m_LocalArena)
 { }
 
-Lexer::~Lexer() { }
+/**
+ * \brief Create a Lexer which allocates from an Arena
+ *
+ * Symbol names and string text all come from the Arena, so one source unit
+ * can be freed at once by resetting it. The Arena must outlive the Lexer and
+ * may only be reset once the Lexer and its Tokens are no longer used.
+ */
+LexerBase::LexerBase(Arena & arena) :
+    m_Current(utf8::Codepoint::Invalid), m_Next(utf8::Codepoint::Invalid),
+    m_Reader(nullptr), m_Offset(0), m_Start(0), m_Skew(0), m_Arena(&arena),
+    m_Symbols(arena), m_Name(ArenaAllocator<char>(arena)),
+    m_Strings(ArenaAllocator<char>(arena)),
+    m_Data(nullptr), m_Size(0), m_Index(0)
+{ }
 
-void Lexer::read(utf8::Reader & reader) {
+LexerBase::~LexerBase() { }
+
+template <typename ReaderT>
+BasicLexer<ReaderT>::BasicLexer() :
+    LexerBase()
+{ }
+
+/**
+ * \brief Create a BasicLexer which allocates from an Arena
+ *
+ * See LexerBase::LexerBase(Arena &).
+ */
+template <typename ReaderT>
+BasicLexer<ReaderT>::BasicLexer(Arena & arena) :
+    LexerBase(arena)
+{ }
+
+template <typename ReaderT>
+BasicLexer<ReaderT>::~BasicLexer() { }
+
+/**
+ * \brief Lex the codepoints of a ReaderT
+ *
+ * The text is not kept, so the SourceMap is filled in as the Lexer goes
+ * and only knows about the Tokens lexed so far.
+ */
+template <typename ReaderT>
+void BasicLexer<ReaderT>::read(ReaderT & reader) {
+    m_Data = nullptr;
+    m_Size = 0;
     m_Reader = &reader;
-    m_Next = m_Reader->next();
+    m_Offset = 0;
+    m_Skew = 0;
+    m_Map.clear();
+    m_Next = reader.next();
+}
+
+/**
+ * \brief Lex directly from a buffer of UTF-8 data
+ *
+ * In this mode the Lexer scans the raw bytes itself instead of pulling
+ * codepoints from a utf8::Reader. ASCII is classified through a byte table
+ * and only bytes with the high bit set are decoded. The buffer must outlive
+ * the Lexer, or at least every call to next().
+ *
+ * \param data The UTF-8 data to lex
+ * \param size The number of bytes in the buffer
+ * \return False if the buffer is larger than MaxSize, when nothing is read
+ *     and the Lexer only gives EndOfFile
+ */
+bool LexerBase::read(const uint8_t * data, size_t size) {
+    bool fits = (size <= LexerBase::MaxSize);
+    if (!fits) {
+        data = nullptr;
+        size = 0;
+    }
+    m_Reader = nullptr;
+    m_Data = data;
+    m_Size = size;
+    m_Index = 0;
+    m_Map.read(data, size);
+    return fits;
+}
+
+/**
+ * \brief Forget every symbol and the text of every string
+ *
+ * Tokens lexed before, and their symbols, are no good after this. The
+ * SymbolTable and the text keep the memory they took from the Arena and
+ * fill it again, so lexing the same source once more takes nothing new.
+ * The Arena itself is left alone, as others may allocate from it too.
+ */
+void LexerBase::reset() {
+    m_Symbols.clear();
+    m_Name.clear();
+    m_Strings.clear();
+}
+
+/**
+ * \brief Get the SourceMap which turns Token offsets into lines and columns
+ */
+const SourceMap & LexerBase::source_map() const {
+    return m_Map;
+}
+
+/**
+ * \brief Get where a Lexer reading a buffer is
+ *
+ * Taken between Tokens, this is all the Lexer carries from one Token to the
+ * next, so restoring it later lexes the same Tokens again.
+ */
+LexerBase::State LexerBase::state() const {
+    return State{ m_Index };
+}
+
+/**
+ * \brief Move a Lexer reading a buffer back to a State from state()
+ */
+void LexerBase::restore(const LexerBase::State & state) {
+    m_Index = state.index;
+}
+
+/**
+ * \brief Get the Arena the Lexer allocates from
+ *
+ * A parser for the same source can allocate its nodes from it too.
+ */
+Arena & LexerBase::arena() {
+    return *m_Arena;
+}
+
+/**
+ * \brief Get the SymbolTable which identifier Tokens refer to
+ */
+SymbolTable & LexerBase::symbols() {
+    return m_Symbols;
 }
 
-size_t Lexer::column() const {
-    return m_CharColumn;
+const SymbolTable & LexerBase::symbols() const {
+    return m_Symbols;
 }
 
-size_t Lexer::line() const {
-    return m_Line;
+/**
+ * \brief Get the UTF-8 text of a string or numeric Token from this Lexer
+ *
+ * When lexing a buffer, strings without escapes are slices of the buffer
+ * and are only valid while it is. Materialized text is kept for as long as
+ * the Lexer lives, across calls to read(), but a view of it is invalidated
+ * by the next call to next().
+ */
+std::string_view LexerBase::string(const Token & token) const {
+    return span_text(token.span());
 }
 
-bool Lexer::identifier(utf8::codepoint_t pt) const {
-    return _g_CategoryIdentifier[utf8::category(pt)];
+/**
+ * \brief Decode the value of a numeric Token produced by this Lexer
+ *
+ * Numeric Tokens only hold a span of their text, which is decoded here, so
+ * literals which are never looked at cost nothing to decode. Like
+ * string(), the source buffer must still be alive.
+ *
+ * \param token An IntegerValue or RealValue Token
+ * \param value Set to the value, see numeric_value()
+ * \return The type of the literal, see numeric_value()
+ */
+Token::Id LexerBase::number(const Token & token, Token::Value & value) const {
+    return numeric_value(span_text(token.span()),
+        token.id() == Token::Id::RealValue, value);
 }
 
-bool Lexer::identifier_start(utf8::codepoint_t pt) const {
-    return _g_CategoryIdentifier_Start[utf8::category(pt)];
+/**
+ * \brief Get the value of an integer Token, or 0 if it is not valid
+ */
+uint64_t LexerBase::integer(const Token & token) const {
+    Token::Value value;
+    Token::Id type = number(token, value);
+    if (type == Token::Id::Invalid || type == Token::Id::RealValue
+        || type == Token::Id::Float || type == Token::Id::Double)
+    {
+        return 0;
+    }
+    return value.integer;
+}
+
+/**
+ * \brief Get the value of a numeric Token as a real, or 0 if it is not valid
+ */
+double LexerBase::real(const Token & token) const {
+    Token::Value value;
+    switch (number(token, value)) {
+    case Token::Id::Invalid:
+        return 0.0;
+    case Token::Id::RealValue:
+    case Token::Id::Float:
+    case Token::Id::Double:
+        return value.real;
+    default:
+        return (double)value.integer;
+    }
+}
+
+std::string_view LexerBase::span_text(const Token::Span & span) const {
+    if (span.materialized()) {
+        return std::string_view(m_Strings.data() + span.offset, span.size());
+    }
+    return std::string_view((const char *)m_Data + span.offset, span.size());
+}
+
+bool LexerBase::identifier(utf8::codepoint_t pt) const {
+    return (utf8::char_class(pt) & utf8::CC_IdContinue) != 0;
+}
+
+bool LexerBase::identifier_start(utf8::codepoint_t pt) const {
+    return (utf8::char_class(pt) & utf8::CC_IdStart) != 0;
+}
+
+template <typename ReaderT>
+Token BasicLexer<ReaderT>::next() {
+    Token token = (m_Reader == nullptr ? next_buffer() : next_reader());
+    TSBL_STATS_TOKEN(token.id());
+    return token;
 }
 
-Token Lexer::next() {
+/**
+ * \brief Produce the next Token from the ReaderT set by read(ReaderT &)
+ */
+template <typename ReaderT>
+Token BasicLexer<ReaderT>::next_reader() {
+    size_t start = m_Offset, skew = m_Skew;
     utf8::codepoint_t codepoint = next_cp();
 
     // Consume all whitespace which is not a new line - category is ZS
-    while (utf8::category(codepoint) == utf8::Category::ZS) {
-        m_CharColumn += 1;
-        codepoint = next_cp();
+    {
+        TSBL_STATS_TIME(Whitespace);
+        while (utf8::char_class(codepoint) & utf8::CC_Space) {
+            start = m_Offset;
+            skew = m_Skew;
+            codepoint = next_cp();
+        }
     }
 
-    m_StartLine = m_Line;
-    m_StartColumn = m_CharColumn;
+    // Only the start of each Token is mapped, there is no text to scan
+    m_Start = start;
+    m_Map.add_skew(start, skew);
 
     switch (codepoint) {
+    case utf8::Codepoint::EndOfFile:
+    case utf8::Codepoint::Invalid:
+        return error(codepoint, m_Start, m_Offset);
     case '\n':
-        if (peek_cp() == '\r') {
+    case '\r':
+        if (codepoint == '\n' && peek_cp() == '\r') {
             next_cp();
         }
-        m_CharColumn = 0;
-        m_Line += 1;
-        return Token(Token::Id::NewLine, m_Line, m_CharColumn);
-    case '\r':
-        m_CharColumn = 0;
-        m_Line += 1;
-        return Token(Token::Id::NewLine, m_Line, m_CharColumn);
+        m_Map.add_line(m_Offset);
+        return Token(Token::Id::NewLine, m_Start);
     case '+':
         if (peek_cp() == '+') {
             next_cp();
-            return Token(Token::Id::Increment, m_Line, m_StartColumn);
+            return Token(Token::Id::Increment, m_Start);
         }
-        return Token(Token::Id::Plus, m_Line, m_CharColumn);
+        return Token(Token::Id::Plus, m_Start);
     case '-':
         if (peek_cp() == '-') {
             next_cp();
-            return Token(Token::Id::Decrement, m_Line, m_StartColumn);
+            return Token(Token::Id::Decrement, m_Start);
         }
-        return Token(Token::Id::Minus, m_Line, m_CharColumn);
+        return Token(Token::Id::Minus, m_Start);
     case '*':
         if (peek_cp() == '*') {
             next_cp();
-            return Token(Token::Id::Power, m_Line, m_StartColumn);
+            return Token(Token::Id::Power, m_Start);
         }
-        return Token(Token::Id::Multiply, m_Line, m_CharColumn);
+        return Token(Token::Id::Multiply, m_Start);
     case '/':
-        return Token(Token::Id::Divide, m_Line, m_CharColumn);
+        return Token(Token::Id::Divide, m_Start);
     case '(':
-        return Token(Token::Id::OpenParen, m_Line, m_CharColumn);
+        return Token(Token::Id::OpenParen, m_Start);
     case ')':
-        return Token(Token::Id::CloseParen, m_Line, m_CharColumn);
+        return Token(Token::Id::CloseParen, m_Start);
     case '[':
-        return Token(Token::Id::OpenBracket, m_Line, m_CharColumn);
+        return Token(Token::Id::OpenBracket, m_Start);
     case ']':
-        return Token(Token::Id::CloseBracket, m_Line, m_CharColumn);
+        return Token(Token::Id::CloseBracket, m_Start);
     case '{':
-        return Token(Token::Id::OpenBrace, m_Line, m_CharColumn);
+        return Token(Token::Id::OpenBrace, m_Start);
     case '}':
-        return Token(Token::Id::CloseBrace, m_Line, m_CharColumn);
+        return Token(Token::Id::CloseBrace, m_Start);
     case '.':
-        return Token(Token::Id::Access, m_Line, m_CharColumn);
+        return Token(Token::Id::Access, m_Start);
     case '=':
         if (peek_cp() == '=') {
             next_cp();
-            return Token(Token::Id::Equals, m_Line, m_StartColumn);
+            return Token(Token::Id::Equals, m_Start);
         }
-        return Token(Token::Id::Assign, m_Line, m_CharColumn);
+        return Token(Token::Id::Assign, m_Start);
     case '!':
         if (peek_cp() == '=') {
             next_cp();
-            return Token(Token::Id::NotEquals, m_Line, m_StartColumn);
+            return Token(Token::Id::NotEquals, m_Start);
         }
-        return Token(Token::Id::Not, m_Line, m_CharColumn);
+        return Token(Token::Id::Not, m_Start);
     case '>':
         if (peek_cp() == '=') {
             next_cp();
-            return Token(Token::Id::GreaterEquals, m_Line, m_StartColumn);
+            return Token(Token::Id::GreaterEquals, m_Start);
         }
         else if (peek_cp() == '>') {
             next_cp();
-            return Token(Token::Id::RShift, m_Line, m_StartColumn);
+            return Token(Token::Id::RShift, m_Start);
         }
-        return Token(Token::Id::Greater, m_Line, m_CharColumn);
+        return Token(Token::Id::Greater, m_Start);
     case '<':
         if (peek_cp() == '=') {
             next_cp();
-            return Token(Token::Id::LessEquals, m_Line, m_StartColumn);
+            return Token(Token::Id::LessEquals, m_Start);
         }
         else if (peek_cp() == '<') {
             next_cp();
-            return Token(Token::Id::LShift, m_Line, m_StartColumn);
-        }
-        return Token(Token::Id::Less, m_Line, m_CharColumn);
-    case 'd':
-        switch (peek_cp()) {
-        case 'e':
-            return consume_keyword(Token::Id::Def, 2);
-        case 'o':
-            return consume_keyword(Token::Id::Double, 2);
-        default:
-            return consume_identifier(U"d");
-        }
-    case 'p':
-        switch (peek_cp()) {
-        case 'u':
-            switch (peek_next_cp()) {
-            case 'r':
-                return consume_keyword(Token::Id::Pure, 3);
-            case 'b':
-                return consume_keyword(Token::Id::Public, 3);
-            default:
-                return consume_identifier(U"pu");
-            }
-        case 'r':
-            return consume_keyword(Token::Id::Protected, 2);
-        default:
-            return consume_identifier(U"p");
-        }
-        break;
-    case 't':
-        switch (peek_cp()) {
-        case 'r':
-            switch (peek_next_cp()) {
-            case 'y':
-                if (identifier(peek_next_cp())) {
-                    return consume_identifier(U"try");
-                }
-                return Token(Token::Id::Try, m_Line, m_StartColumn);
-            case 'u':
-                return consume_keyword(Token::Id::True, 3);
-            default:
-                return consume_identifier(U"tr");
-            }
-        case 'h':
-            return consume_keyword(Token::Id::Throw, 2);
-        default:
-            return consume_identifier(U"t");
+            return Token(Token::Id::LShift, m_Start);
         }
+        return Token(Token::Id::Less, m_Start);
+    case '"':
+    case '\'':
+        return consume_string(codepoint);
     case '0':
     case '1':
     case '2':
@@ -188,317 +508,1004 @@ Token Lexer::next() {
         }
     }
 
-    return Token(Token::Id::Invalid, m_Line, m_CharColumn);
+    return Token(Token::Id::Invalid, m_Start);
+}
+
+/**
+ * \brief Lex up to max Tokens into a TokenBuffer
+ *
+ * The buffer is cleared first, and keeps its capacity from earlier batches.
+ * A batch ends early after an error Token, which is kept as the last Token
+ * so the caller can see why. Lexing can carry on after any error but
+ * EndOfFile and BadEncoding, which repeat forever.
+ *
+ * \param buffer The TokenBuffer to fill
+ * \param max The most Tokens to lex
+ * \return The number of Tokens lexed
+ */
+template <typename ReaderT>
+size_t BasicLexer<ReaderT>::next_batch(TokenBuffer & buffer, size_t max) {
+    buffer.clear();
+    buffer.reserve(max);
+    while (buffer.size() < max) {
+        Token token = next();
+        buffer.push(token);
+        if (token.id() < 0) {
+            break;
+        }
+    }
+    return buffer.size();
+}
+
+/**
+ * \brief Produce the next Token from the buffer set by read(const uint8_t *)
+ *
+ * This mirrors next(), but works on bytes. ASCII never gets converted to a
+ * codepoint, and identifier text is interned without being decoded.
+ */
+Token LexerBase::next_buffer() {
+    size_t length;
+    utf8::codepoint_t pt;
+
+    // Consume all whitespace which is not a new line - category is ZS
+    {
+        TSBL_STATS_TIME(Whitespace);
+        for (;;) {
+            while (m_Index < m_Size && _g_ByteClass[m_Data[m_Index]] == SP) {
+                m_Index += 1;
+            }
+            if (m_Index >= m_Size || m_Data[m_Index] < 0x80) {
+                break;
+            }
+            pt = decode_buffer(m_Index, length);
+            if (pt == utf8::Codepoint::Invalid
+                || !(utf8::char_class(pt) & utf8::CC_Space))
+            {
+                break;
+            }
+            m_Index += length;
+        }
+    }
+
+    size_t start = m_Index;
+    if (m_Index >= m_Size) {
+        return Token(Token::Id::EndOfFile, start);
+    }
+
+    uint8_t byte = m_Data[m_Index++];
+    uint8_t next = (m_Index < m_Size ? m_Data[m_Index] : 0);
+    switch (byte) {
+    case '\n':
+    case '\r':
+        if (byte == '\n' && next == '\r') {
+            m_Index += 1;
+        }
+        return Token(Token::Id::NewLine, start);
+    case '+':
+        if (next == '+') {
+            m_Index += 1;
+            return Token(Token::Id::Increment, start);
+        }
+        return Token(Token::Id::Plus, start);
+    case '-':
+        if (next == '-') {
+            m_Index += 1;
+            return Token(Token::Id::Decrement, start);
+        }
+        return Token(Token::Id::Minus, start);
+    case '*':
+        if (next == '*') {
+            m_Index += 1;
+            return Token(Token::Id::Power, start);
+        }
+        return Token(Token::Id::Multiply, start);
+    case '/':
+        return Token(Token::Id::Divide, start);
+    case '(':
+        return Token(Token::Id::OpenParen, start);
+    case ')':
+        return Token(Token::Id::CloseParen, start);
+    case '[':
+        return Token(Token::Id::OpenBracket, start);
+    case ']':
+        return Token(Token::Id::CloseBracket, start);
+    case '{':
+        return Token(Token::Id::OpenBrace, start);
+    case '}':
+        return Token(Token::Id::CloseBrace, start);
+    case '.':
+        return Token(Token::Id::Access, start);
+    case '=':
+        if (next == '=') {
+            m_Index += 1;
+            return Token(Token::Id::Equals, start);
+        }
+        return Token(Token::Id::Assign, start);
+    case '!':
+        if (next == '=') {
+            m_Index += 1;
+            return Token(Token::Id::NotEquals, start);
+        }
+        return Token(Token::Id::Not, start);
+    case '>':
+        if (next == '=') {
+            m_Index += 1;
+            return Token(Token::Id::GreaterEquals, start);
+        }
+        else if (next == '>') {
+            m_Index += 1;
+            return Token(Token::Id::RShift, start);
+        }
+        return Token(Token::Id::Greater, start);
+    case '<':
+        if (next == '=') {
+            m_Index += 1;
+            return Token(Token::Id::LessEquals, start);
+        }
+        else if (next == '<') {
+            m_Index += 1;
+            return Token(Token::Id::LShift, start);
+        }
+        return Token(Token::Id::Less, start);
+    case '"':
+    case '\'':
+        return scan_string(start);
+    default:
+        break;
+    }
+
+    if (_g_ByteClass[byte] & BC_Digit) {
+        return scan_numeric(start);
+    }
+    if (_g_ByteClass[byte] & BC_IdStart) {
+        return scan_identifier(start);
+    }
+    if (byte >= 0x80) {
+        pt = decode_buffer(start, length);
+        if (pt == utf8::Codepoint::Invalid) {
+            // Like a utf8::Reader, stay on the bad sequence
+            m_Index = start;
+            return Token(Token::Id::BadEncoding, start);
+        }
+        if (identifier_start(pt)) {
+            return scan_identifier(start);
+        }
+        m_Index = start + length;
+    }
+    return Token(Token::Id::Invalid, start);
+}
+
+Token LexerBase::scan_identifier(size_t start) {
+    TSBL_STATS_TIME(Identifier);
+    bool ascii = true;
+    size_t index = start;
+    for (;;) {
+        while (index < m_Size
+            && (_g_ByteClass[m_Data[index]] & BC_IdContinue))
+        {
+            index += 1;
+        }
+        if (index >= m_Size || m_Data[index] < 0x80) {
+            break;
+        }
+        size_t length;
+        utf8::codepoint_t pt = decode_buffer(index, length);
+        if (pt == utf8::Codepoint::Invalid || !identifier(pt)) {
+            break;
+        }
+        ascii = false;
+        index += length;
+    }
+    m_Index = index;
+
+    if (ascii) {
+        Token::Id id = keyword(m_Data + start, index - start);
+        if (id != Token::Id::Identifier) {
+            return Token(id, start);
+        }
+    }
+
+    // The name is interned straight from the buffer, without decoding
+    Token token(Token::Id::Identifier, start);
+    token.symbol() = m_Symbols.intern(m_Data + start, index - start);
+    return token;
+}
+
+/**
+ * \brief Scan a numeric literal, the first digit being at start
+ *
+ * Only the extent of the literal is found here, the Token holds a span of
+ * its text and the value is decoded by number() when it is asked for.
+ */
+Token LexerBase::scan_numeric(size_t start) {
+    TSBL_STATS_TIME(Numeric);
+    Token::Id id = Token::Id::IntegerValue;
+    size_t index = start + 1;
+    uint8_t prefix = (index < m_Size && m_Data[start] == '0'
+        ? (m_Data[index] | 0x20) : 0);
+    if (prefix == 'x') {
+        index += 1;
+        while (index < m_Size && hex_digit(m_Data[index]) >= 0) {
+            index += 1;
+        }
+    }
+    else if (prefix == 'b') {
+        index += 1;
+        while (index < m_Size && (m_Data[index] == '0' || m_Data[index] == '1'))
+        {
+            index += 1;
+        }
+    }
+    else {
+        index = digit_run(index);
+        if (index < m_Size && m_Data[index] == '.') {
+            id = Token::Id::RealValue;
+            index = digit_run(index + 1);
+        }
+        if (index < m_Size && (m_Data[index] | 0x20) == 'e') {
+            id = Token::Id::RealValue;
+            index += 1;
+            if (index < m_Size && (m_Data[index] == '+' || m_Data[index] == '-'))
+            {
+                index += 1;
+            }
+            index = digit_run(index);
+        }
+    }
+
+    // A type suffix, which is checked when the value is decoded
+    while (index < m_Size && (_g_ByteClass[m_Data[index]] & BC_IdContinue)) {
+        index += 1;
+    }
+    m_Index = index;
+    return span_token(id, start,
+        Token::Span{ (uint32_t)start, (uint32_t)(index - start) });
+}
+
+/**
+ * \brief Get the index of the first byte from index on which is not [0-9]
+ *
+ * Eight bytes are checked at a time while there are that many left.
+ */
+size_t LexerBase::digit_run(size_t index) const {
+    while (index + 8 <= m_Size) {
+        size_t count = digit_count8(m_Data + index);
+        index += count;
+        if (count < 8) {
+            return index;
+        }
+    }
+    while (index < m_Size && (_g_ByteClass[m_Data[index]] & BC_Digit)) {
+        index += 1;
+    }
+    return index;
+}
+
+/**
+ * \brief Scan a string literal, the opening quote being at start
+ *
+ * A string without escapes is returned as a span of the buffer itself, so
+ * nothing is copied. The first escape switches to materializing the text:
+ * what was scanned so far is copied out and the rest is decoded after it.
+ */
+Token LexerBase::scan_string(size_t start) {
+    TSBL_STATS_TIME(String);
+    uint8_t quote = m_Data[start];
+    size_t index = start + 1;
+    bool longstr = false;
+    if (index < m_Size && m_Data[index] == quote) {
+        if (index + 1 >= m_Size || m_Data[index + 1] != quote) {
+            // Just an empty string
+            m_Index = index + 1;
+            return span_token(Token::Id::StringValue, start,
+                Token::Span{ (uint32_t)index, 0 });
+        }
+        index += 2;
+        longstr = true;
+    }
+
+    size_t begin = index;
+    size_t copied = index;  //< Bytes before this are in m_Strings
+    size_t offset = m_Strings.size();
+    bool materialized = false;
+    utf8::codepoint_t failure = 0;
+    size_t end = 0;
+    for (;;) {
+        if (index >= m_Size) {
+            failure = utf8::Codepoint::UnexpectedStringEOF;
+            break;
+        }
+        uint8_t byte = m_Data[index];
+        if (byte == quote) {
+            if (!longstr) {
+                end = index;
+                index += 1;
+                break;
+            }
+            if (index + 2 < m_Size && m_Data[index + 1] == quote
+                && m_Data[index + 2] == quote)
+            {
+                end = index;
+                index += 3;
+                break;
+            }
+            index += 1;
+        }
+        else if (byte == '\\') {
+            m_Strings.append((const char *)m_Data + copied, index - copied);
+            materialized = true;
+            if (!scan_escape(index, failure)) {
+                break;
+            }
+            copied = index;
+        }
+        else if (byte == '\n' || byte == '\r') {
+            if (!longstr) {
+                failure = utf8::Codepoint::UnexpectedStringEOL;
+                break;
+            }
+            index += 1;
+            if (byte == '\n' && index < m_Size && m_Data[index] == '\r') {
+                index += 1;
+            }
+        }
+        else if (byte >= 0x80) {
+            size_t length;
+            if (decode_buffer(index, length) == utf8::Codepoint::Invalid) {
+                failure = utf8::Codepoint::Invalid;
+                break;
+            }
+            index += length;
+        }
+        else {
+            index += 1;
+        }
+    }
+
+    if (failure != 0) {
+        // Report it the same way as the utf8::Reader path, staying on
+        // whatever caused it
+        m_Strings.resize(offset);
+        m_Index = (failure == utf8::Codepoint::UnexpectedStringEOF
+            ? m_Size : index);
+        return error(failure, start, index);
+    }
+
+    m_Index = index;
+    Token::Id id = (longstr ? Token::Id::LongString : Token::Id::StringValue);
+    if (!materialized) {
+        return span_token(id, start,
+            Token::Span{ (uint32_t)begin, (uint32_t)(end - begin) });
+    }
+    m_Strings.append((const char *)m_Data + copied, end - copied);
+    return span_token(id, start, Token::Span{ (uint32_t)offset,
+        (uint32_t)(m_Strings.size() - offset) | Token::Span::Materialized });
+}
+
+/**
+ * \brief Scan the escape at index, which is a backslash, and append its value
+ *
+ * \param index Moved past the escape, or onto whatever made it bad
+ * \param failure Set to the utf8::Codepoint error code if the escape is bad
+ * \return If the escape was good
+ */
+bool LexerBase::scan_escape(size_t & index, utf8::codepoint_t & failure) {
+    index += 1;
+    if (index >= m_Size) {
+        failure = utf8::Codepoint::UnexpectedStringEOF;
+        return false;
+    }
+    uint8_t byte = m_Data[index];
+    if (byte == '\n' || byte == '\r') {
+        failure = utf8::Codepoint::UnexpectedStringEOL;
+        return false;
+    }
+    if (byte >= 0x80) {
+        // Not an escape, so it is kept as written
+        size_t length;
+        if (decode_buffer(index, length) == utf8::Codepoint::Invalid) {
+            failure = utf8::Codepoint::Invalid;
+            return false;
+        }
+        m_Strings.push_back('\\');
+        m_Strings.append((const char *)m_Data + index, length);
+        index += length;
+        return true;
+    }
+    index += 1;
+
+    size_t digits = escape_digits(byte);
+    if (digits > 0) {
+        utf8::codepoint_t value = 0;
+        for (size_t i = 0; i < digits; ++i) {
+            int digit = (index < m_Size ? hex_digit(m_Data[index]) : -1);
+            if (digit < 0) {
+                utf8::codepoint_t pt = utf8::Codepoint::EndOfFile;
+                if (index < m_Size) {
+                    size_t length;
+                    pt = (m_Data[index] < 0x80 ? m_Data[index]
+                        : decode_buffer(index, length));
+                }
+                failure = escape_digit_error(pt);
+                return false;
+            }
+            value = value * 16 + (utf8::codepoint_t)digit;
+            index += 1;
+        }
+        if (value > 0x10FFFF) {
+            failure = utf8::Codepoint::BadEscapeHexDigit;
+            return false;
+        }
+        append_string(value);
+        return true;
+    }
+
+    utf8::codepoint_t value = escape_value(byte);
+    if (value == utf8::Codepoint::Invalid) {
+        m_Strings.push_back('\\');
+        value = byte;
+    }
+    m_Strings.push_back((char)value);
+    return true;
 }
 
-utf8::codepoint_t Lexer::next_cp() {
+/**
+ * \brief Decode the multi-byte sequence at the given buffer index
+ *
+ * \param index The buffer index of the lead byte
+ * \param length Set to the length of the sequence in bytes
+ * \return The codepoint, or utf8::Codepoint::Invalid
+ */
+utf8::codepoint_t LexerBase::decode_buffer(size_t index, size_t & length) const {
+    size_t remaining = m_Size - index;
+    auto results = utf8::iterate(m_Data + index,
+        (remaining >= 4 ? (int32_t)4 : (int32_t)remaining));
+    if (results.first <= 0) {
+        length = 0;
+        return utf8::Codepoint::Invalid;
+    }
+    length = (size_t)results.first;
+    TSBL_STATS_ADD(codepoints, 1);
+    return results.second;
+}
+
+/**
+ * \brief Look up the keyword Token::Id for identifier text
+ *
+ * \return The keyword Token::Id, or Token::Id::Identifier if the text is
+ *         not a keyword
+ */
+Token::Id LexerBase::keyword(const uint8_t * data, size_t size) {
+    return keyword_lookup(data, size);
+}
+
+template <typename ReaderT>
+utf8::codepoint_t BasicLexer<ReaderT>::next_cp() {
     m_Current = m_Next;
-    m_Next = m_Reader->next();
-    // If our current character isn't negative (an error code), increment the
-    // column count.
-    if (m_Current >= 0) {
-        m_CharColumn += 1;
+    m_Next = static_cast<ReaderT *>(m_Reader)->next();
+    // Error codes take no room in the text
+    if (m_Current < 0x80) {
+        m_Offset += 1;
+    }
+    else if (m_Current <= 0x10FFFF) {
+        size_t length = (m_Current < 0x800 ? 2 : m_Current < 0x10000 ? 3 : 4);
+        m_Offset += length;
+        m_Skew += length - 1;
     }
     return m_Current;
 }
 
-utf8::codepoint_t Lexer::current_cp() const {
+utf8::codepoint_t LexerBase::current_cp() const {
     return m_Current;
 }
 
-utf8::codepoint_t Lexer::peek_cp() const {
+utf8::codepoint_t LexerBase::peek_cp() const {
     return m_Next;
 }
 
-utf8::codepoint_t Lexer::peek_next_cp() {
+template <typename ReaderT>
+utf8::codepoint_t BasicLexer<ReaderT>::peek_next_cp() {
     next_cp();
     return m_Next;
 }
 
-Token Lexer::consume_keyword(Token::Id id, size_t start_idx) {
-    utf8::codepoint_t pt;
-    const char32_t * keyword = Token::Name32(id);
-    for (size_t i = start_idx; keyword[i] != '\0'; ++i) {
-        if ((pt = peek_next_cp()) != keyword[i]) {
-            // If we don't match the next expected character, treat the token
-            // as an identifier.
-            Token token(Token::Id::Identifier, line(), m_StartColumn);
-            token.string() = std::move(Token::U32String(keyword, i));
-            consume_identifier(token);
-            return token;
-        }
-    }
-    
-    // Check if the next codepoint is still an identifier codepoint
-    if (identifier(peek_next_cp())) {
-        return consume_identifier(keyword);
-    }
-    return Token(id, line(), m_StartColumn);
-}
-
-Token Lexer::consume_identifier(const char32_t * start_val) {
-    Token::U32String tstr(start_val);
-    Token token(Token::Id::Identifier, line(), m_StartColumn);
-    token.string() = std::move(tstr);
-    consume_identifier(token);
-    
-    return token;
-}
+template <typename ReaderT>
+Token BasicLexer<ReaderT>::consume_identifier(utf8::codepoint_t pt) {
+    TSBL_STATS_TIME(Identifier);
+    // Collect the name as UTF-8 so it can be interned as-is
+    uint8_t bytes[4];
+    m_Name.clear();
+    m_Name.append((const char *)bytes, utf8::encode(pt, bytes));
+    while (identifier(peek_cp())) {
+        m_Name.append((const char *)bytes, utf8::encode(peek_cp(), bytes));
+        next_cp();
+    }
 
-Token Lexer::consume_identifier(utf8::codepoint_t pt) {
-    Token token(Token::Id::Identifier, line(), m_StartColumn);
-    token.string() += pt;
-    consume_identifier(token);
+    const uint8_t * data = (const uint8_t *)m_Name.data();
+    Token::Id id = keyword(data, m_Name.size());
+    if (id != Token::Id::Identifier) {
+        return Token(id, m_Start);
+    }
+    Token token(Token::Id::Identifier, m_Start);
+    token.symbol() = m_Symbols.intern(data, m_Name.size());
     return token;
 }
 
-void Lexer::consume_identifier(Token & token) {
-    while (identifier(peek_cp())) {
-        token.string() += peek_cp();
+/**
+ * \brief Read a string literal, the opening quote being the current codepoint
+ *
+ * Without a source buffer the text always has to be materialized, so it is
+ * appended to the string text as it is decoded.
+ */
+template <typename ReaderT>
+Token BasicLexer<ReaderT>::consume_string(utf8::codepoint_t quote) {
+    TSBL_STATS_TIME(String);
+    bool longstr = false;
+    size_t offset = m_Strings.size();
+    if (m_Next == quote) {
+        next_cp();
+        if (m_Next != quote) {
+            // Just an empty string
+            return span_token(Token::Id::StringValue, m_Start,
+                Token::Span{ (uint32_t)offset, Token::Span::Materialized });
+        }
         next_cp();
+        longstr = true;
     }
-}
 
-Token Lexer::consume_string(bool dbl, bool longstr) {
-    size_t endsize = (longstr ? 3 : 1);
-    size_t count = 0;
-    size_t line_start = line();
-    size_t char_start = column() - (count - 1);
-    utf8::codepoint_t quote_cp = (utf8::codepoint_t)(dbl ? '"' : '\'');
     utf8::codepoint_t pt;
-    Token::U32String data;
-    while (count < endsize) {
-        if (m_Next < 0) {
-            return error(next_cp());
+    for (;;) {
+        pt = m_Next;
+        if (pt == utf8::Codepoint::EndOfFile) {
+            m_Strings.resize(offset);
+            return error(utf8::Codepoint::UnexpectedStringEOF, m_Start,
+                m_Offset);
+        }
+        if (pt == utf8::Codepoint::Invalid) {
+            m_Strings.resize(offset);
+            m_Map.add_skew(m_Offset, m_Skew);
+            return error(pt, m_Start, m_Offset);
         }
+        if (!longstr && (pt == '\n' || pt == '\r')) {
+            m_Strings.resize(offset);
+            return error(utf8::Codepoint::UnexpectedStringEOL, m_Start,
+                m_Offset);
+        }
+        next_cp();
 
-        count = (m_Next == quote_cp ? count + 1 : 0);
-        if (m_Next == '\\') {
-            next_cp();
-            switch (m_Next) {
-            case 'a':
-                data += (utf8::codepoint_t)'\a';
-                break;
-            case 'b':
-                data += (utf8::codepoint_t)'\b';
-                break;
-            case 'n':
-                data += (utf8::codepoint_t)'\n';
-                break;
-            case 'r':
-                data += (utf8::codepoint_t)'\r';
-                break;
-            case 't':
-                data += (utf8::codepoint_t)'\t';
+        if (pt == quote) {
+            if (!longstr) {
                 break;
-            case 'u':
-                pt = consume_escape(4);
-                if (pt < 0) {
-                    return error(pt);
-                }
-                data += pt;
-                break;
-            case 'U':
-                data += consume_escape(8);
-                if (pt < 0) {
-                    return error(pt);
-                }
-                break;
-            case 'v':
-                data += (utf8::codepoint_t)'\v';
-                break;
-            case 'x':
-                pt = consume_escape(2);
-                if (pt < 0) {
-                    return error(pt);
+            }
+            if (m_Next == quote) {
+                next_cp();
+                if (m_Next == quote) {
+                    next_cp();
+                    break;
                 }
-                data += consume_escape(2);
-                break;
-            case '\'':
-                data += (utf8::codepoint_t)'\'';
-                break;
-            case '\"':
-                data += (utf8::codepoint_t)'\"';
-                break;
+                append_string(quote);
             }
+            append_string(quote);
         }
-        else if (m_Next == '\n' || m_Next == '\r') {
-            return error(utf8::Codepoint::UnexpectedStringEOL);
+        else if (pt == '\\') {
+            pt = consume_escape();
+            if (escape_error(pt)) {
+                m_Strings.resize(offset);
+                m_Map.add_skew(m_Offset, m_Skew);
+                return error(pt, m_Start, m_Offset);
+            }
+        }
+        else if (pt == '\n' || pt == '\r') {
+            // Only long strings get here; the text keeps the raw line break
+            append_string(pt);
+            if (pt == '\n' && m_Next == '\r') {
+                append_string(next_cp());
+            }
+            m_Map.add_line(m_Offset);
+            m_Map.add_skew(m_Offset, m_Skew);
         }
         else {
-            data += m_Next;
+            append_string(pt);
         }
-        next_cp();
     }
-    Token::Id id = (longstr ? Token::Id::LongString : Token::Id::String);
-    Token tok(id, line_start, char_start);
-    tok.string().swap(data); //< Move data into the Token value
-    return tok;
+
+    uint32_t length = (uint32_t)(m_Strings.size() - offset);
+    return span_token(
+        (longstr ? Token::Id::LongString : Token::Id::StringValue), m_Start,
+        Token::Span{ (uint32_t)offset, length | Token::Span::Materialized });
 }
 
-Token Lexer::consume_numeric() {
-    bool exponent_present = false;
-    uint64_t whole = 0;
-    uint64_t fractional = 0;
-    uint64_t fractional_size = 1;
-    uint64_t exponent = 0;
-    Token::Id t_id = Token::Id::IntegerValue;
-    Token tok;
-    while (m_Current >= '0' && m_Current <= '9') {
-        whole = whole * 10 + (m_Current - '0');
-        next_cp();
+/**
+ * \brief Read the escape after a backslash and append its value
+ *
+ * Unknown escapes are kept as written, backslash included.
+ *
+ * \return The appended codepoint, or a utf8::Codepoint error code
+ */
+template <typename ReaderT>
+utf8::codepoint_t BasicLexer<ReaderT>::consume_escape() {
+    utf8::codepoint_t pt = m_Next;
+    if (pt == utf8::Codepoint::EndOfFile) {
+        return utf8::Codepoint::UnexpectedStringEOF;
     }
-    if (m_Current = '.') {
-        t_id = Token::Id::RealValue;
-        next_cp();
-        while (m_Current >= '0' && m_Current <= '9') {
-            fractional = fractional * 10 + (m_Current - '0');
-            fractional_size *= 10;
-            next_cp();
-        }
+    if (pt == utf8::Codepoint::Invalid) {
+        return pt;
     }
-    if (m_Current == 'e' || m_Current == 'E') {
-        exponent = true;
-        t_id = Token::Id::RealValue;
-        next_cp();
-        while (m_Next >= '0' && m_Next <= '9') {
-            exponent = exponent * 10 + (m_Next - '0');
+    if (pt == '\n' || pt == '\r') {
+        return utf8::Codepoint::UnexpectedStringEOL;
+    }
+    next_cp();
+
+    size_t digits = escape_digits(pt);
+    if (digits > 0) {
+        utf8::codepoint_t value = 0;
+        for (size_t i = 0; i < digits; ++i) {
+            int digit = hex_digit(m_Next);
+            if (digit < 0) {
+                return escape_digit_error(m_Next);
+            }
+            value = value * 16 + (utf8::codepoint_t)digit;
             next_cp();
         }
+        if (value > 0x10FFFF) {
+            return utf8::Codepoint::BadEscapeHexDigit;
+        }
+        append_string(value);
+        return value;
     }
 
-    // TODO: Type postfix specifiers
-    // TODO: Error on invalid continuation
+    utf8::codepoint_t value = escape_value(pt);
+    if (value == utf8::Codepoint::Invalid) {
+        append_string('\\');
+        value = pt;
+    }
+    append_string(value);
+    return value;
+}
 
-    tok = Token(t_id, m_StartLine, m_StartColumn);
-    if (t_id == Token::Id::IntegerValue) {
-        tok.integer() = whole;
+/**
+ * \brief Append a codepoint to the string text as UTF-8
+ */
+void LexerBase::append_string(utf8::codepoint_t pt) {
+    uint8_t bytes[4];
+    m_Strings.append((const char *)bytes, utf8::encode(pt, bytes));
+}
+
+/**
+ * \brief Read a numeric literal, the current codepoint being its first digit
+ *
+ * This follows the same rules as scan_numeric(). The text has nowhere else
+ * to live, so it is materialized for number() to decode later.
+ */
+template <typename ReaderT>
+Token BasicLexer<ReaderT>::consume_numeric() {
+    TSBL_STATS_TIME(Numeric);
+    Token::Id id = Token::Id::IntegerValue;
+    size_t offset = m_Strings.size();
+    m_Strings.push_back((char)m_Current);
+    utf8::codepoint_t prefix = (m_Current == '0' ? (m_Next | 0x20) : 0);
+    if (prefix == 'x') {
+        m_Strings.push_back((char)next_cp());
+        while (hex_digit(m_Next) >= 0) {
+            m_Strings.push_back((char)next_cp());
+        }
+    }
+    else if (prefix == 'b') {
+        m_Strings.push_back((char)next_cp());
+        while (m_Next == '0' || m_Next == '1') {
+            m_Strings.push_back((char)next_cp());
+        }
     }
     else {
-        // If we didn't get a fractional value, we have a 0 for fractional and
-        // 1 for fractional_size
-        double d = ((double)whole);
-        d += ((double)fractional) / ((double)fractional_size);
-        if (exponent_present) {
-            d = std::pow(d, exponent);
+        while (m_Next >= '0' && m_Next <= '9') {
+            m_Strings.push_back((char)next_cp());
+        }
+        if (m_Next == '.') {
+            id = Token::Id::RealValue;
+            m_Strings.push_back((char)next_cp());
+            while (m_Next >= '0' && m_Next <= '9') {
+                m_Strings.push_back((char)next_cp());
+            }
+        }
+        if (m_Next == 'e' || m_Next == 'E') {
+            id = Token::Id::RealValue;
+            m_Strings.push_back((char)next_cp());
+            if (m_Next == '+' || m_Next == '-') {
+                m_Strings.push_back((char)next_cp());
+            }
+            while (m_Next >= '0' && m_Next <= '9') {
+                m_Strings.push_back((char)next_cp());
+            }
         }
-        tok.real() = d;
     }
-    return tok;
+
+    // A type suffix, which is checked when the value is decoded
+    while (m_Next < 0x80 && (_g_ByteClass[m_Next] & BC_IdContinue)) {
+        m_Strings.push_back((char)next_cp());
+    }
+    return span_token(id, m_Start, Token::Span{ (uint32_t)offset,
+            (uint32_t)(m_Strings.size() - offset) | Token::Span::Materialized });
 }
 
-utf8::codepoint_t Lexer::consume_escape(size_t hex_digits) {
-    utf8::codepoint_t pt = 0;
-    next_cp();
-    for (size_t i = 0; i < 4; ++i) {
-        if (m_Next >= '0' && m_Next <= '9') {
-            pt = pt * 16 + (m_Next - '0');
+/**
+ * \brief Decode the value of a numeric literal
+ *
+ * Integers may be written in hex with 0x or binary with 0b. Either kind of
+ * literal may end in a type suffix: i8, i16, i32, i64, u8, u16, u32, u64,
+ * f or d. Reals are parsed with std::from_chars, so they are correctly
+ * rounded.
+ *
+ * \param text The text of the literal
+ * \param real If the literal was lexed as Token::Id::RealValue
+ * \param value Set to the integer value, or the real value for reals and
+ *     the Float and Double types
+ * \return Token::Id::IntegerValue or Token::Id::RealValue without a suffix,
+ *     or the type keyword of the suffix, Token::Id::Int8 to Token::Id::Double.
+ *     Token::Id::Invalid if the literal is malformed or does not fit.
+ */
+Token::Id LexerBase::numeric_value(std::string_view text, bool real,
+    Token::Value & value)
+{
+    const char * first = text.data();
+    const char * last = first + text.size();
+    value.integer = 0;
+
+    int base = 10;
+    if (!real && text.size() >= 2 && first[0] == '0') {
+        if ((first[1] | 0x20) == 'x') {
+            base = 16;
         }
-        else if (m_Next >= 'a' && m_Next <= 'f') {
-            pt = pt * 16 + (m_Next - 'a' + 10);
+        else if ((first[1] | 0x20) == 'b') {
+            base = 2;
         }
-        else if (m_Next >= 'A' && m_Next <= 'F') {
-            pt = pt * 16 + (m_Next - 'A' + 10);
+        first += (base == 10 ? 0 : 2);
+    }
+
+    const char * end;
+    if (real) {
+        auto result = std::from_chars(first, last, value.real);
+        if (result.ec != std::errc()) {
+            return Token::Id::Invalid;
         }
-        else {
-            if (m_Next == '\n' || m_Next == '\r') {
-                return utf8::Codepoint::UnexpectedEscapeEOL;
-            }
-            if (m_Next == utf8::Codepoint::EndOfFile) {
-                return utf8::Codepoint::UnexpectedEscapeEOF;
+        end = result.ptr;
+    }
+    else {
+        auto result = std::from_chars(first, last, value.integer, base);
+        if (result.ec != std::errc()) {
+            return Token::Id::Invalid;
+        }
+        end = result.ptr;
+    }
+
+    Token::Id type = numeric_suffix(std::string_view(end, last - end));
+    switch (type) {
+    case Token::Id::Invalid:
+        return Token::Id::Invalid;
+    case Token::Id::IntegerValue:
+        return (real ? Token::Id::RealValue : Token::Id::IntegerValue);
+    case Token::Id::Float:
+    case Token::Id::Double:
+        if (base != 10) {
+            return Token::Id::Invalid;
+        }
+        if (!real) {
+            std::from_chars(first, end, value.real);
+        }
+        if (type == Token::Id::Float) {
+            if (std::fabs(value.real) > FLT_MAX) {
+                return Token::Id::Invalid;
             }
-            return utf8::Codepoint::BadEscapeHexDigit;
+            value.real = (double)(float)value.real;
+        }
+        return type;
+    default:
+        break;
+    }
+
+    if (real || value.integer > numeric_max(type)) {
+        return Token::Id::Invalid;
+    }
+    return type;
+}
+
+/**
+ * \brief Get the type keyword a numeric suffix stands for
+ *
+ * \return The type keyword, Token::Id::IntegerValue if there is no suffix,
+ *     or Token::Id::Invalid if the suffix is not one
+ */
+Token::Id LexerBase::numeric_suffix(std::string_view suffix) {
+    static const struct {
+        const char * text;
+        Token::Id type;
+    } suffixes[] = {
+        { "i8", Token::Id::Int8 }, { "i16", Token::Id::Int16 },
+        { "i32", Token::Id::Int32 }, { "i64", Token::Id::Int64 },
+        { "u8", Token::Id::UInt8 }, { "u16", Token::Id::UInt16 },
+        { "u32", Token::Id::UInt32 }, { "u64", Token::Id::UInt64 },
+        { "f", Token::Id::Float }, { "d", Token::Id::Double }
+    };
+
+    if (suffix.empty()) {
+        return Token::Id::IntegerValue;
+    }
+    for (const auto & entry : suffixes) {
+        if (suffix == entry.text) {
+            return entry.type;
         }
     }
-    return pt;
+    return Token::Id::Invalid;
+}
+
+/**
+ * \brief Get the largest value an integer type keyword can hold
+ */
+uint64_t LexerBase::numeric_max(Token::Id type) {
+    switch (type) {
+    case Token::Id::Int8:
+        return INT8_MAX;
+    case Token::Id::Int16:
+        return INT16_MAX;
+    case Token::Id::Int32:
+        return INT32_MAX;
+    case Token::Id::Int64:
+        return INT64_MAX;
+    case Token::Id::UInt8:
+        return UINT8_MAX;
+    case Token::Id::UInt16:
+        return UINT16_MAX;
+    case Token::Id::UInt32:
+        return UINT32_MAX;
+    default:
+        return UINT64_MAX;
+    }
+}
+
+Token LexerBase::span_token(Token::Id id, size_t offset,
+    Token::Span span) const
+{
+    // Past the limit the span no longer fits, see Token::Span
+    if (span.materialized()
+        && m_Strings.size() >= Token::Span::Materialized)
+    {
+        return Token(Token::Id::Invalid, offset);
+    }
+    Token tok(id, offset);
+    tok.span() = span;
+    return tok;
+}
+
+/**
+ * \brief Get the value of a single character escape
+ *
+ * \return The value, or utf8::Codepoint::Invalid if it is not one
+ */
+utf8::codepoint_t LexerBase::escape_value(utf8::codepoint_t pt) {
+    switch (pt) {
+    case 'a':
+        return '\a';
+    case 'b':
+        return '\b';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 't':
+        return '\t';
+    case 'v':
+        return '\v';
+    case '\\':
+    case '\'':
+    case '\"':
+        return pt;
+    }
+    return utf8::Codepoint::Invalid;
+}
+
+/**
+ * \brief Get the number of hex digits a \\x, \\u or \\U escape takes
+ *
+ * \return The digit count, or 0 if this is not a hex escape
+ */
+size_t LexerBase::escape_digits(utf8::codepoint_t pt) {
+    switch (pt) {
+    case 'x':
+        return 2;
+    case 'u':
+        return 4;
+    case 'U':
+        return 8;
+    }
+    return 0;
+}
+
+int LexerBase::hex_digit(utf8::codepoint_t pt) {
+    if (pt >= '0' && pt <= '9') {
+        return (int)(pt - '0');
+    }
+    if (pt >= 'a' && pt <= 'f') {
+        return (int)(pt - 'a' + 10);
+    }
+    if (pt >= 'A' && pt <= 'F') {
+        return (int)(pt - 'A' + 10);
+    }
+    return -1;
+}
+
+/**
+ * \brief Get the error for a codepoint which should have been a hex digit
+ */
+utf8::codepoint_t LexerBase::escape_digit_error(utf8::codepoint_t pt) {
+    if (pt == '\n' || pt == '\r') {
+        return utf8::Codepoint::UnexpectedEscapeEOL;
+    }
+    if (pt == utf8::Codepoint::EndOfFile) {
+        return utf8::Codepoint::UnexpectedEscapeEOF;
+    }
+    if (pt == utf8::Codepoint::Invalid) {
+        return pt;
+    }
+    return utf8::Codepoint::BadEscapeHexDigit;
+}
+
+bool LexerBase::escape_error(utf8::codepoint_t pt) {
+    // Every utf8::Codepoint error code lies above the Unicode range
+    return pt > 0x10FFFF;
 }
 
 /**
  * \brief Generate the appropriate error Token from the given error codepoint
  * 
- * \param _line The start line number
- * \param _column The start character column
+ * \param start The byte offset of the Token which failed
+ * \param at The byte offset of whatever made it fail
  * \return A Token instance with the correct error Token::Id
  */
-Token Lexer::error(utf8::codepoint_t pt) const {
+Token LexerBase::error(utf8::codepoint_t pt, size_t start, size_t at) const {
     switch (pt) {
     case utf8::Codepoint::EndOfFile:
-        return Token(Token::Id::EndOfFile, m_StartLine, m_StartColumn);
+        return Token(Token::Id::EndOfFile, start);
     case utf8::Codepoint::Invalid:
-        return Token(Token::Id::BadEncoding, m_Line, m_CharColumn);
+        return Token(Token::Id::BadEncoding, at);
     case utf8::Codepoint::UnexpectedStringEOL:
-        return Token(Token::Id::UnexpectedEscapeEOL, m_StartLine, m_StartColumn);
+        return Token(Token::Id::UnexpectedStringEOL, start);
     case utf8::Codepoint::UnexpectedStringEOF:
-        return Token(Token::Id::UnexpectedStringEOF, m_Line, m_CharColumn);
+        return Token(Token::Id::UnexpectedStringEOF, start);
+    case utf8::Codepoint::BadEscapeHexDigit:
+        return Token(Token::Id::BadEscapeHexDigit, start);
+    case utf8::Codepoint::UnexpectedEscapeEOL:
+        return Token(Token::Id::UnexpectedEscapeEOL, start);
+    case utf8::Codepoint::UnexpectedEscapeEOF:
+        return Token(Token::Id::UnexpectedEscapeEOF, start);
     }
     // This shouldn't happen
-    return Token(Token::Id::Invalid, m_Line, m_CharColumn);
+    return Token(Token::Id::Invalid, at);
 }
 
 //===========================================================================
-// Data definitions
-static const bool _g_CategoryIdentifier[] = {
-    false, //< Not assigned
-    true,  //< Letter, Uppercase
-    true,  //< Letter, Lowercase
-    true,  //< Letter, Titlecase
-    true,  //< Letter, Modifier
-    true,  //< Letter, Other
-    true,  //< Mark, Nonspacing
-    true,  //< Mark, Spacing Combining
-    true,  //< Mark, Enclosing
-    true,  //< Number, Decimal Digit
-    true,  //< Number, Letter
-    false, //< Number, Other
-    true,  //< Punctuation, Connector
-    false, //< Punctuation, Dash
-    false, //< Punctuation, Open
-    false, //< Punctuation, Close
-    false, //< Punctuation, Initial Quote
-    false, //< Punctuation, Final Quote
-    false, //< Punctuation, Other
-    false, //< Symbol, Math
-    false, //< Symbol, Currency
-    false, //< Symbol, Modifier
-    false, //< Symbol, Other
-    false, //< Seperator, Space
-    false, //< Seperator, Line
-    false, //< Seperator, Paragraph
-    false, //< Other, Control
-    false, //< Other, Format
-    false, //< Other, Surrogate
-    false  //< Other, Private Use
-};
+// Instantiations, see BasicLexer
+template class tsbl::BasicLexer<utf8::Reader>;
+template class tsbl::BasicLexer<utf8::FileReader>;
+template class tsbl::BasicLexer<utf8::FdReader>;
+template class tsbl::BasicLexer<utf8::MappedFileReader>;
+template class tsbl::BasicLexer<utf8::StringReader>;
 
-static const bool _g_CategoryIdentifier_Start[] = {
-    false, //< Not assigned
-    true,  //< Letter, Uppercase
-    true,  //< Letter, Lowercase
-    true,  //< Letter, Titlecase
-    true,  //< Letter, Modifier
-    true,  //< Letter, Other
-    false, //< Mark, Nonspacing
-    false, //< Mark, Spacing Combining
-    false, //< Mark, Enclosing
-    false, //< Number, Decimal Digit
-    false, //< Number, Letter
-    false, //< Number, Other
-    true,  //< Punctuation, Connector
-    false, //< Punctuation, Dash
-    false, //< Punctuation, Open
-    false, //< Punctuation, Close
-    false, //< Punctuation, Initial Quote
-    false, //< Punctuation, Final Quote
-    false, //< Punctuation, Other
-    false, //< Symbol, Math
-    false, //< Symbol, Currency
-    false, //< Symbol, Modifier
-    false, //< Symbol, Other
-    false, //< Seperator, Space
-    false, //< Seperator, Line
-    false, //< Seperator, Paragraph
-    false, //< Other, Control
-    false, //< Other, Format
-    false, //< Other, Surrogate
-    false  //< Other, Private Use
+//===========================================================================
+// Data definitions
+const uint8_t _g_ByteClass[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0, NL,  0,  0, NL,  0,  0, //< 0x00
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, //< 0x10
+    SP,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, //< 0x20
+    DG, DG, DG, DG, DG, DG, DG, DG, DG, DG,  0,  0,  0,  0,  0,  0, //< 0x30
+     0, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, //< 0x40
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  0,  0,  0,  0, ID, //< 0x50
+     0, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, //< 0x60
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  0,  0,  0,  0,  0, //< 0x70
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, //< 0x80
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, //< 0x90
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, //< 0xA0
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, //< 0xB0
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, //< 0xC0
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, //< 0xD0
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, //< 0xE0
+    BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM, BM  //< 0xF0
 };
@@ -0,0 +1,204 @@
+
+#include "tsbl/lexer.hpp"
+#include "tsbl/stats.hpp"
+
+#include <stdint.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace tsbl;
+
+//< Chunks smaller than this are not worth a thread
+static const size_t _g_MinChunkSize = 256 * 1024;
+
+/**
+ * \brief Lex a whole buffer into a TokenBuffer using several threads
+ *
+ * The buffer is cut into one chunk per thread, at line starts, and every
+ * chunk is lexed at the same time as if no string was open where it starts.
+ * Only a long string can cross a line, so that guess is checked when the
+ * chunks are stitched back together: a chunk is only kept if the chunk
+ * before it really ended where it starts. Otherwise the chunk before it
+ * carries on through it, just as lexing from the start would.
+ *
+ * The result is exactly what calling next() until EndOfFile or BadEncoding
+ * would give, including the last Token. Symbols are interned in the same
+ * order, so string(), number() and symbols() work on the Tokens as usual,
+ * and the Lexer is left at the end of the buffer. The Stats counted by the
+ * other threads are added to those of the calling thread.
+ *
+ * \param data The UTF-8 data to lex, which must outlive the Tokens
+ * \param size The number of bytes in the buffer
+ * \param tokens Cleared and filled with every Token
+ * \param threads The most threads to use, 0 for one per core
+ * \return The number of Tokens lexed, 0 if the buffer is larger than
+ *     MaxSize
+ */
+size_t LexerBase::lex_parallel(const uint8_t * data, size_t size,
+    TokenBuffer & tokens, size_t threads)
+{
+    if (!read(data, size)) {
+        tokens.clear();
+        return 0;
+    }
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    size_t max_chunks = size / _g_MinChunkSize;
+    if (threads > max_chunks) {
+        threads = max_chunks;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    // Chunks start just after a \n which does not start a \n\r pair, as
+    // that is always a token boundary outside of a long string
+    std::vector<size_t> starts(1, 0);
+    for (size_t i = 1; i < threads; ++i) {
+        size_t index = size / threads * i;
+        if (index < starts.back()) {
+            index = starts.back();
+        }
+        while (index < size
+            && !(data[index - 1] == '\n' && data[index] != '\r'))
+        {
+            index += 1;
+        }
+        if (index < size && index > starts.back()) {
+            starts.push_back(index);
+        }
+    }
+    size_t count = starts.size();
+    // The last chunk runs until EndOfFile or BadEncoding
+    starts.push_back(SIZE_MAX);
+
+    // The first chunk is lexed by this Lexer, the rest by their own
+    std::vector<std::unique_ptr<LexerBase>> lexers(count);
+    std::vector<TokenBuffer> buffers(count);  //< The first is unused
+    for (size_t i = 1; i < count; ++i) {
+        lexers[i].reset(new LexerBase());
+        lexers[i]->read(data, size);
+        lexers[i]->m_Index = starts[i];
+    }
+
+    // Each worker counts on its own thread, which starts from zero
+    std::vector<Stats> stats(count);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < count; ++i) {
+        workers.emplace_back([&, i]() {
+            lexers[i]->lex_range(starts[i + 1], buffers[i]);
+            stats[i] = Stats::Get();
+        });
+    }
+    // The first chunk goes straight into the result, nothing needs fixing
+    tokens.clear();
+    lex_range(starts[1], tokens);
+    for (std::thread & worker : workers) {
+        worker.join();
+    }
+    for (size_t i = 1; i < count; ++i) {
+        Stats::Add(stats[i]);
+    }
+
+    LexerBase * current = this;
+    TokenBuffer * buffer = &tokens;
+    for (size_t i = 0;; ++i) {
+        // The guess for the next chunk was wrong, so carry on lexing
+        // through it instead
+        while (i + 1 < count && !stopped(*buffer)
+            && current->m_Index != starts[i + 1])
+        {
+            i += 1;
+            current->lex_range(starts[i + 1], *buffer);
+        }
+
+        append_chunk(*current, *buffer, tokens);
+        if (i + 1 >= count || stopped(*buffer)) {
+            break;
+        }
+        current = lexers[i + 1].get();
+        buffer = &buffers[i + 1];
+    }
+
+    m_Index = current->m_Index;
+    return tokens.size();
+}
+
+/**
+ * \brief Lex from the current index until reaching end
+ *
+ * Tokens are appended to the buffer, and the last one may run past end.
+ * This also stops after EndOfFile or BadEncoding, which is the last Token
+ * lexing would ever give.
+ */
+void LexerBase::lex_range(size_t end, TokenBuffer & tokens) {
+    while (m_Index < end) {
+        Token token = next_buffer();
+        TSBL_STATS_TOKEN(token.id());
+        tokens.push(token);
+        if (token.id() == Token::Id::EndOfFile
+            || token.id() == Token::Id::BadEncoding)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Check if a chunk ended with the last Token lexing would ever give
+ */
+bool LexerBase::stopped(const TokenBuffer & tokens) {
+    if (tokens.empty()) {
+        return false;
+    }
+    Token::Id last = tokens.id(tokens.size() - 1);
+    return (last == Token::Id::EndOfFile || last == Token::Id::BadEncoding);
+}
+
+/**
+ * \brief Append the Tokens another Lexer made for a chunk to a TokenBuffer
+ *
+ * Nothing is done for the first chunk, which was lexed into tokens.
+ * Offsets are into the same buffer so they stay as they are, but the
+ * symbols and materialized text are moved over to this Lexer.
+ */
+void LexerBase::append_chunk(LexerBase & chunk, const TokenBuffer & buffer,
+    TokenBuffer & tokens)
+{
+    if (&buffer == &tokens) {
+        return;
+    }
+
+    std::vector<SymbolTable::Symbol> symbols(chunk.m_Symbols.size());
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        std::string_view name = chunk.m_Symbols.name((SymbolTable::Symbol)i);
+        symbols[i] = m_Symbols.intern((const uint8_t *)name.data(),
+            name.size());
+    }
+    size_t offset = m_Strings.size();
+    m_Strings.append(chunk.m_Strings);
+
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        Token::Id id = buffer.id(i);
+        Token::Value value = buffer.value(i);
+        if (Token::IsSymbol(id)) {
+            value.symbol = symbols[value.symbol];
+        }
+        else if ((Token::IsString(id) || Token::IsNumeric(id))
+            && value.span.materialized())
+        {
+            // Past the limit the span no longer fits, see Token::Span
+            if (offset + value.span.offset + value.span.size()
+                >= Token::Span::Materialized)
+            {
+                tokens.push(Token(Token::Id::Invalid, buffer.offset(i)));
+                continue;
+            }
+            value.span.offset += (uint32_t)offset;
+        }
+        tokens.push(Token(id, buffer.offset(i), value));
+    }
+}
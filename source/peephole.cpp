@@ -0,0 +1,473 @@
+
+#include "tsbl/bytecode.hpp"
+
+#include <cstring>
+#include <unordered_map>
+#include "tsbl/interpreter.hpp"
+
+using namespace tsbl;
+
+namespace {
+    struct Instruction {
+        Opcode op;
+        uint16_t operands[2];
+        size_t target;  //< Where a jump lands, as an offset in the old code
+        uint32_t line;
+        bool label;     //< Jumped to, so it can only start a fusion
+    };
+
+    // What an instruction does to the stack, for constant folding
+    enum Effect {
+        Other,
+        Push,   //< Pushes a constant
+        Unary,  //< Replaces the top
+        Binary  //< Replaces the top two with one
+    };
+
+    // The typed opcodes all come after the generic ones
+    inline bool is_typed(Opcode op) {
+        return op >= Opcode::AddI8;
+    }
+
+    Effect effect(const Instruction & instruction) {
+        switch (instruction.op) {
+        case Opcode::Constant:
+        case Opcode::TypedConstant:
+        case Opcode::Null:
+        case Opcode::True:
+        case Opcode::False:
+            return Push;
+        case Opcode::Negate:
+        case Opcode::Not:
+        case Opcode::Increment:
+        case Opcode::Decrement:
+#define TSBL_UNARY(name, type) \
+        case Opcode::Neg##name: \
+        case Opcode::Unbox##name:
+        TSBL_TYPES(TSBL_UNARY)
+#undef TSBL_UNARY
+            return Unary;
+#define TSBL_BOX(name, type) \
+        case Opcode::Box##name:
+        TSBL_TYPES(TSBL_BOX)
+#undef TSBL_BOX
+            // Only a Box of the top is a unary operator
+            return (instruction.operands[0] == 0 ? Unary : Other);
+        case Opcode::Plus:
+        case Opcode::Minus:
+        case Opcode::Multiply:
+        case Opcode::Divide:
+        case Opcode::Power:
+        case Opcode::Equals:
+        case Opcode::NotEquals:
+        case Opcode::Greater:
+        case Opcode::GreaterEquals:
+        case Opcode::Less:
+        case Opcode::LessEquals:
+        case Opcode::LShift:
+        case Opcode::RShift:
+#define TSBL_BINARY(name, type) \
+        case Opcode::Add##name: \
+        case Opcode::Sub##name: \
+        case Opcode::Mul##name: \
+        case Opcode::Div##name: \
+        case Opcode::Equals##name: \
+        case Opcode::NotEquals##name: \
+        case Opcode::Greater##name: \
+        case Opcode::GreaterEquals##name: \
+        case Opcode::Less##name: \
+        case Opcode::LessEquals##name:
+        TSBL_TYPES(TSBL_BINARY)
+#undef TSBL_BINARY
+#define TSBL_SHIFT(name, type) \
+        case Opcode::Shl##name: \
+        case Opcode::Shr##name:
+        TSBL_INTEGER_TYPES(TSBL_SHIFT)
+#undef TSBL_SHIFT
+            return Binary;
+        default:
+            return Other;
+        }
+    }
+
+    // Typed operators leave a raw value, except comparisons and Box
+    bool leaves_raw(Opcode op) {
+        switch (op) {
+#define TSBL_RAW(name, type) \
+        case Opcode::Add##name: \
+        case Opcode::Sub##name: \
+        case Opcode::Mul##name: \
+        case Opcode::Div##name: \
+        case Opcode::Neg##name: \
+        case Opcode::Unbox##name:
+        TSBL_TYPES(TSBL_RAW)
+#undef TSBL_RAW
+#define TSBL_RAW_SHIFT(name, type) \
+        case Opcode::Shl##name: \
+        case Opcode::Shr##name:
+        TSBL_INTEGER_TYPES(TSBL_RAW_SHIFT)
+#undef TSBL_RAW_SHIFT
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // The superinstruction for a constant then an arithmetic operator
+    Opcode with_constant(Opcode op) {
+        switch (op) {
+        case Opcode::Plus: return Opcode::PlusConstant;
+        case Opcode::Minus: return Opcode::MinusConstant;
+        case Opcode::Multiply: return Opcode::MultiplyConstant;
+#define TSBL_WITH_CONSTANT(name, type) \
+        case Opcode::Add##name: return Opcode::AddConstant##name; \
+        case Opcode::Sub##name: return Opcode::SubConstant##name; \
+        case Opcode::Mul##name: return Opcode::MulConstant##name;
+        TSBL_TYPES(TSBL_WITH_CONSTANT)
+#undef TSBL_WITH_CONSTANT
+        default: return Opcode::_COUNT;
+        }
+    }
+
+    // The compare and branch superinstructions for a Less
+    bool less_jumps(Opcode op, Opcode & locals, Opcode & constant) {
+        switch (op) {
+        case Opcode::Less:
+            locals = Opcode::JumpIfNotLessLocals;
+            constant = Opcode::JumpIfNotLessConstant;
+            return true;
+#define TSBL_LESS_JUMPS(name, type) \
+        case Opcode::Less##name: \
+            locals = Opcode::JumpIfNotLessLocals##name; \
+            constant = Opcode::JumpIfNotLessConstant##name; \
+            return true;
+        TSBL_TYPES(TSBL_LESS_JUMPS)
+#undef TSBL_LESS_JUMPS
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * \brief Rewrites the end of the instructions as they are appended
+     *
+     * Folding runs the operators through an Interpreter, so it can never
+     * disagree with running them later. Operators which would fail are
+     * left to fail when run, on their own line.
+     */
+    class Fuser {
+    public:
+        Fuser(Chunk & chunk);
+
+        void reduce(std::vector<Instruction> & code);
+    private:
+        Chunk & m_Chunk;
+        Chunk m_Scratch;
+        Interpreter m_Interpreter;
+        std::unordered_map<int64_t, uint16_t> m_Ints;
+        std::unordered_map<uint64_t, uint16_t> m_Reals;
+        std::unordered_map<uint64_t, uint16_t> m_Typed;
+
+        bool reduce_once(std::vector<Instruction> & code);
+        bool fold(std::vector<Instruction> & code, size_t operands);
+        bool add_constant(const Value & value, uint16_t & index);
+        bool add_typed_constant(uint64_t bits, uint16_t & index);
+    };
+
+    // Replace the last count instructions by one
+    void fuse(std::vector<Instruction> & code, size_t count, Opcode op,
+        uint16_t first = 0, uint16_t second = 0)
+    {
+        Instruction fused = code[code.size() - count];
+        fused.op = op;
+        fused.operands[0] = first;
+        fused.operands[1] = second;
+        fused.target = code.back().target;
+        code.resize(code.size() - count);
+        code.push_back(fused);
+    }
+}
+
+Fuser::Fuser(Chunk & chunk) :
+    m_Chunk(chunk), m_Interpreter(8)
+{
+    for (size_t i = 0; i < chunk.constants() && i <= UINT16_MAX; ++i) {
+        const Value & value = chunk.constant(i);
+        if (value.is_int()) {
+            m_Ints.emplace(value.as_int(), (uint16_t)i);
+        }
+        else if (value.is_real()) {
+            double real = value.as_real();
+            uint64_t bits;
+            std::memcpy(&bits, &real, sizeof(bits));
+            m_Reals.emplace(bits, (uint16_t)i);
+        }
+    }
+    for (size_t i = 0; i < chunk.typed_constants() && i <= UINT16_MAX; ++i) {
+        m_Typed.emplace(chunk.typed_constant(i), (uint16_t)i);
+    }
+}
+
+/**
+ * \brief Fold and fuse the end of the code for as long as anything changes
+ */
+void Fuser::reduce(std::vector<Instruction> & code) {
+    while (reduce_once(code)) { }
+}
+
+bool Fuser::reduce_once(std::vector<Instruction> & code) {
+    size_t size = code.size();
+    // Only the first of the last count instructions may be jumped to
+    auto fusable = [&](size_t count) {
+        if (size < count) {
+            return false;
+        }
+        for (size_t i = size - count + 1; i < size; ++i) {
+            if (code[i].label) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto at = [&](size_t back) -> Instruction & {
+        return code[size - back];
+    };
+
+    if (fusable(3) && effect(at(1)) == Binary && effect(at(2)) == Push
+        && effect(at(3)) == Push && fold(code, 2))
+    {
+        return true;
+    }
+    if (fusable(2) && effect(at(1)) == Unary && effect(at(2)) == Push
+        && fold(code, 1))
+    {
+        return true;
+    }
+
+    Opcode op = at(1).op, locals, constant;
+    if (op == Opcode::Pop && fusable(2) && at(2).op == Opcode::SetLocal) {
+        fuse(code, 2, Opcode::StoreLocal, at(2).operands[0]);
+        return true;
+    }
+    if (op == Opcode::StoreLocal && fusable(3)
+        && at(3).op == Opcode::GetLocal
+        && at(3).operands[0] == at(1).operands[0]
+        && (at(2).op == Opcode::Increment || at(2).op == Opcode::Decrement))
+    {
+        fuse(code, 3, at(2).op == Opcode::Increment ? Opcode::IncrementLocal
+            : Opcode::DecrementLocal, at(1).operands[0]);
+        return true;
+    }
+    if (op == Opcode::GetLocal && fusable(2) && at(2).op == Opcode::GetLocal) {
+        fuse(code, 2, Opcode::GetLocals, at(2).operands[0],
+            at(1).operands[0]);
+        return true;
+    }
+    if (with_constant(op) != Opcode::_COUNT && fusable(2)
+        && at(2).op == (is_typed(op) ? Opcode::TypedConstant
+            : Opcode::Constant))
+    {
+        fuse(code, 2, with_constant(op), at(2).operands[0]);
+        return true;
+    }
+    if (op == Opcode::JumpIfFalse && size >= 3
+        && less_jumps(at(2).op, locals, constant))
+    {
+        if (fusable(3) && at(3).op == Opcode::GetLocals) {
+            fuse(code, 3, locals, at(3).operands[0], at(3).operands[1]);
+            return true;
+        }
+        if (fusable(4) && at(4).op == Opcode::GetLocal
+            && at(3).op == (is_typed(at(2).op) ? Opcode::TypedConstant
+                : Opcode::Constant))
+        {
+            fuse(code, 4, constant, at(4).operands[0], at(3).operands[0]);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Replace constants and the operator after them by the result
+ *
+ * \return False if the operator fails or its result is not a constant
+ */
+bool Fuser::fold(std::vector<Instruction> & code, size_t operands) {
+    const Instruction & op = code.back();
+    m_Scratch.clear();
+    for (size_t i = code.size() - 1 - operands; i < code.size() - 1; ++i) {
+        const Instruction & push = code[i];
+        if (push.op == Opcode::Constant) {
+            m_Scratch.emit(Opcode::Constant, (uint16_t)m_Scratch.add_constant(
+                m_Chunk.constant(push.operands[0])), 0);
+        }
+        else if (push.op == Opcode::TypedConstant) {
+            m_Scratch.emit(Opcode::TypedConstant,
+                (uint16_t)m_Scratch.add_typed_constant(
+                    m_Chunk.typed_constant(push.operands[0])), 0);
+        }
+        else {
+            m_Scratch.emit(push.op, 0);
+        }
+    }
+    if (Chunk::Length(op.op) == 3) {
+        m_Scratch.emit(op.op, op.operands[0], 0);
+    }
+    else {
+        m_Scratch.emit(op.op, 0);
+    }
+    m_Scratch.emit(Opcode::Return, 0);
+    if (m_Interpreter.run(m_Scratch) != Interpreter::Ok) {
+        return false;
+    }
+
+    const Value & result = m_Interpreter.result();
+    Opcode push = Opcode::Constant;
+    uint16_t index = 0;
+    if (leaves_raw(op.op)) {
+        uint64_t bits;
+        std::memcpy(&bits, (const void *)&result, sizeof(bits));
+        push = Opcode::TypedConstant;
+        if (!add_typed_constant(bits, index)) {
+            return false;
+        }
+    }
+    else if (result.is_bool()) {
+        push = (result.as_bool() ? Opcode::True : Opcode::False);
+    }
+    else if (result.is_null()) {
+        push = Opcode::Null;
+    }
+    else if (!result.is_number() || !add_constant(result, index)) {
+        return false;
+    }
+    fuse(code, operands + 1, push, index);
+    return true;
+}
+
+bool Fuser::add_constant(const Value & value, uint16_t & index) {
+    uint64_t key;
+    std::unordered_map<uint64_t, uint16_t> * reals = nullptr;
+    if (value.is_int()) {
+        auto found = m_Ints.find(value.as_int());
+        if (found != m_Ints.end()) {
+            index = found->second;
+            return true;
+        }
+    }
+    else {
+        double real = value.as_real();
+        std::memcpy(&key, &real, sizeof(key));
+        auto found = m_Reals.find(key);
+        if (found != m_Reals.end()) {
+            index = found->second;
+            return true;
+        }
+        reals = &m_Reals;
+    }
+    size_t added = m_Chunk.add_constant(value);
+    if (added > UINT16_MAX) {
+        return false;
+    }
+    index = (uint16_t)added;
+    if (reals != nullptr) {
+        reals->emplace(key, index);
+    }
+    else {
+        m_Ints.emplace(value.as_int(), index);
+    }
+    return true;
+}
+
+bool Fuser::add_typed_constant(uint64_t bits, uint16_t & index) {
+    auto found = m_Typed.find(bits);
+    if (found != m_Typed.end()) {
+        index = found->second;
+        return true;
+    }
+    size_t added = m_Chunk.add_typed_constant(bits);
+    if (added > UINT16_MAX) {
+        return false;
+    }
+    index = (uint16_t)added;
+    m_Typed.emplace(bits, index);
+    return true;
+}
+
+/**
+ * \brief Fold constants and fuse instructions into superinstructions
+ *
+ * A peephole pass over the whole code. Operators on constants are
+ * replaced by their result, and the sequences below by one instruction
+ * each, chosen as the most run in the loops of the benchmarks:
+ *
+ *     SetLocal, Pop                                  StoreLocal
+ *     GetLocal, Increment or Decrement, StoreLocal   IncrementLocal...
+ *     Constant, Plus, Minus or Multiply              PlusConstant...
+ *     GetLocal, GetLocal                             GetLocals
+ *     GetLocals, Less, JumpIfFalse                   JumpIfNotLessLocals
+ *     GetLocal, Constant, Less, JumpIfFalse          JumpIfNotLessConstant
+ *
+ * with the same for each typed operator and TypedConstant. Nothing is
+ * fused across an instruction which is jumped to. Constants no longer
+ * used are left in place.
+ */
+void Chunk::optimize() {
+    std::vector<Instruction> code;
+    std::vector<size_t> offsets;
+    std::vector<bool> labels(m_Code.size() + 1, false);
+    for (size_t offset = 0; offset < m_Code.size();) {
+        Instruction instruction = {};
+        instruction.op = (Opcode)m_Code[offset];
+        instruction.line = m_Lines[offset];
+        size_t length = Chunk::Length(instruction.op);
+        size_t end = offset + length;
+        if (Chunk::IsJump(instruction.op)) {
+            end -= 4;
+            int32_t jump;
+            std::memcpy(&jump, &m_Code[end], sizeof(jump));
+            instruction.target = offset + length + jump;
+            labels[instruction.target] = true;
+        }
+        for (size_t at = offset + 1, i = 0; at + 2 <= end; at += 2, ++i) {
+            std::memcpy(&instruction.operands[i], &m_Code[at], 2);
+        }
+        code.push_back(instruction);
+        offsets.push_back(offset);
+        offset += length;
+    }
+
+    // Where each old offset ends up in the new instructions
+    std::vector<size_t> moved(m_Code.size() + 1, 0);
+    std::vector<Instruction> fused;
+    fused.reserve(code.size());
+    Fuser fuser(*this);
+    for (size_t i = 0; i < code.size(); ++i) {
+        code[i].label = labels[offsets[i]];
+        moved[offsets[i]] = fused.size();
+        fused.push_back(code[i]);
+        fuser.reduce(fused);
+    }
+    moved[m_Code.size()] = fused.size();
+
+    std::vector<size_t> starts(fused.size() + 1, 0);
+    for (size_t i = 0; i < fused.size(); ++i) {
+        starts[i + 1] = starts[i] + Chunk::Length(fused[i].op);
+    }
+    m_Code.clear();
+    m_Lines.clear();
+    for (size_t i = 0; i < fused.size(); ++i) {
+        const Instruction & instruction = fused[i];
+        size_t length = Chunk::Length(instruction.op);
+        size_t count = (length - 1 - (Chunk::IsJump(instruction.op) ? 4 : 0))
+            / 2;
+        write(&instruction.op, 1, instruction.line);
+        write(instruction.operands, count * 2, instruction.line);
+        if (Chunk::IsJump(instruction.op)) {
+            int32_t jump = (int32_t)starts[moved[instruction.target]]
+                - (int32_t)starts[i + 1];
+            write(&jump, sizeof(jump), instruction.line);
+        }
+    }
+}
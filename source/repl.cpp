@@ -1,93 +1,260 @@
 
 #include <stdint.h>
 
+#include <cstring>
 #include <iostream>
 
+#include "tsbl/compiler.hpp"
+#include "tsbl/image.hpp"
+#include "tsbl/interpreter.hpp"
 #include "tsbl/lexer.hpp"
+#include "tsbl/stats.hpp"
+#include "tsbl/token_cache.hpp"
 #include "tsbl/utf8.hpp"
 
 using namespace tsbl;
 
 const char * _g_default_string_stream =
     "+ - *\ntrue try throw try_it identifier_1\n";
-const char * _g_hex_digits = "0123456789ABCDEF";
 
-void insert_hex_escape(std::ostream & buffer, char value) {
-    buffer << "\\x" << _g_hex_digits[value << 4] <<
-        _g_hex_digits[value & 0x0F];
-}
-
-std::ostream & repr_utf32(std::ostream & buffer, Token::U32String & u32str) {
-    char bytes[4];
-
-    for (size_t i = 0; i < u32str.length(); ++i) {
-        if (u32str[i] < 128) {
-            buffer << ((char)u32str[i]);
+/**
+ * \brief Print a batch of Tokens from a Lexer
+ *
+ * \return False once it gets to EndOfFile or an error
+ */
+bool print_tokens(const tsbl::Lexer & lexer, const TokenBuffer & tokens) {
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        Token tok = tokens.token(i);
+        if (tok.id() < 0) {
+            return false;
         }
-        else {
-            bytes[0] = u32str[i] & 0xFF;
-            bytes[1] = (u32str[i] << 8) & 0xFF;
-            bytes[2] = (u32str[i] << 16) & 0xFF;
-            bytes[3] = (u32str[i] << 24) & 0xFF;
-
-            if (bytes[0] == 0 && bytes[1] == 0) {
-                if (bytes[2] == 0) {
-                    insert_hex_escape(buffer, bytes[3]);
-                }
-                else {
-                    insert_hex_escape(buffer, bytes[2]);
-                    insert_hex_escape(buffer, bytes[3]);
-                }
-            }
-            else {
-                insert_hex_escape(buffer, bytes[0]);
-                insert_hex_escape(buffer, bytes[1]);
-                insert_hex_escape(buffer, bytes[2]);
-                insert_hex_escape(buffer, bytes[3]);
-            }
-        }
-    }
-    return buffer;
-}
-
-void lex_data(utf8::Reader & reader) {
-    tsbl::Lexer lexer;
-    lexer.read(reader);
-    Token tok;
-    std::cout << "Token Stream:" << std::endl;
-    while ((tok = lexer.next()).id() >= 0) {
         std::cout << "  " << Token::Name(tok.id());
         if (Token::IsString(tok.id())) {
-            std::cout << ": ";
-            repr_utf32(std::cout, tok.string());
+            std::cout << ": " << lexer.string(tok);
         }
-        else {
-            switch (tok.id()) {
-            case Token::IntegerValue:
-                std::cout << tok.integer();
+        else if (Token::IsSymbol(tok.id())) {
+            std::cout << ": " << lexer.symbols().name(tok.symbol());
+        }
+        else if (Token::IsNumeric(tok.id())) {
+            Token::Value value;
+            Token::Id type = lexer.number(tok, value);
+            std::cout << ": ";
+            switch (type) {
+            case Token::Invalid:
+                std::cout << "invalid " << lexer.string(tok);
                 break;
             case Token::RealValue:
-                std::cout << tok.real();
+            case Token::Float:
+            case Token::Double:
+                std::cout << value.real;
                 break;
             default:
+                std::cout << value.integer;
                 break;
             }
+            if (type != Token::IntegerValue && type != Token::RealValue) {
+                std::cout << " (" << Token::Name(type) << ")";
+            }
         }
         std::cout << std::endl;
     }
+    return true;
+}
+
+void lex_data(tsbl::Lexer & lexer, size_t batch = 256) {
+    TokenBuffer tokens(batch);
+    std::cout << "Token Stream:" << std::endl;
+    while (lexer.next_batch(tokens, batch) > 0) {
+        if (!print_tokens(lexer, tokens)) {
+            return;
+        }
+    }
+}
+
+/**
+ * \brief Get every Token of a buffer through the TokenCache in a directory
+ *
+ * On a warm start the Tokens come straight out of the cache and nothing is
+ * lexed. Otherwise the buffer is lexed and stored for next time, and a
+ * cache which cannot be written only costs the next start.
+ */
+void lex_cached(tsbl::Lexer & lexer, const uint8_t * data, size_t size,
+    const char * directory, TokenBuffer & tokens)
+{
+    TokenCache cache(directory);
+    if (cache.load(data, size)) {
+        lexer.load(data, size, cache, tokens);
+        return;
+    }
+    lexer.lex_parallel(data, size, tokens);
+    cache.store(data, size, lexer, tokens);
+}
+
+int run_program(const Program & program) {
+    Interpreter interpreter;
+    Interpreter::Status status = interpreter.run(program);
+    if (status != Interpreter::Ok) {
+        std::cout << Interpreter::Name(status) << " on line "
+            << interpreter.error_line() + 1 << std::endl;
+        return 1;
+    }
+    std::cout << interpreter.result().to_string() << std::endl;
+    return 0;
+}
+
+/**
+ * \brief Compile and run a program, storing it as an Image first if asked
+ */
+int run_data(Compiler & compiler, Chunk & chunk, const char * image) {
+    if (!compiler.compile()) {
+        std::cout << "Error at " << compiler.error_line() + 1 << ":"
+            << compiler.error_column() << ": " << compiler.error()
+            << std::endl;
+        return 1;
+    }
+    chunk.optimize();
+    if (image != nullptr && !Image::Store(chunk, image)) {
+        std::cout << "Could not write the image " << image << std::endl;
+        return 1;
+    }
+    return run_program(chunk.program());
+}
+
+/**
+ * \brief Print the Stats of this thread, see --stats
+ */
+void print_stats() {
+    if (!Stats::Enabled) {
+        std::cout << "Stats are not counted, build with TSBL_STATS"
+            << std::endl;
+        return;
+    }
+    Stats stats = Stats::Get();
+    std::cout << "Stats:" << std::endl;
+    std::cout << "  codepoints: " << stats.codepoints << std::endl;
+    std::cout << "  refills: " << stats.refills << std::endl;
+    std::cout << "  allocations: " << stats.allocations << std::endl;
+    std::cout << "  tokens: " << stats.token_total() << std::endl;
+    for (int32_t id = -Stats::ErrorIds; id < Token::Id::_COUNT; ++id) {
+        uint64_t count = stats.token_count((Token::Id)id);
+        if (count > 0) {
+            std::cout << "    " << Token::Name((Token::Id)id) << ": "
+                << count << std::endl;
+        }
+    }
+    std::cout << "  cycles:" << std::endl;
+    for (int phase = 0; phase < Stats::Phase::_COUNT; ++phase) {
+        std::cout << "    " << Stats::Name((Stats::Phase)phase) << ": "
+            << stats.cycles[phase] << std::endl;
+    }
 }
 
 int main(int argc, char **argv) {
+    // --stats prints the Stats at the end, --cache DIR keeps the Tokens of
+    // files in DIR to skip lexing them next time and --image FILE stores
+    // what --run compiles, for --exec to run. They come before everything
+    // else.
+    bool stats = false;
+    const char * cache = nullptr;
+    const char * image = nullptr;
+    for (;;) {
+        if (argc > 1 && std::strcmp(argv[1], "--stats") == 0) {
+            stats = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (argc > 2 && std::strcmp(argv[1], "--cache") == 0) {
+            cache = argv[2];
+            argc -= 2;
+            argv += 2;
+        }
+        else if (argc > 2 && std::strcmp(argv[1], "--image") == 0) {
+            image = argv[2];
+            argc -= 2;
+            argv += 2;
+        }
+        else {
+            break;
+        }
+    }
+
+    tsbl::Lexer lexer;
+    int result = 0;
     if (argc <= 1) {
         std::cout << "Running program with default string buffer" << std::endl;
         utf8::StringReader sr((uint8_t *)_g_default_string_stream);
-        lex_data(sr);
+        lexer.read(sr);
+        lex_data(lexer);
+    }
+    else if (std::strcmp(argv[1], "--run") == 0 && argc > 2) {
+        // Compile and run the file, printing what it returns
+        utf8::MappedFileReader fr(argv[2]);
+        Chunk chunk;
+        if (!fr.is_open()) {
+            // The Reader has already said it could not map the file
+            result = 1;
+        }
+        else if (fr.size() > LexerBase::MaxSize) {
+            std::cout << "File is too large: " << argv[2] << std::endl;
+            result = 1;
+        }
+        else if (cache != nullptr) {
+            TokenBuffer tokens;
+            lex_cached(lexer, fr.data(), fr.size(), cache, tokens);
+            Compiler compiler(lexer, tokens, chunk);
+            result = run_data(compiler, chunk, image);
+        }
+        else {
+            lexer.read(fr.data(), fr.size());
+            Compiler compiler(lexer, chunk);
+            result = run_data(compiler, chunk, image);
+        }
+    }
+    else if (std::strcmp(argv[1], "--exec") == 0 && argc > 2) {
+        // Run an Image straight out of the mapped pages
+        Image program;
+        if (!program.load(argv[2])) {
+            std::cout << "Not an image this build can run: " << argv[2]
+                << std::endl;
+            result = 1;
+        }
+        else {
+            result = run_program(program.program());
+        }
+    }
+    else if (std::strcmp(argv[1], "-") == 0) {
+        std::cout << "Running program from stdin" << std::endl;
+        // Print each Token as soon as the bytes for it arrive
+        utf8::FdReader fr(0);
+        lexer.read(fr);
+        lex_data(lexer, 1);
     }
     else {
         std::cout << "Running program with file " << argv[1] << std::endl;
-        utf8::FileReader fr(argv[1]);
-        lex_data(fr);
+        // Lex straight out of the mapped pages
+        utf8::MappedFileReader fr(argv[1]);
+        if (!fr.is_open()) {
+            // The Reader has already said it could not map the file
+            result = 1;
+        }
+        else if (fr.size() > LexerBase::MaxSize) {
+            std::cout << "File is too large: " << argv[1] << std::endl;
+            result = 1;
+        }
+        else if (cache != nullptr) {
+            TokenBuffer tokens;
+            lex_cached(lexer, fr.data(), fr.size(), cache, tokens);
+            std::cout << "Token Stream:" << std::endl;
+            print_tokens(lexer, tokens);
+        }
+        else {
+            lexer.read(fr.data(), fr.size());
+            lex_data(lexer);
+        }
     }
-    
-    return 0;
+
+    if (stats) {
+        print_stats();
+    }
+    return result;
 }
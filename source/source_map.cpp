@@ -0,0 +1,148 @@
+
+#include "tsbl/source_map.hpp"
+
+#include <algorithm>
+#include "tsbl/utf8.hpp"
+
+using namespace tsbl;
+
+SourceMap::SourceMap() :
+    m_Data(nullptr), m_Size(0), m_Lines(1, 0), m_Scanned(true)
+{ }
+
+SourceMap::~SourceMap() { }
+
+/**
+ * \brief Map the lines of a buffer of UTF-8 text
+ *
+ * Nothing is scanned until a line is asked for. The buffer must outlive
+ * the SourceMap, or at least every question asked of it.
+ */
+void SourceMap::read(const uint8_t * data, size_t size) {
+    m_Data = data;
+    m_Size = size;
+    m_Lines.assign(1, 0);
+    m_Scanned = false;
+    m_Skews.clear();
+}
+
+/**
+ * \brief Forget the text, for lines and codepoints to be added one by one
+ */
+void SourceMap::clear() {
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Lines.assign(1, 0);
+    m_Scanned = true;
+    m_Skews.clear();
+}
+
+/**
+ * \brief Note that a line starts at a byte offset, when there is no text
+ *
+ * Lines have to be added in order.
+ */
+void SourceMap::add_line(size_t offset) {
+    m_Lines.push_back((uint32_t)offset);
+}
+
+/**
+ * \brief Note how many bytes before an offset are not the first of their
+ * codepoint, when there is no text
+ *
+ * These are what tell byte offsets from columns. They have to be added in
+ * order, and only a change from the last is kept.
+ */
+void SourceMap::add_skew(size_t offset, size_t skew) {
+    if ((m_Skews.empty() ? 0 : m_Skews.back().skew) != skew) {
+        m_Skews.push_back(Skew{ (uint32_t)offset, (uint32_t)skew });
+    }
+}
+
+/**
+ * \brief Get the number of lines known, at least 1
+ */
+size_t SourceMap::lines() const {
+    scan();
+    return m_Lines.size();
+}
+
+/**
+ * \brief Get the byte offset a line starts at
+ *
+ * \param line A line below lines()
+ */
+size_t SourceMap::line_start(size_t line) const {
+    scan();
+    return m_Lines[line];
+}
+
+/**
+ * \brief Get the line a byte offset is on
+ *
+ * A binary search over the line starts, so O(log lines).
+ */
+size_t SourceMap::line(size_t offset) const {
+    scan();
+    auto after = std::upper_bound(m_Lines.begin(), m_Lines.end(),
+        (uint32_t)offset);
+    return (size_t)(after - m_Lines.begin()) - 1;
+}
+
+/**
+ * \brief Get the 1-based codepoint column of a byte offset
+ *
+ * With the text, the codepoints from the start of the line are counted,
+ * which only has to look at lead bytes. Without it, the skew gained since
+ * the start of the line is taken off.
+ */
+size_t SourceMap::column(size_t offset) const {
+    size_t start = m_Lines[line(offset)];
+    if (m_Data == nullptr) {
+        return offset - start - (skew(offset) - skew(start)) + 1;
+    }
+    size_t column = 1;
+    for (size_t i = start; i < offset && i < m_Size; ++i) {
+        column += ((m_Data[i] & 0xC0) != 0x80);
+    }
+    return column;
+}
+
+/**
+ * \brief Find every line start in the text, if it has not been done
+ *
+ * utf8::find_line_break() skips from one \n or \r to the next a vector at
+ * a time. A \r straight after a \n is part of the same line break.
+ */
+void SourceMap::scan() const {
+    if (m_Scanned) {
+        return;
+    }
+    m_Scanned = true;
+    size_t index = 0;
+    for (;;) {
+        index += utf8::find_line_break(m_Data + index, m_Size - index);
+        if (index >= m_Size) {
+            break;
+        }
+        uint8_t byte = m_Data[index++];
+        if (byte == '\n' && index < m_Size && m_Data[index] == '\r') {
+            index += 1;
+        }
+        m_Lines.push_back((uint32_t)index);
+    }
+}
+
+/**
+ * \brief Get the skew last added at or before an offset
+ */
+size_t SourceMap::skew(size_t offset) const {
+    auto after = std::upper_bound(m_Skews.begin(), m_Skews.end(),
+        (uint32_t)offset, [](uint32_t value, const Skew & skew) {
+            return value < skew.offset;
+        });
+    if (after == m_Skews.begin()) {
+        return 0;
+    }
+    return (after - 1)->skew;
+}
@@ -0,0 +1,94 @@
+
+#include "tsbl/stats.hpp"
+
+using namespace tsbl;
+
+static_assert(-(int32_t)Token::Id::UnexpectedEscapeEOF == Stats::ErrorIds,
+    "Stats::ErrorIds must cover every error Token::Id");
+
+extern const char * _g_PhaseNames[];
+
+#if TSBL_STATS
+thread_local Stats tsbl::_g_Stats;
+#endif
+
+/**
+ * \brief Get how many Tokens with an Id were lexed
+ */
+uint64_t Stats::token_count(Token::Id id) const {
+    int32_t index = (int32_t)id + Stats::ErrorIds;
+    if (index < 0 || (size_t)index >= Stats::TokenIds) {
+        return 0;
+    }
+    return tokens[index];
+}
+
+/**
+ * \brief Get how many Tokens were lexed, errors included
+ */
+uint64_t Stats::token_total() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < Stats::TokenIds; ++i) {
+        total += tokens[i];
+    }
+    return total;
+}
+
+/**
+ * \brief Get the counters of the calling thread
+ *
+ * Counting carries on from where it was, so take a snapshot before and
+ * after some work, or Reset() first.
+ */
+Stats Stats::Get() {
+#if TSBL_STATS
+    return _g_Stats;
+#else
+    return Stats{};
+#endif
+}
+
+/**
+ * \brief Set the counters of the calling thread back to 0
+ */
+void Stats::Reset() {
+#if TSBL_STATS
+    _g_Stats = Stats{};
+#endif
+}
+
+/**
+ * \brief Add counters taken on another thread to those of the calling
+ * thread
+ */
+void Stats::Add(const Stats & stats) {
+#if TSBL_STATS
+    _g_Stats.codepoints += stats.codepoints;
+    _g_Stats.refills += stats.refills;
+    _g_Stats.allocations += stats.allocations;
+    for (size_t i = 0; i < Stats::TokenIds; ++i) {
+        _g_Stats.tokens[i] += stats.tokens[i];
+    }
+    for (size_t i = 0; i < Stats::Phase::_COUNT; ++i) {
+        _g_Stats.cycles[i] += stats.cycles[i];
+    }
+#else
+    (void)stats;
+#endif
+}
+
+/**
+ * \brief Get the name of a Stats::Phase
+ */
+const char * Stats::Name(Stats::Phase phase) {
+    if (phase < 0 || phase >= Stats::Phase::_COUNT) {
+        return "unknown";
+    }
+    return _g_PhaseNames[phase];
+}
+
+//===========================================================================
+// Data definitions
+const char * _g_PhaseNames[] = {
+    "whitespace", "identifier", "string", "numeric"
+};
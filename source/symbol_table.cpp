@@ -0,0 +1,120 @@
+
+#include "tsbl/symbol_table.hpp"
+
+#include <cstring>
+
+using namespace tsbl;
+
+const SymbolTable::Symbol SymbolTable::Invalid;
+
+SymbolTable::SymbolTable() :
+    m_Slots(64, 0)
+{ }
+
+SymbolTable::SymbolTable(Arena & arena) :
+    m_Text(ArenaAllocator<char>(arena)),
+    m_Entries(ArenaAllocator<Entry>(arena)),
+    m_Slots(64, 0, ArenaAllocator<uint32_t>(arena))
+{ }
+
+SymbolTable::~SymbolTable() { }
+
+/**
+ * \brief Get the Symbol for a name, adding the name if it is new
+ *
+ * \param data The UTF-8 text of the name
+ * \param size The length of the name in bytes
+ * \return The Symbol of the name
+ */
+SymbolTable::Symbol SymbolTable::intern(const uint8_t * data, size_t size) {
+    uint32_t h = hash(data, size);
+    size_t index = slot(h, data, size);
+    if (m_Slots[index] != 0) {
+        return m_Slots[index] - 1;
+    }
+
+    Symbol symbol = (Symbol)m_Entries.size();
+    m_Entries.push_back(Entry{ (uint32_t)m_Text.size(), (uint32_t)size, h });
+    m_Text.append((const char *)data, size);
+    m_Slots[index] = symbol + 1;
+
+    // Keep the load factor at or below one half so probes stay short
+    if (m_Entries.size() * 2 > m_Slots.size()) {
+        grow();
+    }
+    return symbol;
+}
+
+/**
+ * \brief Get the Symbol for a name without adding it
+ *
+ * \return The Symbol of the name, or SymbolTable::Invalid
+ */
+SymbolTable::Symbol SymbolTable::find(const uint8_t * data, size_t size) const
+{
+    size_t index = slot(hash(data, size), data, size);
+    return m_Slots[index] - 1;
+}
+
+/**
+ * \brief Get the UTF-8 text of a Symbol
+ *
+ * The view stays valid until the next call to intern() or clear().
+ */
+std::string_view SymbolTable::name(SymbolTable::Symbol symbol) const {
+    const Entry & entry = m_Entries[symbol];
+    return std::string_view(m_Text.data() + entry.offset, entry.length);
+}
+
+size_t SymbolTable::size() const {
+    return m_Entries.size();
+}
+
+void SymbolTable::clear() {
+    m_Text.clear();
+    m_Entries.clear();
+    m_Slots.assign(64, 0);
+}
+
+uint32_t SymbolTable::hash(const uint8_t * data, size_t size) {
+    // FNV-1a, which is cheap for the short names identifiers tend to be
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * \brief Find the slot holding a name, or the empty slot it would go in
+ */
+size_t SymbolTable::slot(uint32_t h, const uint8_t * data, size_t size) const
+{
+    size_t mask = m_Slots.size() - 1;
+    for (size_t index = h & mask;; index = (index + 1) & mask) {
+        uint32_t value = m_Slots[index];
+        if (value == 0) {
+            return index;
+        }
+        const Entry & entry = m_Entries[value - 1];
+        if (entry.hash == h && entry.length == size
+            && std::memcmp(m_Text.data() + entry.offset, data, size) == 0)
+        {
+            return index;
+        }
+    }
+}
+
+void SymbolTable::grow() {
+    ArenaVector<uint32_t> slots(m_Slots.size() * 2, 0,
+        m_Slots.get_allocator());
+    size_t mask = slots.size() - 1;
+    for (size_t symbol = 0; symbol < m_Entries.size(); ++symbol) {
+        size_t index = m_Entries[symbol].hash & mask;
+        while (slots[index] != 0) {
+            index = (index + 1) & mask;
+        }
+        slots[index] = (uint32_t)symbol + 1;
+    }
+    m_Slots.swap(slots);
+}
@@ -3,7 +3,6 @@
 
 using namespace tsbl;
 
-extern const char * _g_TokenName[];
 extern const char32_t * _g_TokenName32[];
 
 /**
@@ -14,16 +13,32 @@ extern const char32_t * _g_TokenName32[];
  */
 const char * Token::Name(Token::Id id) {
     if (id < 0) {
-        if (id == Token::Id::EndOfFile) {
+        switch (id) {
+        case Token::Id::Invalid:
+            return "Invalid";
+        case Token::Id::EndOfFile:
             return "EOF";
+        case Token::Id::BadEncoding:
+            return "BadEncoding";
+        case Token::Id::UnexpectedStringEOL:
+            return "UnexpectedStringEOL";
+        case Token::Id::UnexpectedStringEOF:
+            return "UnexpectedStringEOF";
+        case Token::Id::BadEscapeHexDigit:
+            return "BadEscapeHexDigit";
+        case Token::Id::UnexpectedEscapeEOL:
+            return "UnexpectedEscapeEOL";
+        case Token::Id::UnexpectedEscapeEOF:
+            return "UnexpectedEscapeEOF";
+        default:
+            return "BadTokenId";
         }
-        return "BadEncoding";
     }
     if (id >= Token::Id::_COUNT) {
         return "BadTokenId";
     }
 
-    return _g_TokenName[id];
+    return TokenNames[id];
 }
 
 /**
@@ -49,7 +64,7 @@ const char32_t * Token::Name32(Token::Id id) {
  * \breif Create a new default token
  */
 Token::Token() :
-    m_Line(0), m_Column(0), m_Id(Token::Id::Invalid)
+    m_Offset(0), m_Id((int8_t)Token::Id::Invalid)
 {
     m_Data.integer = 0;
 }
@@ -58,206 +73,38 @@ Token::Token() :
  * \brief Create a new Token
  * 
  * \param id The Token::Id of the new Token
- * \param line_no The line number of the start of the token
- * \param column The character column of the start of the token
+ * \param offset The byte offset of the start of the token, see SourceMap
  */
-Token::Token(Token::Id id, size_t line_no, size_t column) :
-    m_Line(line_no), m_Column(column), m_Id(id)
+Token::Token(Token::Id id, size_t offset) :
+    m_Offset((uint32_t)offset),
+    m_Id((int8_t)id)
 {
     switch (id) {
-    case Token::Id::Identifier:
-    case Token::Id::String:
-    case Token::Id::LongString:
-        m_Data.str_ptr = new Token::U32String();
-        break;
     case Token::Id::RealValue:
         m_Data.real = 0.0;
         break;
-    case Token::Id::IntegerValue:
-    default:
-        m_Data.integer = 0;
-    }
-}
-
-/**
- * \brief Create a copy of the given Token
- * 
- * If the source Token instance has a value, the newly created Token instance
- * will have a copy of that value.
- * 
- * \param source The Token instance to copy
- */
-Token::Token(const Token & source) :
-    m_Line(source.line()), m_Column(source.column()), m_Id(source.id())
-{
-    switch (m_Id) {
-    case Token::Id::Identifier:
-    case Token::Id::String:
-    case Token::Id::LongString:
-        m_Data.str_ptr = new Token::U32String(*source.m_Data.str_ptr);
-        break;
-    case Token::Id::RealValue:
-        m_Data.real = source.m_Data.real;
-        break;
-    case Token::Id::IntegerValue:
-        m_Data.integer = source.m_Data.integer;
-        break;
-    default:
-        m_Data.integer = 0;
-    }
-}
-
-/**
- * \brief Move construct a Token instance
- * 
- * This constructor will appropriate any value stored in the rval reference
- * passed to the constructor.
- * 
- * \param source The source Token instance to move data from
- */
-Token::Token(Token && source) :
-    m_Line(source.line()), m_Column(source.column()), m_Id(source.id())
-{
-    switch (m_Id) {
     case Token::Id::Identifier:
-    case Token::Id::String:
-    case Token::Id::LongString:
-        m_Data.str_ptr = source.m_Data.str_ptr;
-        source.m_Data.str_ptr = nullptr;
-        break;
-    case Token::Id::IntegerValue:
-        m_Data.integer = source.m_Data.integer;
-        break;
-    case Token::Id::RealValue:
-        m_Data.real = source.m_Data.real;
-        break;
-    default:
         m_Data.integer = 0;
-    }
-}
-
-/**
- * \brief Destroy the Token
- * 
- * If the Token still has a value(), the value is destroyed. Use take_value()
- * to move a value out of a token before it is deconstructed.
- */
-Token::~Token() {
-    if(Token::IsString(m_Id) && m_Data.str_ptr != nullptr) {
-        delete m_Data.str_ptr;
-        m_Data.str_ptr = nullptr;
-    }
-}
-
-/**
- * \brief Copy the given Token instance
- * 
- * If the source Token instance has a value and this one does not, this
- * Token instance will create a new value string and copy the source's value.
- * If the source Token instance has a value and this one does as well, this
- * Token instance will replace the value stored in it's value string with a
- * copy of the source's value.
- * 
- * \param source The source Token instance to copy
- * \return A reference to this token
- */
-Token & Token::operator=(const Token & source) {
-    auto old_id = m_Id;
-
-    m_Line = source.line();
-    m_Column = source.column();
-    m_Id = source.id();
-    switch (m_Id) {
-    case Token::Id::Identifier:
-    case Token::Id::String:
-    case Token::Id::LongString:
-        if(Token::IsString(old_id) && m_Data.str_ptr != nullptr) {
-            *m_Data.str_ptr = *source.m_Data.str_ptr;
-        }
-        else {
-            m_Data.str_ptr = new Token::U32String(*source.m_Data.str_ptr);
-        }
+        m_Data.symbol = SymbolTable::Invalid;
         break;
     case Token::Id::IntegerValue:
-        if(Token::IsString(old_id) && m_Data.str_ptr != nullptr) {
-            delete m_Data.str_ptr;
-        }
-        m_Data.integer = source.m_Data.integer;
-        break;
-    case Token::Id::RealValue:
-        if(Token::IsString(old_id) && m_Data.str_ptr != nullptr) {
-            delete m_Data.str_ptr;
-        }
-        m_Data.real = source.m_Data.real;
-        break;
     default:
-        if(Token::IsString(old_id) && m_Data.str_ptr != nullptr) {
-            delete m_Data.str_ptr;
-        }
         m_Data.integer = 0;
     }
-    return *this;
 }
 
 /**
- * \brief Move the given Token value into this Token
- * 
- * \param source The Token instance to move
+ * \brief Create a new Token with a value
+ *
+ * \param id The Token::Id of the new Token
+ * \param offset The byte offset of the start of the token, see SourceMap
+ * \param value The value of the Token, as given by value()
  */
-Token & Token::operator=(Token && source) {
-    auto old_id = m_Id;
-    Token::U32String * source_string;
-    m_Line = source.line();
-    m_Column = source.column();
-    m_Id = source.id();
-    switch (m_Id) {
-    case Token::Id::Identifier:
-    case Token::Id::String:
-    case Token::Id::LongString:
-        if(Token::IsString(old_id)) {
-            source_string = source.m_Data.str_ptr;
-            source.m_Data.str_ptr = m_Data.str_ptr;
-            m_Data.str_ptr = source_string;
-        }
-        else {
-            m_Data.str_ptr = source.m_Data.str_ptr;
-            source.m_Data.str_ptr = nullptr;
-        }
-        break;
-    case Token::Id::RealValue:
-        if (Token::IsString(old_id) && m_Data.str_ptr != nullptr) {
-            delete m_Data.str_ptr;
-        }
-        m_Data.real = source.m_Data.real;
-        break;
-    case Token::Id::IntegerValue:
-        if (Token::IsString(old_id) && m_Data.str_ptr != nullptr) {
-            delete m_Data.str_ptr;
-        }
-        m_Data.integer = source.m_Data.integer;
-        break;
-    default:
-        if (Token::IsString(old_id) && m_Data.str_ptr != nullptr) {
-            delete m_Data.str_ptr;
-        }
-        m_Data.integer = 0;
-    }
-    return *this;
-}
-
-Token::U32String * Token::take_string() {
-    Token::U32String * strptr = m_Data.str_ptr;
-    m_Data.str_ptr = nullptr;
-    return strptr;
-}
-
-Token::U32String & Token::string() {
-    return *m_Data.str_ptr;
-}
-
-const Token::U32String & Token::string() const {
-    return *m_Data.str_ptr;
-}
+Token::Token(Token::Id id, size_t offset, const Token::Value & value) :
+    m_Offset((uint32_t)offset),
+    m_Id((int8_t)id),
+    m_Data(value)
+{ }
 
 uint64_t & Token::integer() {
     return m_Data.integer;
@@ -275,45 +122,46 @@ const double & Token::real() const {
     return m_Data.real;
 }
 
-Token::Id Token::id() const {
-    return m_Id;
+SymbolTable::Symbol & Token::symbol() {
+    return m_Data.symbol;
 }
 
-size_t Token::line() const {
-    return m_Line;
+const SymbolTable::Symbol & Token::symbol() const {
+    return m_Data.symbol;
 }
 
-size_t Token::column() const {
-    return m_Column;
+Token::Span & Token::span() {
+    return m_Data.span;
 }
 
-const char * Token::name() const {
-    return Token::Name(m_Id);
+const Token::Span & Token::span() const {
+    return m_Data.span;
 }
 
-//===========================================================================
-// Data definitions
-static const char * _g_TokenName[] = {
-    "\\n",
-
-    "+", "++", "-", "--", "/", "*", "**", "(", ")", "[", "]", "{", "}", ".",
-    "=", "!", "==", "!=", ">", ">=", "<", "<=", ">>", "<<",
-
-    "true", "false", "null",
-
-    "int8", "int16", "int32", "int64", "uint8", "uint16", "uint32", "uint64",
-    "float", "double", "char", "string",
+const Token::Value & Token::value() const {
+    return m_Data;
+}
 
-    "struct", "class", "public", "private", "protected", "super", "def",
-    "return", "pure", "for", "while", "if", "else", "elif", "switch", "break",
-    "continue",
+Token::Id Token::id() const {
+    return (Token::Id)m_Id;
+}
 
-    "try", "catch", "throw",
+/**
+ * \brief Get the byte offset the Token starts at
+ *
+ * SourceMap turns it into a line and column.
+ */
+size_t Token::offset() const {
+    return m_Offset;
+}
 
-    "int", "float", "string", "docstring", "identifier"
-};
+const char * Token::name() const {
+    return Token::Name(id());
+}
 
-static const char32_t * _g_TokenName32[] = {
+//===========================================================================
+// Data definitions
+const char32_t * _g_TokenName32[] = {
     U"\\n",
 
     U"+", U"++", U"-", U"--", U"/", U"*", U"**", U"(", U")", U"[", U"]", U"{",
@@ -0,0 +1,113 @@
+
+#include "tsbl/token_buffer.hpp"
+
+#include <cstring>
+
+using namespace tsbl;
+
+TokenBuffer::TokenBuffer() :
+    m_Size(0)
+{ }
+
+/**
+ * \brief Create a TokenBuffer with room for a number of Tokens
+ */
+TokenBuffer::TokenBuffer(size_t capacity) :
+    m_Size(0)
+{
+    reserve(capacity);
+}
+
+TokenBuffer::~TokenBuffer() { }
+
+/**
+ * \brief Append a Token, growing the buffer if it is full
+ */
+void TokenBuffer::push(const Token & token) {
+    if (m_Size == m_Ids.size()) {
+        reserve(m_Size < 64 ? 64 : m_Size * 2);
+    }
+    m_Ids[m_Size] = (int8_t)token.m_Id;
+    m_Offsets[m_Size] = token.m_Offset;
+    m_Values[m_Size] = token.m_Data;
+    m_Size += 1;
+}
+
+/**
+ * \brief Append a run of Tokens given as parallel arrays, like those of
+ * ids(), offsets() and values()
+ */
+void TokenBuffer::append(const int8_t * ids, const uint32_t * offsets,
+    const Token::Value * values, size_t count)
+{
+    reserve(m_Size + count);
+    std::memcpy(m_Ids.data() + m_Size, ids, count * sizeof(*ids));
+    std::memcpy(m_Offsets.data() + m_Size, offsets,
+        count * sizeof(*offsets));
+    std::memcpy(m_Values.data() + m_Size, values, count * sizeof(*values));
+    m_Size += count;
+}
+
+/**
+ * \brief Make room for at least capacity Tokens
+ *
+ * The buffer never shrinks, so a buffer reused across batches only
+ * allocates while it is growing to the largest batch.
+ */
+void TokenBuffer::reserve(size_t capacity) {
+    if (capacity > m_Ids.size()) {
+        m_Ids.resize(capacity);
+        m_Offsets.resize(capacity);
+        m_Values.resize(capacity);
+    }
+}
+
+/**
+ * \brief Remove every Token, keeping the capacity
+ */
+void TokenBuffer::clear() {
+    m_Size = 0;
+}
+
+size_t TokenBuffer::size() const {
+    return m_Size;
+}
+
+size_t TokenBuffer::capacity() const {
+    return m_Ids.size();
+}
+
+bool TokenBuffer::empty() const {
+    return m_Size == 0;
+}
+
+Token::Id TokenBuffer::id(size_t index) const {
+    return (Token::Id)m_Ids[index];
+}
+
+size_t TokenBuffer::offset(size_t index) const {
+    return m_Offsets[index];
+}
+
+const Token::Value & TokenBuffer::value(size_t index) const {
+    return m_Values[index];
+}
+
+/**
+ * \brief Put the Token at index back together
+ */
+Token TokenBuffer::token(size_t index) const {
+    return Token((Token::Id)m_Ids[index], m_Offsets[index], m_Values[index]);
+}
+
+const int8_t * TokenBuffer::ids() const {
+    return m_Ids.data();
+}
+
+const uint32_t * TokenBuffer::offsets() const {
+    return m_Offsets.data();
+}
+
+const Token::Value * TokenBuffer::values() const {
+    return m_Values.data();
+}
@@ -0,0 +1,538 @@
+
+#include "tsbl/token_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace tsbl;
+
+namespace {
+    /**
+     * \brief The start of every cache file
+     *
+     * The sections follow it in this order, each straight after the last:
+     * the Token::Value of every Token, the offset of every Token, the end of
+     * every symbol name, the Token::Id of every Token, the symbol names and
+     * the materialized text. Largest first keeps each of them aligned.
+     */
+    struct CacheHeader {
+        char magic[8];         //< _g_CacheMagic
+        uint32_t version;      //< TokenCache::Version
+        uint16_t ids;          //< Token::Id::_COUNT
+        uint16_t value_size;   //< sizeof(Token::Value)
+        uint64_t hash;         //< TokenCache::Hash() of the source
+        uint64_t source_size;
+        uint64_t end;          //< Lexer index after the last Token
+        uint64_t tokens;
+        uint64_t symbols;
+        uint64_t names_size;
+        uint64_t strings_size;
+    };
+
+    static_assert(sizeof(CacheHeader) % 8 == 0,
+        "The Token::Value section must stay aligned");
+}
+
+extern const char _g_CacheMagic[8];
+
+TokenCache::TokenCache(const char * directory) :
+    m_Directory(directory), m_Mapped(nullptr), m_MappedSize(0),
+    m_Mapping(nullptr), m_Tokens(0), m_Symbols(0), m_End(0),
+    m_Ids(nullptr), m_Offsets(nullptr), m_Values(nullptr),
+    m_NameEnds(nullptr), m_Names(nullptr)
+{ }
+
+TokenCache::~TokenCache() {
+    close();
+}
+
+/**
+ * \brief Map the cache file for a buffer of source text, if there is one
+ *
+ * \param data The source text, hashed to find the file
+ * \param size The number of bytes of source text
+ * Every Token is checked to refer only to the source, the symbols and the
+ * text in the file, so a damaged file is a miss rather than bad Tokens.
+ *
+ * \return True if the file was there and was written for this text by
+ *         this Version. Otherwise nothing is loaded.
+ */
+bool TokenCache::load(const uint8_t * data, size_t size) {
+    close();
+    uint64_t hash = TokenCache::Hash(data, size);
+    if (!map(path(hash))) {
+        return false;
+    }
+
+    CacheHeader header;
+    if (m_MappedSize < sizeof(header)) {
+        close();
+        return false;
+    }
+    std::memcpy(&header, m_Mapped, sizeof(header));
+    if (std::memcmp(header.magic, _g_CacheMagic, sizeof(header.magic)) != 0
+        || header.version != TokenCache::Version
+        || header.ids != (uint16_t)Token::Id::_COUNT
+        || header.value_size != sizeof(Token::Value)
+        || header.hash != hash || header.source_size != size
+        || header.tokens > m_MappedSize || header.symbols > m_MappedSize
+        || header.end > size)
+    {
+        close();
+        return false;
+    }
+
+    // Every section has to fit exactly, a short file is a damaged one
+    size_t tokens = (size_t)header.tokens;
+    size_t symbols = (size_t)header.symbols;
+    size_t offset = sizeof(header);
+    size_t values = offset;
+    offset += tokens * sizeof(Token::Value);
+    size_t offsets = offset;
+    offset += tokens * sizeof(uint32_t);
+    size_t ends = offset;
+    offset += symbols * sizeof(uint32_t);
+    size_t ids = offset;
+    offset += tokens;
+    size_t names = offset;
+    if (offset > m_MappedSize
+        || header.names_size > m_MappedSize - offset
+        || header.strings_size
+            != m_MappedSize - offset - (size_t)header.names_size)
+    {
+        close();
+        return false;
+    }
+
+    m_Tokens = tokens;
+    m_Symbols = symbols;
+    m_End = (size_t)header.end;
+    m_Values = (const Token::Value *)(m_Mapped + values);
+    m_Offsets = (const uint32_t *)(m_Mapped + offsets);
+    m_NameEnds = (const uint32_t *)(m_Mapped + ends);
+    m_Ids = (const int8_t *)(m_Mapped + ids);
+    m_Names = (const char *)(m_Mapped + names);
+    m_Strings = std::string_view(m_Names + header.names_size,
+        (size_t)header.strings_size);
+
+    uint32_t last = 0;
+    for (size_t i = 0; i < m_Symbols; ++i) {
+        if (m_NameEnds[i] < last || m_NameEnds[i] > header.names_size) {
+            close();
+            return false;
+        }
+        last = m_NameEnds[i];
+    }
+
+    // The file is only found by the hash of the source, so every Token has
+    // to point inside the source, the symbols or the text like a lexed one
+    uint32_t previous = 0;
+    for (size_t i = 0; i < m_Tokens; ++i) {
+        Token::Id id = (Token::Id)m_Ids[i];
+        if (id < Token::Id::UnexpectedEscapeEOF || id >= Token::Id::_COUNT
+            || m_Offsets[i] < previous || m_Offsets[i] > size)
+        {
+            close();
+            return false;
+        }
+        previous = m_Offsets[i];
+        Token::Value value = m_Values[i];
+        if (Token::IsSymbol(id) && value.symbol >= m_Symbols) {
+            close();
+            return false;
+        }
+        if (Token::IsString(id) || Token::IsNumeric(id)) {
+            uint64_t end = (uint64_t)value.span.offset + value.span.size();
+            if (end > (value.span.materialized() ?
+                header.strings_size : header.source_size))
+            {
+                close();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Write the cache file for a buffer of source text
+ *
+ * The directory is made if it is not there. Nothing loaded is changed.
+ *
+ * \param data The source text the Tokens were lexed from
+ * \param size The number of bytes of source text
+ * \param lexer The Lexer which lexed them, holding their symbols and text
+ * \param tokens Every Token of the source, as lex_parallel() gives
+ * \return False if the file could not be written
+ */
+bool TokenCache::store(const uint8_t * data, size_t size,
+    const LexerBase & lexer, const TokenBuffer & tokens)
+{
+    const SymbolTable & table = lexer.symbols();
+    std::vector<uint32_t> ends(table.size());
+    std::string names;
+    for (size_t i = 0; i < ends.size(); ++i) {
+        names.append(table.name((SymbolTable::Symbol)i));
+        ends[i] = (uint32_t)names.size();
+    }
+
+    CacheHeader header;
+    std::memcpy(header.magic, _g_CacheMagic, sizeof(header.magic));
+    header.version = TokenCache::Version;
+    header.ids = (uint16_t)Token::Id::_COUNT;
+    header.value_size = (uint16_t)sizeof(Token::Value);
+    header.hash = TokenCache::Hash(data, size);
+    header.source_size = size;
+    header.end = lexer.state().index;
+    header.tokens = tokens.size();
+    header.symbols = ends.size();
+    header.names_size = names.size();
+    header.strings_size = lexer.m_Strings.size();
+
+#ifdef _WIN32
+    _mkdir(m_Directory.c_str());
+    int pid = _getpid();
+#else
+    mkdir(m_Directory.c_str(), 0777);
+    int pid = (int)getpid();
+#endif
+    std::string filename = path(header.hash);
+    std::string temporary = filename + "." + std::to_string(pid) + ".tmp";
+    std::FILE * file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    size_t count = tokens.size();
+    bool good = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(tokens.values(), sizeof(Token::Value), count, file)
+            == count
+        && std::fwrite(tokens.offsets(), sizeof(uint32_t), count, file)
+            == count
+        && std::fwrite(ends.data(), sizeof(uint32_t), ends.size(), file)
+            == ends.size()
+        && std::fwrite(tokens.ids(), 1, count, file) == count
+        && std::fwrite(names.data(), 1, names.size(), file) == names.size()
+        && std::fwrite(lexer.m_Strings.data(), 1, lexer.m_Strings.size(),
+            file) == lexer.m_Strings.size();
+    good = (std::fclose(file) == 0) && good;
+
+    // Another process may have written the same file, which is just as good
+    if (good && std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::remove(filename.c_str());
+        good = (std::rename(temporary.c_str(), filename.c_str()) == 0);
+    }
+    if (!good) {
+        std::remove(temporary.c_str());
+    }
+    return good;
+}
+
+/**
+ * \brief Unmap the loaded file, if any
+ *
+ * Tokens from LexerBase::load() are copies, so they stay valid.
+ */
+void TokenCache::close() {
+    if (m_Mapped != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile((LPCVOID)m_Mapped);
+        CloseHandle((HANDLE)m_Mapping);
+#else
+        munmap((void *)m_Mapped, m_MappedSize);
+#endif
+    }
+    m_Mapped = nullptr;
+    m_MappedSize = 0;
+    m_Mapping = nullptr;
+    m_Tokens = m_Symbols = m_End = 0;
+    m_Ids = nullptr;
+    m_Offsets = nullptr;
+    m_Values = nullptr;
+    m_NameEnds = nullptr;
+    m_Names = nullptr;
+    m_Strings = std::string_view();
+}
+
+bool TokenCache::loaded() const {
+    return m_Mapped != nullptr;
+}
+
+/**
+ * \brief Get the name of the file for source text with a Hash()
+ */
+std::string TokenCache::path(uint64_t hash) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.tokens",
+        (unsigned long long)hash);
+    return m_Directory + name;
+}
+
+/**
+ * \brief Get the number of Tokens, including the last EndOfFile
+ */
+size_t TokenCache::size() const {
+    return m_Tokens;
+}
+
+/**
+ * \brief Get the Lexer index after the last Token, see LexerBase::State
+ */
+size_t TokenCache::end() const {
+    return m_End;
+}
+
+const int8_t * TokenCache::ids() const {
+    return m_Ids;
+}
+
+const uint32_t * TokenCache::offsets() const {
+    return m_Offsets;
+}
+
+/**
+ * \brief Get the value of every Token
+ *
+ * Symbols are numbered and materialized text is placed as they were in
+ * the Lexer which lexed them, see symbol() and strings().
+ */
+const Token::Value * TokenCache::values() const {
+    return m_Values;
+}
+
+size_t TokenCache::symbols() const {
+    return m_Symbols;
+}
+
+/**
+ * \brief Get the name of a symbol, by the SymbolTable::Symbol it had
+ */
+std::string_view TokenCache::symbol(size_t index) const {
+    uint32_t start = (index == 0 ? 0 : m_NameEnds[index - 1]);
+    return std::string_view(m_Names + start, m_NameEnds[index] - start);
+}
+
+/**
+ * \brief Get the materialized text the Tokens refer to
+ */
+std::string_view TokenCache::strings() const {
+    return m_Strings;
+}
+
+static const uint64_t _g_Prime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t _g_Prime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t _g_Prime3 = 0x165667B19E3779F9ull;
+static const uint64_t _g_Prime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t _g_Prime5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const uint8_t * data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const uint8_t * data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+    acc += input * _g_Prime2;
+    return rotate_left(acc, 31) * _g_Prime1;
+}
+
+static inline uint64_t hash_merge(uint64_t acc, uint64_t value) {
+    acc ^= hash_round(0, value);
+    return acc * _g_Prime1 + _g_Prime4;
+}
+
+/**
+ * \brief Hash a buffer, the same as XXH64
+ *
+ * Four lanes take 8 bytes each per 32 byte stripe, so the multiplies of a
+ * stripe run side by side and long sources hash at several bytes a cycle.
+ * Words are read little endian, as cache files are only ever read on the
+ * machine which wrote them.
+ */
+uint64_t TokenCache::Hash(const uint8_t * data, size_t size, uint64_t seed) {
+    const uint8_t * end = data + size;
+    uint64_t hash;
+    if (size >= 32) {
+        uint64_t v1 = seed + _g_Prime1 + _g_Prime2;
+        uint64_t v2 = seed + _g_Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - _g_Prime1;
+        const uint8_t * limit = end - 32;
+        do {
+            v1 = hash_round(v1, read64(data));
+            v2 = hash_round(v2, read64(data + 8));
+            v3 = hash_round(v3, read64(data + 16));
+            v4 = hash_round(v4, read64(data + 24));
+            data += 32;
+        } while (data <= limit);
+        hash = rotate_left(v1, 1) + rotate_left(v2, 7)
+            + rotate_left(v3, 12) + rotate_left(v4, 18);
+        hash = hash_merge(hash, v1);
+        hash = hash_merge(hash, v2);
+        hash = hash_merge(hash, v3);
+        hash = hash_merge(hash, v4);
+    }
+    else {
+        hash = seed + _g_Prime5;
+    }
+    hash += (uint64_t)size;
+
+    while (data + 8 <= end) {
+        hash ^= hash_round(0, read64(data));
+        hash = rotate_left(hash, 27) * _g_Prime1 + _g_Prime4;
+        data += 8;
+    }
+    if (data + 4 <= end) {
+        hash ^= (uint64_t)read32(data) * _g_Prime1;
+        hash = rotate_left(hash, 23) * _g_Prime2 + _g_Prime3;
+        data += 4;
+    }
+    while (data < end) {
+        hash ^= (uint64_t)*data * _g_Prime5;
+        hash = rotate_left(hash, 11) * _g_Prime1;
+        data += 1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= _g_Prime2;
+    hash ^= hash >> 29;
+    hash *= _g_Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/**
+ * \brief Map a whole file read only
+ *
+ * \return False if it is not there or is empty
+ */
+bool TokenCache::map(const std::string & filename) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0,
+            0, nullptr);
+        if (mapping != nullptr) {
+            m_Mapped = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ,
+                0, 0, 0);
+            if (m_Mapped != nullptr) {
+                m_Mapping = (void *)mapping;
+                m_MappedSize = (size_t)size.QuadPart;
+            }
+            else {
+                CloseHandle(mapping);
+            }
+        }
+    }
+    // The mapping keeps its own reference to the file
+    CloseHandle(file);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void * addr = mmap(nullptr, (size_t)info.st_size, PROT_READ,
+            MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            m_Mapped = (const uint8_t *)addr;
+            m_MappedSize = (size_t)info.st_size;
+        }
+    }
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+#endif
+    return m_Mapped != nullptr;
+}
+
+//====================================
+// LexerBase::load, see TokenCache
+
+/**
+ * \brief Fill a TokenBuffer from a TokenCache instead of lexing a buffer
+ *
+ * The TokenCache has to have been loaded for this same data. The result is
+ * what lex_parallel() would give: the symbols are interned in the same
+ * order, the materialized text is taken over and the Lexer is left at the
+ * end of the buffer. Only the symbol names are looked at one by one. When
+ * they get the numbers they had, the Tokens are copied straight out of the
+ * mapped file.
+ *
+ * \param data The UTF-8 data the Tokens were lexed from
+ * \param size The number of bytes in the buffer
+ * \param cache A TokenCache loaded for the data
+ * \param tokens Cleared and filled with every Token
+ * \return The number of Tokens loaded
+ */
+size_t LexerBase::load(const uint8_t * data, size_t size,
+    const TokenCache & cache, TokenBuffer & tokens)
+{
+    read(data, size);
+    std::vector<SymbolTable::Symbol> symbols(cache.symbols());
+    bool renumbered = false;
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        std::string_view name = cache.symbol(i);
+        symbols[i] = m_Symbols.intern((const uint8_t *)name.data(),
+            name.size());
+        renumbered = renumbered || (symbols[i] != (SymbolTable::Symbol)i);
+    }
+    size_t offset = m_Strings.size();
+    m_Strings.append(cache.strings().data(), cache.strings().size());
+
+    tokens.clear();
+    if (!renumbered && offset == 0) {
+        tokens.append(cache.ids(), cache.offsets(), cache.values(),
+            cache.size());
+    }
+    else {
+        tokens.reserve(cache.size());
+        for (size_t i = 0; i < cache.size(); ++i) {
+            Token::Id id = (Token::Id)cache.ids()[i];
+            Token::Value value = cache.values()[i];
+            if (Token::IsSymbol(id)) {
+                value.symbol = symbols[value.symbol];
+            }
+            else if ((Token::IsString(id) || Token::IsNumeric(id))
+                && value.span.materialized())
+            {
+                value.span.offset += (uint32_t)offset;
+            }
+            tokens.push(Token(id, cache.offsets()[i], value));
+        }
+    }
+    m_Index = cache.end();
+    return tokens.size();
+}
+
+//===========================================================================
+// Data definitions
+const char _g_CacheMagic[8] = { 't', 's', 'b', 'l', 't', 'o', 'k', '\0' };
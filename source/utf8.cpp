@@ -2,7 +2,24 @@
 #include <iostream>
 #include "tsbl/utf8.hpp"
 
+#include <algorithm>
+#include <climits>
 #include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define UTF8PROC_STATIC
 #include "utf8proc.h"
 
@@ -47,6 +64,22 @@ utf8::iterate(const uint8_t *string, int32_t strlen) {
     return std::make_pair(advance, codepoint);
 }
 
+/**
+ * \brief Encode a codepoint as UTF-8
+ *
+ * \param codepoint The codepoint to encode
+ * \param buffer Where to write the encoding, which must have room for 4 bytes
+ * \return The number of bytes written, or 0 if the codepoint is not valid
+ */
+size_t utf8::encode(utf8::codepoint_t codepoint, uint8_t * buffer) {
+    if (codepoint < 0x80) {
+        buffer[0] = (uint8_t)codepoint;
+        return 1;
+    }
+    auto written = utf8proc_encode_char((utf8proc_int32_t)codepoint, buffer);
+    return (written > 0 ? (size_t)written : 0);
+}
+
 //=============================================
 // utf8::Reader
 
@@ -102,6 +135,7 @@ utf8::FileReader::FileReader(const char * filename, size_t buffsize) :
     if (m_FilePtr != nullptr) {
         // Turn off the stream buffering
         std::setvbuf((FILE *)m_FilePtr, nullptr, _IONBF, 0);
+        m_Buffer = new uint8_t[m_BufferSize];
     }
     else {
         std::cout << "Could not open file " << filename << std::endl;
@@ -114,9 +148,17 @@ utf8::FileReader::~FileReader() {
         std::fclose((FILE *)m_FilePtr);
         m_FilePtr = nullptr;
     }
+    delete[] m_Buffer;
+    m_Buffer = nullptr;
 }
 
-utf8::codepoint_t utf8::FileReader::next() {
+/**
+ * \brief Decode the next codepoint when next() cannot do it inline
+ *
+ * Reads the first buffer, refills it when less than a whole sequence is
+ * left, and decodes anything which is not ASCII.
+ */
+utf8::codepoint_t utf8::FileReader::next_sequence() {
     // Early exit - if we already are in an ending state (invalid or end of
     // file), don't do any of the other stuff.
     if(bad()) {
@@ -130,7 +172,8 @@ utf8::codepoint_t utf8::FileReader::next() {
 
     // If we haven't read anything yet, attempt to populate the buffer
     if(bof()) {
-        m_BufferData = std::fread(m_Buffer, m_BufferSize, 1, fp);
+        m_BufferData = std::fread(m_Buffer, 1, m_BufferSize, fp);
+        TSBL_STATS_ADD(refills, 1);
         if (m_BufferData == 0) {
             // No data could be read - bad file
             m_Current = utf8::Codepoint::EndOfFile;
@@ -141,35 +184,39 @@ utf8::codepoint_t utf8::FileReader::next() {
     // Handle buffer with very little data - we want at least 4 bytes if
     // possible. If that isn't possible, we can still try to process the data
     // in the buffer, but it may be invalid.
-    if (m_BufferData - m_BufferIndex < 4) {
-        if (m_BufferData == m_BufferSize) {
-            // Shift remaining bytes (if any) to the start of the buffer
-            size_t shift = m_BufferData - m_BufferIndex;
-            for (size_t i = 0; i < shift; ++i) {
-                m_Buffer[i] = m_Buffer[m_BufferIndex + i];
-            }
+    if (m_BufferData - m_BufferIndex < 4 && m_BufferData == m_BufferSize) {
+        // Shift remaining bytes (if any) to the start of the buffer
+        size_t shift = m_BufferData - m_BufferIndex;
+        for (size_t i = 0; i < shift; ++i) {
+            m_Buffer[i] = m_Buffer[m_BufferIndex + i];
+        }
 
-            // Read the remainder of the buffer size
-            size_t bytes_read = std::fread(m_Buffer + shift,
-                m_BufferSize - shift, 1, fp);
+        // Read the remainder of the buffer size
+        size_t bytes_read = std::fread(m_Buffer + shift, 1,
+            m_BufferSize - shift, fp);
+        TSBL_STATS_ADD(refills, 1);
 
-            // The final buffer data count includes shift
-            if (bytes_read > 0) {
-                m_BufferData = shift + bytes_read;
-            }
-            else {
-                m_BufferData = shift;
-            }
-            m_BufferIndex = 0;
+        // The final buffer data count includes shift
+        if (bytes_read > 0) {
+            m_BufferData = shift + bytes_read;
         }
         else {
-            // We hit the end of the file last time, no need to read
-            m_Current = utf8::Codepoint::EndOfFile;
-            return m_Current;
+            m_BufferData = shift;
         }
+        m_BufferIndex = 0;
+    }
+    if (m_BufferIndex >= m_BufferData) {
+        // We hit the end of the file and consumed everything we read
+        m_Current = utf8::Codepoint::EndOfFile;
+        return m_Current;
     }
 
     // At this point, we have our data read from the stream one way or another
+    if (m_Buffer[m_BufferIndex] < 0x80) {
+        m_Current = m_Buffer[m_BufferIndex++];
+        TSBL_STATS_ADD(codepoints, 1);
+        return m_Current;
+    }
     int32_t length = (m_BufferData - m_BufferIndex >= 4 ?
         (int32_t)4 :
         (int32_t)(m_BufferData - m_BufferIndex)
@@ -179,6 +226,7 @@ utf8::codepoint_t utf8::FileReader::next() {
     if (results.first > 0) {
         m_BufferIndex += results.first;
         m_Current = results.second;
+        TSBL_STATS_ADD(codepoints, 1);
     }
     else {
         m_Current = utf8::Codepoint::Invalid;
@@ -186,33 +234,493 @@ utf8::codepoint_t utf8::FileReader::next() {
     return m_Current;
 }
 
+size_t utf8::FileReader::write(utf8::codepoint_t * buffer, size_t count) {
+    if (bad()) {
+        return 0;
+    }
+    size_t written = 0;
+    while (written < count) {
+        // Let next() deal with the first read, refilling the buffer and
+        // sequences which straddle the end of it.
+        if (bof() || m_BufferData - m_BufferIndex < 4) {
+            next();
+            if (bad()) {
+                return written;
+            }
+            buffer[written++] = m_Current;
+            continue;
+        }
+
+        auto results = utf8::decode(m_Buffer + m_BufferIndex,
+            m_BufferData - m_BufferIndex, buffer + written, count - written);
+        m_BufferIndex += results.first;
+        written += results.second;
+        TSBL_STATS_ADD(codepoints, results.second);
+        if (results.second > 0) {
+            m_Current = buffer[written - 1];
+        }
+        if (written < count && m_BufferData - m_BufferIndex >= 4) {
+            // The decoder stopped on a sequence it had all the bytes for
+            m_Current = utf8::Codepoint::Invalid;
+            return written;
+        }
+    }
+    return written;
+}
+
 bool utf8::FileReader::bad() const {
     return m_FilePtr == nullptr || Reader::bad();
 }
 
+//====================================
+// utf8::FdReader
+
+/**
+ * \brief Create a Reader over a file descriptor
+ *
+ * Nothing is read until the first call, and the descriptor is left open.
+ *
+ * \param fd The descriptor to read, such as 0 for stdin
+ * \param buffsize The size of the ring buffer, rounded up to a power of 2
+ */
+utf8::FdReader::FdReader(int fd, size_t buffsize) :
+    m_Fd(fd), m_Buffer(nullptr), m_Mask(0), m_Head(0), m_Tail(0),
+    m_LineEnd(0), m_Closed(false)
+{
+    size_t capacity = 16;
+    while (capacity < buffsize) {
+        capacity *= 2;
+    }
+    m_Buffer = new uint8_t[capacity];
+    m_Mask = capacity - 1;
+    if (m_Fd < 0) {
+        m_Current = utf8::Codepoint::EndOfFile;
+    }
+}
+
+utf8::FdReader::~FdReader() {
+    delete[] m_Buffer;
+    m_Buffer = nullptr;
+}
+
+utf8::codepoint_t utf8::FdReader::next() {
+    if (bad()) {
+        return m_Current;
+    }
+    if (m_Head == m_Tail && !wait()) {
+        m_Current = utf8::Codepoint::EndOfFile;
+        return m_Current;
+    }
+
+    uint8_t lead = m_Buffer[m_Head & m_Mask];
+    if (lead < 0x80) {
+        m_Head += 1;
+        m_Current = lead;
+        TSBL_STATS_ADD(codepoints, 1);
+        return m_Current;
+    }
+
+    // Wait for the rest of the sequence if it was split across reads
+    size_t length = (lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2);
+    while (m_Tail - m_Head < length && wait()) { }
+    if (m_Tail - m_Head < length) {
+        length = m_Tail - m_Head;
+    }
+
+    // The sequence may wrap around the end of the ring
+    uint8_t sequence[4];
+    for (size_t i = 0; i < length; ++i) {
+        sequence[i] = m_Buffer[(m_Head + i) & m_Mask];
+    }
+    auto results = utf8::iterate(sequence, (int32_t)length);
+    if (results.first > 0) {
+        m_Head += results.first;
+        m_Current = results.second;
+        TSBL_STATS_ADD(codepoints, 1);
+    }
+    else {
+        m_Current = utf8::Codepoint::Invalid;
+    }
+    return m_Current;
+}
+
+size_t utf8::FdReader::write(utf8::codepoint_t * buffer, size_t count) {
+    if (bad()) {
+        return 0;
+    }
+    size_t written = 0;
+    while (written < count) {
+        // Bulk decode the part of the ring up to its end or the tail, and
+        // let next() deal with waiting and sequences which wrap or straddle
+        // the tail
+        size_t head = m_Head & m_Mask;
+        size_t span = std::min(m_Tail - m_Head, m_Mask + 1 - head);
+        if (span < 4) {
+            next();
+            if (bad()) {
+                return written;
+            }
+            buffer[written++] = m_Current;
+            continue;
+        }
+
+        auto results = utf8::decode(m_Buffer + head, span, buffer + written,
+            count - written);
+        m_Head += results.first;
+        written += results.second;
+        TSBL_STATS_ADD(codepoints, results.second);
+        if (results.second > 0) {
+            m_Current = buffer[written - 1];
+        }
+        if (written < count && span - results.first >= 4) {
+            // The decoder stopped on a sequence it had all the bytes for
+            m_Current = utf8::Codepoint::Invalid;
+            return written;
+        }
+    }
+    return written;
+}
+
+bool utf8::FdReader::bad() const {
+    return m_Fd < 0 || Reader::bad();
+}
+
+/**
+ * \brief Read whatever the descriptor has ready, without blocking
+ *
+ * Stops when the ring buffer is full, so a writer faster than the Lexer
+ * is held back by the pipe instead of growing memory.
+ *
+ * \return The number of bytes added to the buffer
+ */
+size_t utf8::FdReader::fill() {
+    size_t total = 0;
+    while (!m_Closed && m_Tail - m_Head <= m_Mask) {
+        size_t tail = m_Tail & m_Mask;
+        size_t space = std::min(m_Mask + 1 - (m_Tail - m_Head),
+            m_Mask + 1 - tail);
+        ptrdiff_t count = read_some(m_Buffer + tail, space, false);
+        if (count <= 0) {
+            break;
+        }
+        total += (size_t)count;
+        if ((size_t)count < space) {
+            break;
+        }
+    }
+    return total;
+}
+
+/**
+ * \brief Block until more data is buffered or the descriptor is closed
+ *
+ * \return False if nothing more will come, or the buffer is already full
+ */
+bool utf8::FdReader::wait() {
+    if (m_Closed || m_Tail - m_Head > m_Mask) {
+        return false;
+    }
+    size_t tail = m_Tail & m_Mask;
+    size_t space = std::min(m_Mask + 1 - (m_Tail - m_Head),
+        m_Mask + 1 - tail);
+    return read_some(m_Buffer + tail, space, true) > 0;
+}
+
+/**
+ * \brief Check if the Lexer can run without waiting for more data
+ *
+ * True once a whole line which has not been read is buffered, along with
+ * the start of the next one which the Lexer peeks at. Also true when the
+ * descriptor is closed or the buffer is full, as waiting would not help.
+ * A string spanning lines or a codepoint split just after the new line may
+ * still make the Lexer wait.
+ */
+bool utf8::FdReader::ready() const {
+    return m_Closed || m_Tail - m_Head > m_Mask
+        || (m_LineEnd > m_Head && m_LineEnd < m_Tail);
+}
+
+/**
+ * \brief Check if the descriptor has reached its end
+ *
+ * Data may still be buffered, which next() returns before EndOfFile.
+ */
+bool utf8::FdReader::closed() const {
+    return m_Closed;
+}
+
+/**
+ * \brief Get the number of bytes read from the descriptor but not decoded
+ */
+size_t utf8::FdReader::buffered() const {
+    return m_Tail - m_Head;
+}
+
+int utf8::FdReader::fd() const {
+    return m_Fd;
+}
+
+/**
+ * \brief Read once from the descriptor into the buffer
+ *
+ * \param buffer Where to read to, which is at the tail of the ring
+ * \param size The room at buffer
+ * \param block Wait for data instead of giving up when there is none
+ * \return The number of bytes read, or 0 if none were. m_Closed is set when
+ *     the descriptor has ended or failed.
+ */
+ptrdiff_t utf8::FdReader::read_some(uint8_t * buffer, size_t size,
+    bool block)
+{
+    if (m_Fd < 0 || m_Closed) {
+        return 0;
+    }
+#ifdef _WIN32
+    // Only pipes can be asked how much they hold, anything else is read
+    // straight away
+    HANDLE handle = (HANDLE)_get_osfhandle(m_Fd);
+    DWORD available = 0;
+    if (!block && GetFileType(handle) == FILE_TYPE_PIPE) {
+        if (!PeekNamedPipe(handle, nullptr, 0, nullptr, &available, nullptr)) {
+            m_Closed = true;
+            return 0;
+        }
+        if (available == 0) {
+            return 0;
+        }
+        if (size > available) {
+            size = available;
+        }
+    }
+    int count = _read(m_Fd, buffer, (unsigned int)std::min(size,
+        (size_t)INT_MAX));
+#else
+    ptrdiff_t count;
+    for (;;) {
+        pollfd request = { m_Fd, POLLIN, 0 };
+        int polled = poll(&request, 1, block ? -1 : 0);
+        if (polled < 0 && errno == EINTR) {
+            continue;
+        }
+        if (polled == 0) {
+            return 0;
+        }
+        count = ::read(m_Fd, buffer, size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (block) {
+                continue;
+            }
+            return 0;
+        }
+        break;
+    }
+#endif
+    if (count <= 0) {
+        m_Closed = true;
+        return 0;
+    }
+
+    for (ptrdiff_t i = count - 1; i >= 0; --i) {
+        if (buffer[i] == '\n') {
+            m_LineEnd = m_Tail + (size_t)i + 1;
+            break;
+        }
+    }
+    m_Tail += (size_t)count;
+    return (ptrdiff_t)count;
+}
+
+//====================================
+// utf8::MappedFileReader
+utf8::MappedFileReader::MappedFileReader(const char * filename) :
+    m_Mapping(nullptr), m_Data(nullptr), m_Size(0), m_Index(0),
+    m_Open(false)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER size;
+        bool sized = (GetFileSizeEx(file, &size) != FALSE);
+        // An empty file cannot be mapped, and there is nothing to map
+        m_Open = (sized && size.QuadPart == 0);
+        if (sized && size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                0, 0, nullptr);
+            if (mapping != nullptr) {
+                m_Data = (const uint8_t *)MapViewOfFile(mapping,
+                    FILE_MAP_READ, 0, 0, 0);
+                if (m_Data != nullptr) {
+                    m_Mapping = (void *)mapping;
+                    m_Size = (size_t)size.QuadPart;
+                    m_Open = true;
+                }
+                else {
+                    CloseHandle(mapping);
+                }
+            }
+        }
+        // The mapping keeps its own reference to the file
+        CloseHandle(file);
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0) {
+        struct stat info;
+        bool sized = (fstat(fd, &info) == 0);
+        // An empty file cannot be mapped, and there is nothing to map
+        m_Open = (sized && info.st_size == 0);
+        if (sized && info.st_size > 0) {
+            void * addr = mmap(nullptr, (size_t)info.st_size, PROT_READ,
+                MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, (size_t)info.st_size, MADV_SEQUENTIAL);
+                m_Data = (const uint8_t *)addr;
+                m_Size = (size_t)info.st_size;
+                m_Open = true;
+            }
+        }
+        // The mapping keeps its own reference to the file
+        close(fd);
+    }
+#endif
+    if (!m_Open) {
+        std::cout << "Could not map file " << filename << std::endl;
+    }
+    if (m_Data == nullptr) {
+        m_Current = utf8::Codepoint::EndOfFile;
+    }
+}
+
+utf8::MappedFileReader::~MappedFileReader() {
+    if (m_Data != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile((LPCVOID)m_Data);
+        CloseHandle((HANDLE)m_Mapping);
+#else
+        munmap((void *)m_Data, m_Size);
+#endif
+        m_Data = nullptr;
+        m_Mapping = nullptr;
+    }
+}
+
+/**
+ * \brief Decode the next codepoint when next() cannot do it inline
+ */
+utf8::codepoint_t utf8::MappedFileReader::next_sequence() {
+    if (bad()) {
+        return m_Current;
+    }
+    if (m_Index >= m_Size) {
+        m_Current = utf8::Codepoint::EndOfFile;
+        return m_Current;
+    }
+
+    // The mapping is not NUL terminated, so never let utf8::iterate() look
+    // past the end of it.
+    size_t remaining = m_Size - m_Index;
+    int32_t length = (remaining >= 4 ? (int32_t)4 : (int32_t)remaining);
+    auto results = utf8::iterate(m_Data + m_Index, length);
+    if (results.first > 0) {
+        m_Index += results.first;
+        m_Current = results.second;
+        TSBL_STATS_ADD(codepoints, 1);
+    }
+    else {
+        m_Current = utf8::Codepoint::Invalid;
+    }
+    return m_Current;
+}
+
+size_t utf8::MappedFileReader::write(utf8::codepoint_t * buffer,
+    size_t count)
+{
+    if (bad()) {
+        return 0;
+    }
+    auto results = utf8::decode(m_Data + m_Index, m_Size - m_Index, buffer,
+        count);
+    m_Index += results.first;
+    TSBL_STATS_ADD(codepoints, results.second);
+    if (results.second > 0) {
+        m_Current = buffer[results.second - 1];
+    }
+    if (results.second < count) {
+        m_Current = (m_Index >= m_Size ?
+            utf8::Codepoint::EndOfFile :
+            utf8::Codepoint::Invalid
+        );
+    }
+    return results.second;
+}
+
+bool utf8::MappedFileReader::bad() const {
+    return !m_Open || Reader::bad();
+}
+
+/**
+ * \brief Check if the file was opened and mapped, or found to be empty
+ */
+bool utf8::MappedFileReader::is_open() const {
+    return m_Open;
+}
+
+const uint8_t * utf8::MappedFileReader::data() const {
+    return m_Data;
+}
+
+size_t utf8::MappedFileReader::size() const {
+    return m_Size;
+}
+
 //====================================
 // utf8::StringStream
 utf8::StringReader::StringReader(const uint8_t * data) :
-    m_Data(data), m_Index(0)
+    m_Data(data), m_Size(std::strlen((const char *)data)), m_Index(0)
 { }
 
 utf8::StringReader::~StringReader() { }
 
-utf8::codepoint_t utf8::StringReader::next() {
-    size_t len = 0;
-    for (; len < 4 && m_Data[m_Index + len] != 0; ++len) {}
-    if (len == 0) {
+/**
+ * \brief Decode the next codepoint when next() cannot do it inline
+ */
+utf8::codepoint_t utf8::StringReader::next_sequence() {
+    if (m_Index >= m_Size) {
         m_Current = utf8::Codepoint::EndOfFile;
         return m_Current;
     }
-    // The cast is safe - len is always [0, 4]
-    auto results = utf8::iterate(m_Data + m_Index, (int32_t)(len));
+
+    size_t remaining = m_Size - m_Index;
+    int32_t length = (remaining >= 4 ? (int32_t)4 : (int32_t)remaining);
+    auto results = utf8::iterate(m_Data + m_Index, length);
     if (results.first > 0) {
         m_Index += results.first;
         m_Current = results.second;
+        TSBL_STATS_ADD(codepoints, 1);
     }
     else {
         m_Current = utf8::Codepoint::Invalid;
     }
     return m_Current;
 }
+
+size_t utf8::StringReader::write(utf8::codepoint_t * buffer, size_t count) {
+    auto results = utf8::decode(m_Data + m_Index, m_Size - m_Index, buffer,
+        count);
+    m_Index += results.first;
+    TSBL_STATS_ADD(codepoints, results.second);
+    if (results.second > 0) {
+        m_Current = buffer[results.second - 1];
+    }
+    if (results.second < count) {
+        m_Current = (m_Index >= m_Size ?
+            utf8::Codepoint::EndOfFile :
+            utf8::Codepoint::Invalid
+        );
+    }
+    return results.second;
+}
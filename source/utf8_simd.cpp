@@ -0,0 +1,221 @@
+#include "tsbl/utf8.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TSBL_UTF8_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TSBL_TARGET_AVX2
+#else
+#define TSBL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace tsbl;
+
+namespace {
+    /**
+     * \brief Widen the leading 7-bit run of `data` into `buffer`
+     *
+     * Every variant stops at the first byte with the high bit set, or after
+     * `size` bytes, and returns the number of codepoints written.
+     */
+    typedef size_t (*WidenFn)(const uint8_t *, size_t, utf8::codepoint_t *);
+
+    size_t widen_scalar(const uint8_t * data, size_t size,
+        utf8::codepoint_t * buffer)
+    {
+        size_t i = 0;
+        for (; i < size && data[i] < 0x80; ++i) {
+            buffer[i] = data[i];
+        }
+        return i;
+    }
+
+    inline unsigned trailing_zeros(uint32_t mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (unsigned)index;
+#else
+        return (unsigned)__builtin_ctz(mask);
+#endif
+    }
+
+#ifdef TSBL_UTF8_X86
+    size_t widen_sse2(const uint8_t * data, size_t size,
+        utf8::codepoint_t * buffer)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(data + i));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(bytes);
+            if (mask != 0) {
+                size_t run = trailing_zeros(mask);
+                return i + widen_scalar(data + i, run, buffer + i);
+            }
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            __m128i * out = (__m128i *)(buffer + i);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+        }
+        return i + widen_scalar(data + i, size - i, buffer + i);
+    }
+
+    TSBL_TARGET_AVX2
+    size_t widen_avx2(const uint8_t * data, size_t size,
+        utf8::codepoint_t * buffer)
+    {
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i *)(data + i));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(bytes);
+            if (mask != 0) {
+                size_t run = trailing_zeros(mask);
+                return i + widen_scalar(data + i, run, buffer + i);
+            }
+            __m128i lo = _mm256_castsi256_si128(bytes);
+            __m128i hi = _mm256_extracti128_si256(bytes, 1);
+            __m256i * out = (__m256i *)(buffer + i);
+            _mm256_storeu_si256(out + 0, _mm256_cvtepu8_epi32(lo));
+            _mm256_storeu_si256(out + 1,
+                _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+            _mm256_storeu_si256(out + 2, _mm256_cvtepu8_epi32(hi));
+            _mm256_storeu_si256(out + 3,
+                _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+        }
+        return i + widen_sse2(data + i, size - i, buffer + i);
+    }
+
+    bool cpu_has_avx2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        // AVX needs OS support for saving the YMM registers (OSXSAVE + AVX)
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+            return false;
+        }
+        if ((_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        // We run during static initialization, before the CPU model is
+        // guaranteed to be populated.
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    WidenFn select_widen() {
+#ifdef TSBL_UTF8_X86
+        if (cpu_has_avx2()) {
+            return widen_avx2;
+        }
+        return widen_sse2;
+#else
+        return widen_scalar;
+#endif
+    }
+
+    const WidenFn _g_Widen = select_widen();
+}
+
+/**
+ * \brief Get the length of the leading 7-bit ASCII run of the data
+ *
+ * \param data The UTF-8 data to check
+ * \param size The number of bytes available at data
+ * \return The number of leading bytes which are all below 0x80
+ */
+size_t utf8::ascii_prefix(const uint8_t * data, size_t size) {
+    size_t i = 0;
+#ifdef TSBL_UTF8_X86
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(data + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(bytes);
+        if (mask != 0) {
+            return i + trailing_zeros(mask);
+        }
+    }
+#endif
+    for (; i < size && data[i] < 0x80; ++i) {}
+    return i;
+}
+
+/**
+ * \brief Find the first \n or \r in the data, like memchr() for two bytes
+ *
+ * \param data The data to search
+ * \param size The number of bytes available at data
+ * \return The index of the first \n or \r, or size if there is none
+ */
+size_t utf8::find_line_break(const uint8_t * data, size_t size) {
+    size_t i = 0;
+#ifdef TSBL_UTF8_X86
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i found = _mm_or_si128(_mm_cmpeq_epi8(bytes, lf),
+            _mm_cmpeq_epi8(bytes, cr));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(found);
+        if (mask != 0) {
+            return i + trailing_zeros(mask);
+        }
+    }
+#endif
+    for (; i < size && data[i] != '\n' && data[i] != '\r'; ++i) {}
+    return i;
+}
+
+/**
+ * \brief Decode a run of UTF-8 data into a codepoint buffer
+ *
+ * ASCII runs are validated and widened a whole vector at a time, using the
+ * widest implementation the CPU supports. Everything else goes through
+ * utf8::iterate() one codepoint at a time. Decoding stops when the buffer is
+ * full, the data is exhausted, or at the first sequence which is invalid or
+ * truncated by the end of the data.
+ *
+ * \param data The UTF-8 data to decode
+ * \param size The number of bytes available at data
+ * \param buffer The buffer to write codepoints to
+ * \param count The number of codepoints the buffer can hold
+ * \return The number of bytes consumed and the number of codepoints written
+ */
+std::pair<size_t, size_t> utf8::decode(const uint8_t * data, size_t size,
+    utf8::codepoint_t * buffer, size_t count)
+{
+    size_t in = 0, out = 0;
+    while (out < count && in < size) {
+        size_t limit = (size - in < count - out ? size - in : count - out);
+        size_t run = _g_Widen(data + in, limit, buffer + out);
+        in += run;
+        out += run;
+        if (run == limit) {
+            continue;
+        }
+
+        size_t remaining = size - in;
+        auto results = utf8::iterate(data + in,
+            (remaining >= 4 ? (int32_t)4 : (int32_t)remaining));
+        if (results.first <= 0) {
+            break;
+        }
+        in += results.first;
+        buffer[out++] = results.second;
+    }
+    return std::make_pair(in, out);
+}
@@ -0,0 +1,78 @@
+
+#include "tsbl/value.hpp"
+
+#include <cstdio>
+
+using namespace tsbl;
+
+static const char * _g_KindNames[] = {
+    "null", "bool", "int", "real", "string"
+};
+
+/**
+ * \brief Get the kind of a Value from its tag
+ */
+Value::Kind Value::kind() const {
+    if (is_real()) {
+        return Value::Real;
+    }
+    switch (m_Bits & Value::TagMask) {
+    case Value::IntTag:
+        return Value::Int;
+    case Value::StringTag:
+        return Value::String;
+    default:
+        return (is_null() ? Value::Null : Value::Bool);
+    }
+}
+
+/**
+ * \brief Format a Value the way the language would write it
+ */
+std::string Value::to_string() const {
+    char buffer[32];
+    switch (kind()) {
+    case Value::Bool:
+        return (as_bool() ? "true" : "false");
+    case Value::Int:
+        std::snprintf(buffer, sizeof(buffer), "%lld", (long long)as_int());
+        return buffer;
+    case Value::Real:
+        std::snprintf(buffer, sizeof(buffer), "%.17g", as_real());
+        return buffer;
+    case Value::String:
+        return std::string(as_string());
+    default:
+        return "null";
+    }
+}
+
+/**
+ * \brief Check if two Values are the same
+ *
+ * Ints and reals are compared as numbers, strings by their text, and
+ * Values of any other differing kinds are never equal.
+ */
+bool Value::Equal(const Value & left, const Value & right) {
+    if (left.is_number() && right.is_number()) {
+        if (left.is_int() && right.is_int()) {
+            return left.m_Bits == right.m_Bits;
+        }
+        return left.as_number() == right.as_number();
+    }
+    if (left.is_string() && right.is_string()) {
+        return left.as_string() == right.as_string();
+    }
+    // Null and the bools are singletons
+    return left.m_Bits == right.m_Bits;
+}
+
+/**
+ * \brief Get the name of a Value::Kind, as used in errors
+ */
+const char * Value::Name(Value::Kind kind) {
+    if (kind > Value::String) {
+        return "unknown";
+    }
+    return _g_KindNames[kind];
+}
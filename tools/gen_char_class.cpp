@@ -0,0 +1,115 @@
+
+/**
+ * \brief Generate the codepoint class tables used by the Lexer
+ *
+ * Run at build time, so the tables follow the Unicode version of the
+ * utf8proc the project is linked against. The output is a C++ source file
+ * defining the tables declared in tsbl/char_class.hpp.
+ *
+ * Usage: tsbl_gen_char_class <output file>
+ */
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include <utf8proc.h>
+
+#include "tsbl/char_class.hpp"
+
+using namespace tsbl;
+
+static const uint32_t MaxCodepoint = 0x10FFFF;
+static const uint32_t BlockSize = 1u << utf8::CharClassShift;
+
+static uint8_t classify(uint32_t pt) {
+    uint8_t flags = 0;
+    switch (utf8proc_category((utf8proc_int32_t)pt)) {
+    case UTF8PROC_CATEGORY_LU:
+    case UTF8PROC_CATEGORY_LL:
+    case UTF8PROC_CATEGORY_LT:
+    case UTF8PROC_CATEGORY_LM:
+    case UTF8PROC_CATEGORY_LO:
+    case UTF8PROC_CATEGORY_PC:
+        flags |= utf8::CC_IdStart | utf8::CC_IdContinue;
+        break;
+    case UTF8PROC_CATEGORY_MN:
+    case UTF8PROC_CATEGORY_MC:
+    case UTF8PROC_CATEGORY_ME:
+    case UTF8PROC_CATEGORY_ND:
+    case UTF8PROC_CATEGORY_NL:
+        flags |= utf8::CC_IdContinue;
+        break;
+    case UTF8PROC_CATEGORY_ZS:
+        flags |= utf8::CC_Space;
+        break;
+    default:
+        break;
+    }
+    if (pt == '\n' || pt == '\r') {
+        flags |= utf8::CC_NewLine;
+    }
+    return flags;
+}
+
+static void write_table(FILE * out, const char * type, const char * name,
+    const std::vector<uint8_t> & values)
+{
+    std::fprintf(out, "const %s %s[%zu] = {", type, name, values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        std::fprintf(out, (i % 16 == 0 ? "\n    %u," : " %u,"),
+            (unsigned)values[i]);
+    }
+    std::fprintf(out, "\n};\n\n");
+}
+
+int main(int argc, char ** argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: %s <output file>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> ascii(128);
+    for (uint32_t pt = 0; pt < 128; ++pt) {
+        ascii[pt] = classify(pt);
+    }
+
+    // Identical blocks are stored once
+    std::map<std::vector<uint8_t>, uint32_t> blocks;
+    std::vector<uint8_t> stage1, stage2;
+    for (uint32_t base = 0; base <= MaxCodepoint; base += BlockSize) {
+        std::vector<uint8_t> block(BlockSize);
+        for (uint32_t i = 0; i < BlockSize; ++i) {
+            block[i] = classify(base + i);
+        }
+        auto found = blocks.find(block);
+        if (found == blocks.end()) {
+            found = blocks.emplace(block, (uint32_t)blocks.size()).first;
+            stage2.insert(stage2.end(), block.begin(), block.end());
+        }
+        if (found->second > 0xFF) {
+            std::fprintf(stderr, "Too many distinct blocks for a byte index,"
+                " raise CharClassShift\n");
+            return 1;
+        }
+        stage1.push_back((uint8_t)found->second);
+    }
+
+    FILE * out = std::fopen(argv[1], "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "Could not open %s\n", argv[1]);
+        return 1;
+    }
+    std::fprintf(out, "// Generated by tsbl_gen_char_class from utf8proc %s,"
+        " do not edit\n\n", utf8proc_version());
+    std::fprintf(out, "#include \"tsbl/char_class.hpp\"\n\n");
+    std::fprintf(out, "namespace tsbl::utf8 {\n\n");
+    write_table(out, "uint8_t", "_g_CharClassAscii", ascii);
+    write_table(out, "uint8_t", "_g_CharClassStage1", stage1);
+    write_table(out, "uint8_t", "_g_CharClassStage2", stage2);
+    std::fprintf(out, "}\n");
+    std::fclose(out);
+    return 0;
+}